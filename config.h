@@ -1,8 +1,15 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+// Rate the DACs are sampled at (Covox, FTL, Stereo-on-1), their native rate
 #define SAMPLE_RATE 96000
 
+// Rate of the I2S output at start, it can be changed at runtime over the serial console (see picovox.c)
+// All devices render at their native rate and one shared resampler converts it (same rates are passed through)
+#ifndef OUTPUT_RATE
+    #define OUTPUT_RATE SAMPLE_RATE
+#endif
+
 // Definitions of GPIO LPT pins
 #define LPT_STROBE_PIN 0    // Beware! STROBE pin must be exactly one position before or after the DATA pins! (Check control down.)
 #define LPT_BASE_PIN 1
@@ -19,9 +26,6 @@
 #define PICO_AUDIO_I2S_CLOCK_PINS_SWAPPED 0
 #define PICO_AUDIO_I2S_DATA_PIN 28
 
-// Definition of unused pin
-#define PICO_UNUSED_PIN 20
-
 // Definitions of GPIO mode switch button (GPIO - ground)
 #define CHANGE_BUTTON_PIN 17
 
@@ -34,4 +38,56 @@
     #error "STROBE pin must be either LPT_BASE_PIN-1 or LPT_BASE_PIN+8"
 #endif
 
+// Timestamped capture of register writes (OPL2LPT, TNDLPT, CMSLPT)
+// When enabled, one PIO program snapshots all LPT pins on every write together with a cycle timestamp,
+// so each write is applied at its exact sample position instead of whenever core1 gets to it.
+#ifndef LPT_TIMESTAMP_CAPTURE
+    #define LPT_TIMESTAMP_CAPTURE 0
+#endif
+
+// First pin of the captured snapshot (16 pins from here are captured)
+#if LPT_STROBE_SWAPPED
+    #define LPT_CAPTURE_BASE_PIN LPT_STROBE_PIN
+#else
+    #define LPT_CAPTURE_BASE_PIN LPT_BASE_PIN
+#endif
+
+#if LPT_TIMESTAMP_CAPTURE && (LPT_INIT_PIN - LPT_CAPTURE_BASE_PIN > 15 || LPT_SELIN_PIN - LPT_CAPTURE_BASE_PIN > 15 || LPT_AUTOFEED_PIN - LPT_CAPTURE_BASE_PIN > 15)
+    #error "LPT_TIMESTAMP_CAPTURE needs INIT, SELIN and AUTOFEED within 16 pins from LPT_CAPTURE_BASE_PIN"
+#endif
+
+// Frames rendered ahead by core1 devices (OPL2LPT, OPL3LPT, TNDLPT, CMSLPT), in ms - core1 renders by a frame clock
+// of its own and the shared resampler keeps their ringbuffers filled to this level by fine adjustments of its ratio
+// (must stay above one output buffer, 512 frames at the lowest output rate)
+#ifndef FILL_TARGET_MS
+    #define FILL_TARGET_MS 20
+#endif
+
+// Rate the Tandy and CMS square generators run at (native rate of both devices)
+#ifndef SQUARE_RATE
+    #define SQUARE_RATE (SAMPLE_RATE / 2)
+#endif
+
+// Band-limited edges (polyBLEP) in the Tandy and CMS square generators - removes most of the aliasing of high notes,
+// so SQUARE_RATE can go down to 24000-32000 and still sound cleaner than hard edges at 48000 (one frame of latency)
+#ifndef SQUARE_BLEP
+    #define SQUARE_BLEP 0
+#endif
+
+// Covox is captured run-length: its PIO program pushes only when the data pins change (with how long the previous
+// value was held) instead of every sample at 3 * SAMPLE_RATE, so FIFO and CPU traffic follow the write rate of the host
+#ifndef COVOX_RUN_LENGTH_CAPTURE
+    #define COVOX_RUN_LENGTH_CAPTURE 0
+#endif
+
+// OPL3LPT is left out of the device list until its render cost is measured on RP2350 (with OPL3_PROFILE)
+#ifndef OPL3_DEVICE
+    #define OPL3_DEVICE 0
+#endif
+
+// Render time of OPL3LPT on core1 is measured and printed once per second of output (cycles per frame vs. budget)
+#ifndef OPL3_PROFILE
+    #define OPL3_PROFILE 0
+#endif
+
 #endif // CONFIG_H
\ No newline at end of file
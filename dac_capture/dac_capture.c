@@ -0,0 +1,162 @@
+#include "dac_capture.h"
+#include "hardware/dma.h"
+
+#define DAC_CAPTURE_MASK (DAC_CAPTURE_SAMPLES - 1)
+
+bool dac_capture_start(dac_capture_t *capture, uint32_t *buffer, PIO pio, uint sm) {
+    capture->channel = dma_claim_unused_channel(false);
+    if (capture->channel < 0) {
+        return false;
+    }
+    capture->buffer = buffer;
+    capture->read = 0;
+    capture->started = false;
+    capture->next_known = false;
+    capture->position = 0;
+    capture->partial_count = 0;
+
+    // FIFO words go one after another into the buffer, write address wraps around within it
+    dma_channel_config config = dma_channel_get_default_config(capture->channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_ring(&config, true, DAC_CAPTURE_RING_BITS);
+    channel_config_set_dreq(&config, pio_get_dreq(pio, sm, false));
+
+    dma_channel_configure(capture->channel, &config, buffer, &pio->rxf[sm], dma_encode_endless_transfer_count(), true);
+    return true;
+}
+
+void dac_capture_stop(dac_capture_t *capture) {
+    if (capture->channel < 0) {
+        return;
+    }
+
+    dma_channel_abort(capture->channel);
+    dma_channel_unclaim(capture->channel);
+    capture->channel = -1;
+}
+
+uint32_t dac_capture_available(dac_capture_t *capture) {
+    uintptr_t write_addr = (uintptr_t) dma_channel_hw_addr(capture->channel)->write_addr;
+    uint32_t write = (uint32_t) (write_addr - (uintptr_t) capture->buffer);
+    return (write - capture->read) & DAC_CAPTURE_MASK;
+}
+
+// Median of three, without branches (samples are compared as unsigned bytes, the conversion keeps the order)
+static inline uint32_t median_of_three(uint32_t a, uint32_t b, uint32_t c) {
+    uint32_t low = (a < b) ? a : b;
+    uint32_t high = (a < b) ? b : a;
+    uint32_t middle = (high < c) ? high : c;
+    return (low > middle) ? low : middle;
+}
+
+static inline int16_t to_sample(uint32_t value) {
+    return (int16_t) (((int32_t) value - 128) << 8);
+}
+
+void dac_capture_read_median(dac_capture_t *capture, int16_t *interleaved, uint32_t frames) {
+    const uint8_t *samples = (const uint8_t *) capture->buffer;
+
+    while (frames > 0) {
+        uint32_t ready = dac_capture_available(capture) / 3;
+        if (ready == 0) {
+            tight_loop_contents();
+            continue;
+        }
+        if (ready > frames) {
+            ready = frames;
+        }
+
+        // Everything written so far is filtered in one pass
+        uint32_t read = capture->read;
+        for (uint32_t i = 0; i < ready; i++) {
+            uint32_t a = samples[read];
+            uint32_t b = samples[(read + 1) & DAC_CAPTURE_MASK];
+            uint32_t c = samples[(read + 2) & DAC_CAPTURE_MASK];
+            read = (read + 3) & DAC_CAPTURE_MASK;
+
+            int16_t sample = to_sample(median_of_three(a, b, c));
+            interleaved[0] = sample;
+            interleaved[1] = sample;
+            interleaved += 2;
+        }
+        capture->read = read;
+        frames -= ready;
+    }
+}
+
+// Reads the word of the next run, false if DMA has not written it yet
+static bool read_next_run(dac_capture_t *capture) {
+    if (dac_capture_available(capture) < sizeof(uint32_t)) {
+        return false;
+    }
+
+    uint32_t word = capture->buffer[capture->read / sizeof(uint32_t)];
+    capture->read = (capture->read + sizeof(uint32_t)) & DAC_CAPTURE_MASK;
+
+    capture->next_value = word & 0xFF;
+    if (capture->started) {
+        // Ticks counted by the hold counter plus the ticks the state machine spent pushing the word of the current run
+        capture->next_start = capture->start + (DAC_CAPTURE_HOLD_MAX - (word >> 8)) + capture->push_ticks;
+    } else {
+        capture->next_start = capture->position; // First word reports the pins at the first tick
+    }
+    capture->next_known = true;
+    return true;
+}
+
+static void start_next_run(dac_capture_t *capture) {
+    // Same value again means the hold counter ran out, pushing that one takes a tick longer than a change
+    bool repeated = capture->started && capture->next_value == capture->value;
+    capture->push_ticks = repeated ? DAC_CAPTURE_REPEAT_TICKS : DAC_CAPTURE_CHANGE_TICKS;
+    capture->value = capture->next_value;
+    capture->start = capture->next_start;
+    capture->started = true;
+    capture->next_known = false;
+}
+
+void dac_capture_read_runs(dac_capture_t *capture, int16_t *interleaved, uint32_t frames) {
+    while (frames > 0) {
+        if (!capture->next_known && !read_next_run(capture)) {
+            tight_loop_contents();
+            continue;
+        }
+
+        uint32_t left = capture->next_start - capture->position; // Ticks left of the current run
+        if (left == 0) {
+            start_next_run(capture);
+            continue;
+        }
+
+        // Frames lying whole within the run are filled at once
+        if (capture->partial_count == 0 && left >= 3) {
+            uint32_t count = left / 3;
+            if (count > frames) {
+                count = frames;
+            }
+
+            int16_t sample = to_sample(capture->value);
+            for (uint32_t i = 0; i < count; i++) {
+                interleaved[0] = sample;
+                interleaved[1] = sample;
+                interleaved += 2;
+            }
+            capture->position += 3 * count;
+            frames -= count;
+            continue;
+        }
+
+        // Frame crossing the end of the run is assembled tick by tick
+        capture->partial[capture->partial_count++] = capture->value;
+        capture->position++;
+        if (capture->partial_count == 3) {
+            int16_t sample = to_sample(median_of_three(capture->partial[0], capture->partial[1], capture->partial[2]));
+            interleaved[0] = sample;
+            interleaved[1] = sample;
+            interleaved += 2;
+            capture->partial_count = 0;
+            frames--;
+        }
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef DAC_CAPTURE_H
+#define DAC_CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hardware/pio.h"
+
+// Size of the circular buffer in bytes as a power of 2 (DMA ring wrap on the write address, at most 15)
+#define DAC_CAPTURE_RING_BITS 12
+#define DAC_CAPTURE_SAMPLES (1u << DAC_CAPTURE_RING_BITS)
+#define DAC_CAPTURE_WORDS (DAC_CAPTURE_SAMPLES / 4)
+
+// Hold counter of the run-length words (same as HOLD_BITS in covox.pio) and ticks taken by pushing a word
+#define DAC_CAPTURE_HOLD_MAX ((1u << 10) - 1)
+#define DAC_CAPTURE_CHANGE_TICKS 2
+#define DAC_CAPTURE_REPEAT_TICKS 3
+
+/**
+ * @brief Declares the circular buffer of one capture (it must be aligned to its size for the DMA ring wrap).
+ */
+#define DAC_CAPTURE_BUFFER(name) static uint32_t name[DAC_CAPTURE_WORDS] __attribute__((aligned(1u << DAC_CAPTURE_RING_BITS)))
+
+/**
+ * @brief Capture of an 8-bit DAC on the LPT data pins (Covox, FTL), streamed from the RX FIFO of its state machine by DMA.
+ *
+ * DMA channel is paced by the RX FIFO and writes the FIFO words into a circular buffer endlessly, so the state machine
+ * never stalls and the CPU does not touch the FIFO at all. Each word packs four samples with the first one in the low
+ * byte (in pins, 8 shifting right with autopush at 32), so the buffer read byte by byte is the sample stream.
+ * Consumer keeps its own read index and takes whatever was written up to the current DMA write address.
+ *
+ * Run-length capture (covox_rle) pushes a word only when the pins change, with the new value in the low byte and the
+ * hold counter left of the previous value above it. Runs are laid back onto the tick grid (3 ticks per frame) and
+ * filtered by the same median. Pins are not sampled while a word is pushed (2-3 ticks), so a change that quickly
+ * follows another one is seen up to 2 ticks late; values held for 3 ticks or more come out the same as sampled ones.
+ * @note Everything except dac_capture_start/stop is used only by the consumer.
+ */
+typedef struct {
+    uint32_t *buffer;
+    int channel;
+    uint32_t read;
+
+    // Run-length decoding - current run, the next one (once its word is read) and the frame being assembled
+    bool started;
+    uint8_t value;
+    uint8_t push_ticks;
+    uint32_t start;
+    bool next_known;
+    uint8_t next_value;
+    uint32_t next_start;
+    uint32_t position;
+    uint8_t partial[3];
+    uint8_t partial_count;
+} dac_capture_t;
+
+/**
+ * @brief Claims a DMA channel and starts streaming the RX FIFO of given state machine into the buffer.
+ * @note Start it before enabling the state machine, so no word is left in the FIFO.
+ *
+ * @param capture is the capture to be started.
+ * @param buffer is the circular buffer declared by DAC_CAPTURE_BUFFER.
+ * @param pio is the PIO the state machine runs in.
+ * @param sm is the state machine pushing four samples per FIFO word.
+ *
+ * @return true if the DMA channel is running, false if there is no free channel.
+ */
+bool dac_capture_start(dac_capture_t *capture, uint32_t *buffer, PIO pio, uint sm);
+
+/**
+ * @brief Stops the DMA channel and releases it.
+ */
+void dac_capture_stop(dac_capture_t *capture);
+
+/**
+ * @brief Returns number of samples written by DMA and not read yet (whole FIFO words only).
+ */
+uint32_t dac_capture_available(dac_capture_t *capture);
+
+/**
+ * @brief Generates frames from the captured samples, each frame is the median of three consecutive samples.
+ * @note Waits for the samples when DMA has not written them yet (the state machine samples 3 times per frame).
+ *
+ * @param interleaved is a pointer to the output buffer, the same sample is stored to both channels.
+ * @param frames is number of stereo frames to be generated.
+ */
+void dac_capture_read_median(dac_capture_t *capture, int16_t *interleaved, uint32_t frames);
+
+/**
+ * @brief Generates frames from run-length words, each frame is the median of the values at its three ticks.
+ * @note Waits until the run covering the last tick has ended (the state machine pushes at least every 1026 ticks).
+ *
+ * @param interleaved is a pointer to the output buffer, the same sample is stored to both channels.
+ * @param frames is number of stereo frames to be generated.
+ */
+void dac_capture_read_runs(dac_capture_t *capture, int16_t *interleaved, uint32_t frames);
+
+#endif // DAC_CAPTURE_H
@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include "pio_manager.h"
 #include "ringbuffer.h"
+#include "lpt_capture.h"
 #include "device.h"
 #include "square/square_c.h"
 #include "pico/multicore.h"
@@ -15,6 +16,13 @@
 
 #define CMS_RINGBUFFER_SIZE 2048
 
+// Core1 renders in blocks of this size (shorter only at the end of ringbuffer), register writes are applied within
+#define CMS_BLOCK_MIN 32
+#define CMS_BLOCK_MAX 128
+
+// Every write due within a block is queued before rendering it, a full queue would apply a write ahead of earlier ones
+_Static_assert(SQUARE_PENDING_WRITES >= LPT_PENDING_WRITES, "render_block queue must hold all writes of the capture");
+
 // Variables for PIO - each device simulated has its own
 static PIO first_pio;
 static int8_t first_sm;
@@ -24,12 +32,20 @@ static PIO second_pio;
 static int8_t second_sm;
 static int second_offset;
 
-static int sample_used = false;
+// Chips render at SQUARE_RATE, the shared resampler converts it to the output rate
+static ringbuffer_t *cms_ringbuffer;
 
 // Killswitch for core1
 static volatile bool stop_core1 = false;
 
-static void write_to_chip(gameblaster_t *device, int16_t current_instruction, bool first) {
+// Register writes waiting for their sample position (used only by core1)
+static lpt_capture_t cms_capture;
+
+static void apply_write(gameblaster_t *device, uint32_t value) {
+    gameblaster_write(device, value >> 8, value & 255);
+}
+
+static void write_to_chip(gameblaster_t *device, int16_t current_instruction, bool first, uint32_t timestamp) {
     uint32_t address = 0x220;
     uint8_t data = 0;
     if (!first) {
@@ -52,42 +68,90 @@ static void write_to_chip(gameblaster_t *device, int16_t current_instruction, bo
     }
 #endif
 
-    gameblaster_write(device, address, data);
+    uint32_t value;
+    if (lpt_capture_full(&cms_capture) && lpt_capture_pop(&cms_capture, &value)) { // No space left, oldest write is applied late rather than lost
+        apply_write(device, value);
+    }
+
+#if LPT_TIMESTAMP_CAPTURE
+    lpt_capture_queue_timed(&cms_capture, (address << 8) | data, timestamp);
+#else
+    lpt_capture_queue(&cms_capture, (address << 8) | data);
+#endif
+}
+
+static bool instruction_waiting(void) {
+#if LPT_TIMESTAMP_CAPTURE
+    return !pio_sm_is_rx_fifo_empty(cms_capture.pio, cms_capture.sm);
+#else
+    return (!pio_sm_is_rx_fifo_empty(first_pio, first_sm)) || (!pio_sm_is_rx_fifo_empty(second_pio, second_sm));
+#endif
 }
 
 static void load_new_instruction(gameblaster_t *device) {
+#if LPT_TIMESTAMP_CAPTURE
+    uint16_t pins;
+    uint32_t timestamp;
+    if (!lpt_capture_read(&cms_capture, &pins, &timestamp)) {
+        return;
+    }
+
+    // Snapshot starts at the same pin as cms.pio reads, both chips may be selected at once (same as with two programs)
+    if (((pins >> (LPT_AUTOFEED_PIN - LPT_CAPTURE_BASE_PIN)) & 1) == 1) {
+        write_to_chip(device, pins & 0x1FF, true, timestamp);
+    }
+    if (((pins >> (LPT_SELIN_PIN - LPT_CAPTURE_BASE_PIN)) & 1) == 1) {
+        write_to_chip(device, pins & 0x1FF, false, timestamp);
+    }
+#else
     if (!pio_sm_is_rx_fifo_empty(first_pio, first_sm)) {
-        write_to_chip(device, pio_sm_get(first_pio, first_sm) >> 23, true);
+        write_to_chip(device, pio_sm_get(first_pio, first_sm) >> 23, true, 0);
     }
     if (!pio_sm_is_rx_fifo_empty(second_pio, second_sm)) {
-        write_to_chip(device, pio_sm_get(second_pio, second_sm) >> 23, false);
+        write_to_chip(device, pio_sm_get(second_pio, second_sm) >> 23, false, 0);
     }
+#endif
 }
 
 static void core1_operation(void) {
     gameblaster_t *device = gameblaster_create();
-    int32_t current_left_sample = 0;
-    int32_t current_right_sample = 0;
-    int16_t register_address = 0;
+    stereo_frame_t *span;
 
     while (!stop_core1) {
-        while ((!pio_sm_is_rx_fifo_empty(first_pio, first_sm)) || (!pio_sm_is_rx_fifo_empty(second_pio, second_sm))) {
+        while (instruction_waiting()) {
             load_new_instruction(device);
         }
-        gameblaster_get_sample(device, &current_left_sample, &current_right_sample);
-        while (ringbuffer_full() && !stop_core1) {
-            load_new_instruction(device);
+
+        size_t due = lpt_capture_frames_due(&cms_capture);
+        if (due < CMS_BLOCK_MIN) {
+            continue; // Wait for the sample clock, but keep reading the writes
         }
-        ringbuffer_push(current_left_sample >> 1);
-        ringbuffer_push(current_right_sample >> 1);
+
+        // Writes due within the block are passed with their frame, gameblaster_render_block splits the block at them
+        size_t position = ringbuffer_produced(cms_ringbuffer);
+        size_t reserved = ringbuffer_reserve(cms_ringbuffer, (due < CMS_BLOCK_MAX) ? due : CMS_BLOCK_MAX, &span);
+        size_t offset;
+        uint32_t value;
+        while ((offset = lpt_capture_frames_until_next(&cms_capture, position)) < reserved && lpt_capture_pop(&cms_capture, &value)) {
+            gameblaster_write_at(device, value >> 8, value & 255, offset);
+        }
+
+        gameblaster_render_block(device, (int16_t *) span, reserved);
+        ringbuffer_commit(cms_ringbuffer, reserved);
     }
     gameblaster_destroy(device);
 }
 
 bool load_cms(Device *self) {
 
-    ringbuffer_init(CMS_RINGBUFFER_SIZE);
+    ringbuffer_reset(cms_ringbuffer);
+    lpt_capture_init(&cms_capture, cms_ringbuffer, SQUARE_RATE);
 
+#if LPT_TIMESTAMP_CAPTURE
+    if (!lpt_capture_load(&cms_capture)) {
+        return false;
+    }
+#else
     first_offset = pio_manager_load(&first_pio, &first_sm, &cms_one_program);
     if (first_offset < 0) {
         return false;
@@ -155,6 +219,7 @@ bool load_cms(Device *self) {
     }
 
     pio_sm_set_enabled(second_pio, second_sm, true);
+#endif
 
     stop_core1 = false;
     multicore_reset_core1();
@@ -164,11 +229,15 @@ bool load_cms(Device *self) {
 
 bool unload_cms(Device *self) {
     stop_core1 = true;
+#if LPT_TIMESTAMP_CAPTURE
+    lpt_capture_unload(&cms_capture);
+#else
     pio_sm_set_enabled(first_pio, first_sm, false);
     pio_manager_unload(first_pio, first_sm, first_offset, &cms_one_program);
 
     pio_sm_set_enabled(second_pio, second_sm, false);
     pio_manager_unload(second_pio, second_sm, second_offset, &cms_two_program);
+#endif
 
     for (int i = LPT_BASE_PIN; i < LPT_BASE_PIN + 8; i++) {
         gpio_deinit(i);
@@ -181,22 +250,24 @@ bool unload_cms(Device *self) {
     return true;
 }
 
-size_t generate_cms(Device *self, int16_t *left_sample, int16_t *right_sample) {
-    if (!sample_used) {
-        sample_used = true;
-        return 0;
-    }
-    sample_used = false;
-    while (ringbuffer_empty()) {
-        tight_loop_contents();
-    }
-    if (!ringbuffer_pop(left_sample)) {
-        *left_sample = 0;
-    }
-    if (!ringbuffer_pop(right_sample)) {
-        *right_sample = 0;
+uint32_t generate_cms_block(Device *self, int16_t *interleaved, uint32_t frames) {
+    stereo_frame_t *output = (stereo_frame_t *) interleaved;
+    for (uint32_t popped = 0; popped < frames;) { // Core1 renders ahead of realtime, waits only on start
+        popped += ringbuffer_pop_bulk(cms_ringbuffer, output + popped, frames - popped);
     }
+    return frames;
+}
+
+uint32_t buffered_cms(Device *self) {
+    return ringbuffer_count(cms_ringbuffer);
+}
 
+size_t generate_cms(Device *self, int16_t *left_sample, int16_t *right_sample) {
+    int16_t frame[2];
+    generate_cms_block(self, frame, 1);
+
+    *left_sample = frame[0];
+    *right_sample = frame[1];
     return 0;
 }
 
@@ -206,9 +277,18 @@ Device *create_cms() {
         return NULL;
     }
 
+    cms_ringbuffer = ringbuffer_create(CMS_RINGBUFFER_SIZE);
+    if (cms_ringbuffer == NULL) {
+        free(cms_struct);
+        return NULL;
+    }
+
     cms_struct->load_device = load_cms;
     cms_struct->unload_device = unload_cms;
     cms_struct->generate_sample = generate_cms;
+    cms_struct->generate_block = generate_cms_block;
+    cms_struct->native_rate = SQUARE_RATE;
+    cms_struct->buffered_frames = buffered_cms;
 
     return cms_struct;
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include "pio_manager.h"
+#include "dac_capture.h"
 #include "device.h"
 #include "hardware/clocks.h"
 #include "hardware/pio.h"
@@ -15,17 +16,35 @@ static PIO used_pio;
 static int8_t used_sm;
 static int used_offset;
 
+// Samples (or run-length words) streamed from the FIFO by DMA, 3 ticks per frame filtered by median
+DAC_CAPTURE_BUFFER(capture_buffer);
+static dac_capture_t capture = { .channel = -1 };
+
+#if COVOX_RUN_LENGTH_CAPTURE
+#define COVOX_PROGRAM covox_rle_program
+#define COVOX_TICK_CYCLES 5 // One pass of the sampling loop in covox_rle
+#else
+#define COVOX_PROGRAM covox_program
+#define COVOX_TICK_CYCLES 1
+#endif
+
 bool load_covox(Device *self) {
 
-    used_offset = pio_manager_load(&used_pio, &used_sm, &covox_program);
+    used_offset = pio_manager_load(&used_pio, &used_sm, &COVOX_PROGRAM);
     if (used_offset < 0) {
         return false;
     }
 
+#if COVOX_RUN_LENGTH_CAPTURE
+    pio_sm_config used_config = covox_rle_program_get_default_config(used_offset);
+    sm_config_set_in_pin_count(&used_config, 8);
+#else
     pio_sm_config used_config = covox_program_get_default_config(used_offset);
+#endif
     sm_config_set_in_pins(&used_config, LPT_BASE_PIN);
+    sm_config_set_in_shift(&used_config, true, true, 32);
     sm_config_set_fifo_join(&used_config, PIO_FIFO_JOIN_RX);
-    sm_config_set_clkdiv(&used_config, (((float) clock_get_hz(clk_sys)) / (SAMPLE_RATE * 2 * 3)));
+    sm_config_set_clkdiv(&used_config, (((float) clock_get_hz(clk_sys)) / (SAMPLE_RATE * 3 * COVOX_TICK_CYCLES))); // 3 ticks per frame
 
     for (int i = LPT_BASE_PIN; i < LPT_BASE_PIN + 8; i++) { // Sets pins to use PIO
         pio_gpio_init(used_pio, i);
@@ -37,13 +56,18 @@ bool load_covox(Device *self) {
         return false;
     }
 
+    if (!dac_capture_start(&capture, capture_buffer, used_pio, used_sm)) {
+        return false;
+    }
+
     pio_sm_set_enabled(used_pio, used_sm, true);
     return true;
 }
 
 bool unload_covox(Device *self) {
     pio_sm_set_enabled(used_pio, used_sm, false);
-    pio_manager_unload(used_pio, used_sm, used_offset, &covox_program);
+    dac_capture_stop(&capture);
+    pio_manager_unload(used_pio, used_sm, used_offset, &COVOX_PROGRAM);
 
     for (int i = LPT_BASE_PIN; i < LPT_BASE_PIN + 8; i++) {
         gpio_deinit(i);
@@ -51,39 +75,20 @@ bool unload_covox(Device *self) {
     return true;
 }
 
-static inline int16_t read_sample(void) {
-    while (pio_sm_is_rx_fifo_empty(used_pio, used_sm)) {
-        tight_loop_contents();
-    }
-    return (((pio_sm_get(used_pio, used_sm) >> 24) & 0xFF) - 128) << 8;
-}
-
-static inline int16_t best_sample(int16_t a, int16_t b, int16_t c) {
-    int16_t max_ab = a;
-    int16_t min_ab = b;
-    if (a < b) {
-        max_ab = b;
-        min_ab = a;
-    }
-
-    if (c >= max_ab) {
-        return max_ab;
-    }
-
-    if (c >= min_ab) {
-        return c;
-    }
-
-    return min_ab;
+uint32_t generate_covox_block(Device *self, int16_t *interleaved, uint32_t frames) {
+#if COVOX_RUN_LENGTH_CAPTURE
+    dac_capture_read_runs(&capture, interleaved, frames);
+#else
+    dac_capture_read_median(&capture, interleaved, frames);
+#endif
+    return frames;
 }
 
 size_t generate_covox(Device *self, int16_t *left_sample, int16_t *right_sample) {
-    int16_t sample1 = read_sample();
-    int16_t sample2 = read_sample();
-    int16_t sample3 = read_sample();
-    int16_t current_sample = best_sample(sample1, sample2, sample3);
-    *left_sample = current_sample;
-    *right_sample = current_sample;
+    int16_t frame[2];
+    generate_covox_block(self, frame, 1);
+    *left_sample = frame[0];
+    *right_sample = frame[1];
     return 0;
 }
 
@@ -96,6 +101,8 @@ Device *create_covox() {
     covox_struct->load_device = load_covox;
     covox_struct->unload_device = unload_covox;
     covox_struct->generate_sample = generate_covox;
+    covox_struct->generate_block = generate_covox_block;
+    covox_struct->native_rate = SAMPLE_RATE;
 
     return covox_struct;
 }
\ No newline at end of file
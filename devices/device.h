@@ -37,6 +37,33 @@ typedef struct Device {
      * @return number of samples available in internal device buffer.
      */
     size_t (*generate_sample)(struct Device *self, int16_t *left_sample, int16_t *right_sample);
+
+    /**
+     * @brief Function generates a whole block of sound frames at native_rate at once (same data source as generate_sample).
+     * @note This is the main entry point of the audio loop, generate_sample is kept only as a per-sample shim.
+     * 
+     * @param self is a pointer to the simulated device itself.
+     * @param interleaved is a pointer to the output buffer, frames are stored as interleaved pairs (left, right).
+     * @param frames is number of stereo frames that should be generated (buffer must hold 2 * frames samples).
+     * 
+     * @return number of frames generated.
+     */
+    uint32_t (*generate_block)(struct Device *self, int16_t *interleaved, uint32_t frames);
+
+    /**
+     * @brief Rate of the frames generated by generate_block (Hz), set when the device is created.
+     * @note Frames are converted to the output rate by the shared resampler (see resampler.h), never by the device.
+     */
+    uint32_t native_rate;
+
+    /**
+     * @brief Function returns number of frames rendered ahead and not consumed yet (NULL if the device renders on demand).
+     * @note Devices rendering on core1 by their own frame clock (or clocked by a timer, DSS) report their ringbuffer,
+     * the shared resampler keeps it filled to FILL_TARGET_MS.
+     *
+     * @param self is a pointer to the simulated device itself.
+     */
+    uint32_t (*buffered_frames)(struct Device *self);
 } Device;
 
 /**
@@ -52,5 +79,7 @@ Device *create_dss();
 Device *create_opl2();
 Device *create_tandy();
 Device *create_cms();
+Device *create_opl3();
+Device *create_dual_opl2();
 
 #endif // DEVICE_H
\ No newline at end of file
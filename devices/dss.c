@@ -8,84 +8,112 @@
 #include "ringbuffer.h"
 #include "device.h"
 #include "hardware/pio.h"
-#include "hardware/irq.h"
 #include "pico/time.h"
-#include "pico/stdlib.h"
 #include "dss.pio.h"
 
-#define DSS_RINGBUFFER_SIZE 16
 #define DSS_SAMPLE_RATE 7000
 
-static const double DSS_RATE_TO_SAMPLE = SAMPLE_RATE / (double) DSS_SAMPLE_RATE;
+// FIFO of the DSS - the joined RX FIFO of the state machine is its input end, the clock moves bytes on from there
+#define DSS_FIFO_DEPTH 16
+#define DSS_PIO_FIFO_DEPTH 8
+
+// Samples clocked out wait here for the resampler, it keeps FILL_TARGET_MS of them (the rest is room for the I2S pool
+// to be drained on a rate change)
+#define DSS_RINGBUFFER_SIZE 1024
+#define DSS_FILL_FRAMES (DSS_SAMPLE_RATE * FILL_TARGET_MS / 1000)
 
 // Variables for PIO - each device simulated has its own
 static PIO used_pio;
 static int8_t used_sm;
 static int used_offset;
-static int8_t used_pio_irq;
-
-// Definitions for repeating the sample
-repeating_timer_t dss_buffer_timer;
-static int16_t current_sample = 0;
-static int16_t repeated_sample = 0;
-static double sample_repeated = 0;
-static bool is_new_sample = true;
-
-void __isr ringbuffer_filler(void) {
-    while (!pio_sm_is_rx_fifo_empty(used_pio, used_sm)) {
-        int16_t pushed_data = (((pio_sm_get(used_pio, used_sm) >> 24) & 0xFF) - 128);
-
-        if (!ringbuffer_push(pushed_data)) {
-            gpio_put(LPT_ACK_PIN, true);
-        }
+static pio_sm_config used_config;
+
+// DSS clock - hardware alarm at DSS_SAMPLE_RATE, period alternates between 142 and 143 us to keep the rate exact
+static repeating_timer_t dss_clock;
+static uint32_t clock_remainder;
+
+// Part of the FIFO past the state machine (used only by the clock)
+static uint8_t fifo[DSS_FIFO_DEPTH];
+static uint32_t fifo_first;
+static uint32_t fifo_count;
+static uint32_t full_level;
+
+static ringbuffer_t *dss_ringbuffer;
+static bool started;
+
+// Bytes waiting in the state machine move on as the FIFO has room
+static void fill_fifo(void) {
+    while (fifo_count < DSS_FIFO_DEPTH && !pio_sm_is_rx_fifo_empty(used_pio, used_sm)) {
+        fifo[(fifo_first + fifo_count) % DSS_FIFO_DEPTH] = pio_sm_get(used_pio, used_sm) >> 24;
+        fifo_count++;
     }
 }
 
-static bool new_sample(repeating_timer_t *timer_for_buffer) {
-    if (ringbuffer_empty()) {
-        current_sample = 0;
-        is_new_sample = true;
-        return true;
+// State machine signals full (ACK) once its level reaches the room left in the FIFO, so ACK follows all 16 entries
+static void set_full_level(uint32_t level) {
+    if (level != full_level) {
+        full_level = level;
+        sm_config_set_mov_status(&used_config, STATUS_RX_LESSTHAN, level);
+        pio_sm_set_config(used_pio, used_sm, &used_config);
     }
+}
 
-    if (ringbuffer_full()) {
-        gpio_put(LPT_ACK_PIN, false);
+// One tick of the DSS clock - next byte from the FIFO, silence if it ran empty
+static bool dss_clock_tick(repeating_timer_t *timer) {
+    fill_fifo();
+    int16_t sample = 0;
+    if (fifo_count > 0) {
+        sample = (fifo[fifo_first] - 128) << 8;
+        fifo_first = (fifo_first + 1) % DSS_FIFO_DEPTH;
+        fifo_count--;
     }
+    fill_fifo();
+
+    uint32_t room = DSS_FIFO_DEPTH - fifo_count;
+    set_full_level((room < DSS_PIO_FIFO_DEPTH) ? room : DSS_PIO_FIFO_DEPTH);
 
-    ringbuffer_pop(&current_sample);
-    is_new_sample = true;
-    current_sample = current_sample << 8;
+    stereo_frame_t frame = { sample, sample };
+    ringbuffer_push(dss_ringbuffer, frame); // Lost only if nothing takes the frames (full ringbuffer)
+
+    // Negative delay counts from the previous tick, not from the end of this one
+    clock_remainder += 1000000 % DSS_SAMPLE_RATE;
+    timer->delay_us = -(int64_t) (1000000 / DSS_SAMPLE_RATE);
+    if (clock_remainder >= DSS_SAMPLE_RATE) {
+        clock_remainder -= DSS_SAMPLE_RATE;
+        timer->delay_us--;
+    }
     return true;
 }
 
 bool load_dss(Device *self) {
-    ringbuffer_init(DSS_RINGBUFFER_SIZE);
-
     used_offset = pio_manager_load(&used_pio, &used_sm, &dss_program);
     if (used_offset < 0) {
         return false;
     }
 
-    used_pio_irq = pio_manager_get_irq(used_pio);
+    fifo_first = 0;
+    fifo_count = 0;
+    full_level = DSS_PIO_FIFO_DEPTH;
+    clock_remainder = 0;
+    started = false;
+    ringbuffer_reset(dss_ringbuffer);
 
-    pio_sm_config used_config = dss_program_get_default_config(used_offset);
+    used_config = dss_program_get_default_config(used_offset);
     sm_config_set_in_pins(&used_config, LPT_BASE_PIN);
-    sm_config_set_fifo_join(&used_config, PIO_FIFO_JOIN_RX);
+    sm_config_set_out_pins(&used_config, LPT_ACK_PIN, 1);
     sm_config_set_jmp_pin(&used_config, LPT_SELIN_PIN);
+    sm_config_set_fifo_join(&used_config, PIO_FIFO_JOIN_RX);
+    sm_config_set_mov_status(&used_config, STATUS_RX_LESSTHAN, full_level);
 
     for (int i = LPT_BASE_PIN; i < LPT_BASE_PIN + 8; i++) { // Sets pins to use PIO
         pio_gpio_init(used_pio, i);
     }
     pio_gpio_init(used_pio, LPT_SELIN_PIN);
-    gpio_init(LPT_ACK_PIN);
-    gpio_set_dir(LPT_ACK_PIN, true);
-
-    pio_sm_set_consecutive_pindirs(used_pio, used_sm, LPT_BASE_PIN, 8, false); // Sets pins in PIO to be inputs
-
-    irq_set_exclusive_handler(used_pio_irq, ringbuffer_filler);
-    irq_set_enabled(used_pio_irq, true);
+    pio_gpio_init(used_pio, LPT_ACK_PIN);
 
-    pio_set_irq0_source_enabled(used_pio, irq_sources[used_sm], true);
+    pio_sm_set_consecutive_pindirs(used_pio, used_sm, LPT_BASE_PIN, 8, false); // Sets pins in PIO to be inputs/outputs
+    pio_sm_set_consecutive_pindirs(used_pio, used_sm, LPT_SELIN_PIN, 1, false);
+    pio_sm_set_consecutive_pindirs(used_pio, used_sm, LPT_ACK_PIN, 1, true);
 
     if (pio_sm_init(used_pio, used_sm, used_offset, &used_config) < 0) {
         return false;
@@ -93,16 +121,12 @@ bool load_dss(Device *self) {
 
     pio_sm_set_enabled(used_pio, used_sm, true);
 
-    add_repeating_timer_us(1000000 / DSS_SAMPLE_RATE, new_sample, NULL, &dss_buffer_timer);
-    return true;
+    return add_repeating_timer_us(-(int64_t) (1000000 / DSS_SAMPLE_RATE), dss_clock_tick, NULL, &dss_clock);
 }
 
 bool unload_dss(Device *self) {
-    cancel_repeating_timer(&dss_buffer_timer);
+    cancel_repeating_timer(&dss_clock);
     pio_sm_set_enabled(used_pio, used_sm, false);
-    pio_set_irq0_source_enabled(used_pio, irq_sources[used_sm], false);
-    irq_set_enabled(used_pio_irq, false);
-    irq_remove_handler(used_pio_irq, ringbuffer_filler);
     pio_manager_unload(used_pio, used_sm, used_offset, &dss_program);
 
     for (int i = LPT_BASE_PIN; i < LPT_BASE_PIN + 8; i++) {
@@ -113,22 +137,34 @@ bool unload_dss(Device *self) {
     return true;
 }
 
-static inline void correct_sample(void) {
-    if (sample_repeated > DSS_RATE_TO_SAMPLE) {
-        while (!is_new_sample) {
-            tight_loop_contents;
-        }
-        sample_repeated -= DSS_RATE_TO_SAMPLE;
-        repeated_sample = current_sample;
-        is_new_sample = false;
+uint32_t generate_dss_block(Device *self, int16_t *interleaved, uint32_t frames) {
+    stereo_frame_t *output = (stereo_frame_t *) interleaved;
+
+    // Clock is let run ahead by the fill target on start, so the first buffers of I2S do not wait for every tick
+    while (!started && ringbuffer_count(dss_ringbuffer) < DSS_FILL_FRAMES) {
+        tight_loop_contents();
+    }
+    started = true;
+
+    // Frames are at the DSS clock, the shared resampler upsamples them (polyphase FIR). Whatever the ringbuffer lacks
+    // is waited for, the frames ahead are mostly held by the I2S pool
+    uint32_t popped = ringbuffer_pop_bulk(dss_ringbuffer, output, frames);
+    while (popped < frames) {
+        tight_loop_contents();
+        popped += ringbuffer_pop_bulk(dss_ringbuffer, output + popped, frames - popped);
     }
-    sample_repeated++;
+    return frames;
+}
+
+uint32_t buffered_dss(Device *self) {
+    return ringbuffer_count(dss_ringbuffer);
 }
 
 size_t generate_dss(Device *self, int16_t *left_sample, int16_t *right_sample) {
-    correct_sample();
-    *left_sample = repeated_sample;
-    *right_sample = repeated_sample;
+    int16_t frame[2];
+    generate_dss_block(self, frame, 1);
+    *left_sample = frame[0];
+    *right_sample = frame[1];
     return 0;
 }
 
@@ -138,9 +174,18 @@ Device *create_dss() {
         return NULL;
     }
 
+    dss_ringbuffer = ringbuffer_create(DSS_RINGBUFFER_SIZE);
+    if (dss_ringbuffer == NULL) {
+        free(dss_struct);
+        return NULL;
+    }
+
     dss_struct->load_device = load_dss;
     dss_struct->unload_device = unload_dss;
     dss_struct->generate_sample = generate_dss;
+    dss_struct->generate_block = generate_dss_block;
+    dss_struct->native_rate = DSS_SAMPLE_RATE;
+    dss_struct->buffered_frames = buffered_dss;
 
     return dss_struct;
-}
\ No newline at end of file
+}
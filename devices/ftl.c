@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include "pio_manager.h"
+#include "dac_capture.h"
 #include "device.h"
 #include "hardware/clocks.h"
 #include "hardware/pio.h"
@@ -15,6 +16,10 @@ static PIO sound_pio;
 static int8_t sound_sm;
 static int sound_offset;
 
+// Samples streamed from the FIFO by DMA (3 per frame, median is taken)
+DAC_CAPTURE_BUFFER(capture_buffer);
+static dac_capture_t capture = { .channel = -1 };
+
 static PIO detection_pio;
 static int8_t detection_sm;
 static int detection_offset;
@@ -33,8 +38,9 @@ bool load_ftl(Device *self) {
 
     pio_sm_config used_config_sound = ftl_sound_program_get_default_config(sound_offset);
     sm_config_set_in_pins(&used_config_sound, LPT_BASE_PIN);
+    sm_config_set_in_shift(&used_config_sound, true, true, 32);
     sm_config_set_fifo_join(&used_config_sound, PIO_FIFO_JOIN_RX);
-    sm_config_set_clkdiv(&used_config_sound, (((float) clock_get_hz(clk_sys)) / (SAMPLE_RATE * 6)));
+    sm_config_set_clkdiv(&used_config_sound, (((float) clock_get_hz(clk_sys)) / (SAMPLE_RATE * 3))); // One sample per cycle
 
     pio_sm_config used_config_detection = ftl_detection_program_get_default_config(detection_offset);
     sm_config_set_in_pins(&used_config_detection, LPT_SELIN_PIN);
@@ -59,6 +65,10 @@ bool load_ftl(Device *self) {
         return false;
     }
 
+    if (!dac_capture_start(&capture, capture_buffer, sound_pio, sound_sm)) {
+        return false;
+    }
+
     pio_sm_set_enabled(sound_pio, sound_sm, true);
     pio_sm_set_enabled(detection_pio, detection_sm, true);
     return true;
@@ -67,6 +77,7 @@ bool load_ftl(Device *self) {
 bool unload_ftl(Device *self) {
     pio_sm_set_enabled(sound_pio, sound_sm, false);
     pio_sm_set_enabled(detection_pio, detection_sm, false);
+    dac_capture_stop(&capture);
     pio_manager_unload(sound_pio, sound_sm, sound_offset, &ftl_sound_program);
     pio_manager_unload(detection_pio, detection_sm, detection_offset, &ftl_detection_program);
 
@@ -78,42 +89,19 @@ bool unload_ftl(Device *self) {
     return true;
 }
 
-static inline int16_t read_sample(void) {
-    while (pio_sm_is_rx_fifo_empty(sound_pio, sound_sm)) {
-        tight_loop_contents();
-    }
-    return (((pio_sm_get(sound_pio, sound_sm) >> 24) & 0xFF) - 128) << 8;
-}
-
-static inline int16_t best_sample(int16_t a, int16_t b, int16_t c) {
-    int16_t max_ab = a;
-    int16_t min_ab = b;
-    if (a < b) {
-        max_ab = b;
-        min_ab = a;
-    }
-
-    if (c >= max_ab) {
-        return max_ab;
-    }
-
-    if (c >= min_ab) {
-        return c;
-    }
-
-    return min_ab;
-}
-
 size_t generate_ftl(Device *self, int16_t *left_sample, int16_t *right_sample) {
-    int16_t sample1 = read_sample();
-    int16_t sample2 = read_sample();
-    int16_t sample3 = read_sample();
-    int16_t current_sample = best_sample(sample1, sample2, sample3);
-    *left_sample = current_sample;
-    *right_sample = current_sample;
+    int16_t frame[2];
+    dac_capture_read_median(&capture, frame, 1);
+    *left_sample = frame[0];
+    *right_sample = frame[1];
     return 0;
 }
 
+uint32_t generate_ftl_block(Device *self, int16_t *interleaved, uint32_t frames) {
+    dac_capture_read_median(&capture, interleaved, frames);
+    return frames;
+}
+
 Device *create_ftl() {
     Device *ftl_struct = calloc(1, sizeof(Device));
     if (ftl_struct == NULL) {
@@ -123,6 +111,8 @@ Device *create_ftl() {
     ftl_struct->load_device = load_ftl;
     ftl_struct->unload_device = unload_ftl;
     ftl_struct->generate_sample = generate_ftl;
+    ftl_struct->generate_block = generate_ftl_block;
+    ftl_struct->native_rate = SAMPLE_RATE;
 
     return ftl_struct;
 }
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include "device.h"
 #include "pio_manager.h"
 #include "ringbuffer.h"
+#include "lpt_capture.h"
 #include "opl/opl.h"
 #include "hardware/clocks.h"
 #include "hardware/pio.h"
@@ -19,139 +20,434 @@
 // Buffer storing samples generated
 #define OPL_RINGBUFFER_SIZE 4096
 
-// Sample repeated 2 times -> for 96kHz, only 48 kHz needed (still high quality, but fast enough)
-#define SAMPLE_REPEAT 2
 
-// Variables for PIO - each device simulated has its own
-static PIO used_pio;
-static int8_t used_sm;
-static int used_offset;
+// Core1 renders in blocks of this size (shorter only when split by a register write or at the end of ringbuffer)
+#define OPL_BLOCK_MIN 32
+#define OPL_BLOCK_MAX 128
+
+// Dual mode - chip is selected by SELIN (same line as OPL3LPT bank), low for the left chip, high for the right one
+#define OPL_SELECT_BIT (LPT_SELIN_PIN - LPT_CAPTURE_BASE_PIN)
+
+#if OPL_SELECT_BIT > 15
+    #error "OPL2LPT needs SELIN within 16 pins from LPT_CAPTURE_BASE_PIN"
+#endif
+
+// Dual mode - both chips mixed to stereo, short as the latency is already given by the ringbuffer of core1 chip
+#define OPL_MIX_RINGBUFFER_SIZE 256
+
+// Dual mode - output is taken in chunks and the mix ringbuffer topped up in between, so it never runs dry
+#define OPL_MIX_OUTPUT_CHUNK 64
+
+/**
+ * @brief One emulated chip with the writes meant for it.
+ *
+ * Each chip listens to the whole port by its own PIO program (same as chips on a real bus) and keeps only writes
+ * with its select level. Core1 reads the writes of both chips, as it polls all the time (core0 renders the right chip
+ * only once per output buffer, its FIFO would fill up meanwhile), and core0 applies those of its chip while mixing.
+ */
+typedef struct {
+    opl_pico_t *opl;
+    int8_t select; // SELIN level of writes for this chip, -1 if it takes all of them (single chip)
+    uint8_t register_address;
+
+    // Register writes waiting for their sample position (queued by core1, applied by the core rendering the chip)
+    lpt_capture_t capture;
+
+    // Variables for PIO (without LPT_TIMESTAMP_CAPTURE)
+    PIO used_pio;
+    int8_t used_sm;
+    int used_offset;
+} opl_chip_t;
+
+// Chip rendered by core1, in dual mode the left one
+static opl_chip_t core1_chip;
+
+// Right chip of dual mode, rendered by core0 while mixing
+static opl_chip_t core0_chip;
 
 // Killswitch for core1
 static volatile bool stop_core1 = false;
 
-static int16_t last_sample = 0;
-static int8_t sample_used = 0;
+// Dual mode - core1 reads the writes of core0 chip as well (set only while core1 is stopped)
+static bool dual_mode = false;
+
+// Chip is rendered at its native rate (OPL_PICO_RATE), the shared resampler converts it to the output rate
+static ringbuffer_t *opl_ringbuffer;
+
+// Dual mode - frames of core1 chip (left) with core0 chip (right), consumed instead of opl_ringbuffer
+static ringbuffer_t *mix_ringbuffer;
+
+static void apply_write(opl_chip_t *chip, uint32_t value) {
+    OPL_Pico_WriteRegister(chip->opl, value >> 8, value & 255);
+}
 
-static void load_new_instruction(int16_t *register_address) {
-    if (pio_sm_is_rx_fifo_empty(used_pio, used_sm)) {
+static void queue_write(opl_chip_t *chip, uint8_t address, uint8_t data, uint32_t timestamp) {
+    uint32_t value;
+    if (lpt_capture_full(&chip->capture) && lpt_capture_pop(&chip->capture, &value)) { // No space left, oldest write is applied late rather than lost
+        apply_write(chip, value);
+    }
+
+#if LPT_TIMESTAMP_CAPTURE
+    lpt_capture_queue_timed(&chip->capture, (address << 8) | data, timestamp);
+#else
+    lpt_capture_queue(&chip->capture, (address << 8) | data);
+#endif
+}
+
+static bool instruction_waiting(opl_chip_t *chip) {
+#if LPT_TIMESTAMP_CAPTURE
+    return !pio_sm_is_rx_fifo_empty(chip->capture.pio, chip->capture.sm);
+#else
+    return !pio_sm_is_rx_fifo_empty(chip->used_pio, chip->used_sm);
+#endif
+}
+
+static void load_new_instruction(opl_chip_t *chip) {
+    uint16_t pins;
+    uint32_t timestamp = 0;
+
+#if LPT_TIMESTAMP_CAPTURE
+    if (!lpt_capture_read(&chip->capture, &pins, &timestamp)) {
         return;
     }
+#else
+    if (pio_sm_is_rx_fifo_empty(chip->used_pio, chip->used_sm)) {
+        return;
+    }
+    pins = (pio_sm_get(chip->used_pio, chip->used_sm) >> 16); // Same snapshot as lpt_timestamp
+#endif
 
-    uint16_t new_instruction = (pio_sm_get(used_pio, used_sm) >> 23);
+    if (chip->select >= 0 && ((pins >> OPL_SELECT_BIT) & 1) != chip->select) { // Write for the other chip
+        return;
+    }
 
 #if LPT_STROBE_SWAPPED
-    if ((new_instruction & 1) == 0) {
-        *register_address = (new_instruction >> 1) & 255;
+    if ((pins & 1) == 0) {
+        chip->register_address = (pins >> 1) & 255;
     } else {
-        OPL_Pico_WriteRegister(*register_address, ((new_instruction >> 1) & 255));
+        queue_write(chip, chip->register_address, (pins >> 1) & 255, timestamp);
     }
 #else
-    if (((new_instruction >> 8) & 1) == 0) {
-        *register_address = new_instruction & 255;
+    if (((pins >> 8) & 1) == 0) {
+        chip->register_address = pins & 255;
     } else {
-        OPL_Pico_WriteRegister(*register_address, (new_instruction & 255));
+        queue_write(chip, chip->register_address, pins & 255, timestamp);
     }
 #endif
 }
 
+// Renders mono samples right into the reserved frames, then spreads them to both channels in place
+static void render_frames(opl_chip_t *chip, stereo_frame_t *frames, size_t count) {
+    int16_t *samples = (int16_t *) frames;
+    OPL_Pico_simple(chip->opl, samples, count);
+
+    // Going backwards, frame i (samples 2i and 2i+1) never overwrites a mono sample not yet spread
+    for (size_t i = count; i-- > 0;) {
+        int16_t sample = samples[i] << 2;
+        frames[i].left = sample;
+        frames[i].right = sample;
+    }
+}
+
 static void core1_operation(void) {
-    OPL_Pico_Init(0);
-    int16_t current_sample = 0;
-    int16_t register_address = 0;
+    opl_chip_t *chip = &core1_chip;
+    chip->opl = OPL_Pico_Init(0);
+    stereo_frame_t *span;
 
     while (!stop_core1) {
-        while ((!pio_sm_is_rx_fifo_empty(used_pio, used_sm))) {
-            load_new_instruction(&register_address);
+        while (instruction_waiting(chip)) {
+            load_new_instruction(chip);
         }
-        OPL_Pico_simple(&current_sample, 1);
-        while (ringbuffer_full() && !stop_core1) {
-            load_new_instruction(&register_address);
+
+        // Stamped by the shared clock right when read, same as the writes of this chip. A full queue is not emptied
+        // here (core0 applies it), the write waits in the FIFO instead.
+        while (dual_mode && !lpt_capture_full(&core0_chip.capture) && instruction_waiting(&core0_chip)) {
+            load_new_instruction(&core0_chip);
+        }
+
+        // Writes due now are applied, block ends right before the next one
+        size_t position = ringbuffer_produced(opl_ringbuffer);
+        uint32_t value;
+        while (lpt_capture_pop_due(&chip->capture, position, &value)) {
+            apply_write(chip, value);
+        }
+
+        size_t wanted = lpt_capture_frames_until_next(&chip->capture, position);
+        if (wanted > OPL_BLOCK_MAX) {
+            wanted = OPL_BLOCK_MAX;
         }
-        ringbuffer_push(current_sample << 2);
+
+        // Wait for the sample clock to reach a whole block, unless the block is cut short by a register write
+        size_t due = lpt_capture_frames_due(&chip->capture);
+        if (due < ((wanted < OPL_BLOCK_MIN) ? wanted : OPL_BLOCK_MIN)) {
+            continue;
+        }
+        if (wanted > due) {
+            wanted = due;
+        }
+
+        size_t reserved = ringbuffer_reserve(opl_ringbuffer, wanted, &span);
+        render_frames(chip, span, reserved);
+        ringbuffer_commit(opl_ringbuffer, reserved);
     }
-    OPL_Pico_delete();
+    OPL_Pico_delete(chip->opl);
+    chip->opl = NULL;
 }
 
-bool load_opl2(Device *self) {
-    ringbuffer_init(OPL_RINGBUFFER_SIZE);
+// Fills the mix ringbuffer with frames of core1 chip (left) and core0 chip rendered next to them (right)
+static void mix_frames(void) {
+    opl_chip_t *chip = &core0_chip;
+    int16_t right[OPL_BLOCK_MAX];
+    const stereo_frame_t *left;
+    stereo_frame_t *span;
 
-    used_offset = pio_manager_load(&used_pio, &used_sm, &opl2_program);
-    if (used_offset < 0) {
-        return false;
+    while (!ringbuffer_full(mix_ringbuffer)) {
+        // Writes are read and stamped by core1 with the clock of its chip (shared capture clock), so both chips sound
+        // with the same latency
+        size_t position = ringbuffer_consumed(opl_ringbuffer);
+        uint32_t value;
+        while (lpt_capture_pop_due(&chip->capture, position, &value)) {
+            apply_write(chip, value);
+        }
+
+        size_t wanted = lpt_capture_frames_until_next(&chip->capture, position);
+        if (wanted > OPL_BLOCK_MAX) {
+            wanted = OPL_BLOCK_MAX;
+        }
+
+        wanted = ringbuffer_peek(opl_ringbuffer, wanted, &left);
+        wanted = ringbuffer_reserve(mix_ringbuffer, wanted, &span);
+        if (wanted == 0) { // Core1 is behind, it renders ahead of realtime so it catches up right away
+            tight_loop_contents();
+            continue;
+        }
+
+        OPL_Pico_simple(chip->opl, right, wanted);
+        for (size_t i = 0; i < wanted; i++) {
+            span[i].left = left[i].left;
+            span[i].right = right[i] << 2;
+        }
+
+        ringbuffer_commit(mix_ringbuffer, wanted);
+        ringbuffer_consume(opl_ringbuffer, wanted);
     }
+}
 
-    pio_sm_config used_config = opl2_program_get_default_config(used_offset);
-#if LPT_STROBE_SWAPPED
-    sm_config_set_in_pins(&used_config, LPT_STROBE_PIN);
+static bool load_chip(opl_chip_t *chip, int8_t select) {
+    chip->select = select;
+    chip->register_address = 0;
+    lpt_capture_init(&chip->capture, opl_ringbuffer, OPL_PICO_RATE);
+
+#if LPT_TIMESTAMP_CAPTURE
+    return lpt_capture_load(&chip->capture);
 #else
-    sm_config_set_in_pins(&used_config, LPT_BASE_PIN);
-#endif
+    chip->used_offset = pio_manager_load(&chip->used_pio, &chip->used_sm, &opl2_program);
+    if (chip->used_offset < 0) {
+        return false;
+    }
+
+    pio_sm_config used_config = opl2_program_get_default_config(chip->used_offset);
+    sm_config_set_in_pins(&used_config, LPT_CAPTURE_BASE_PIN);
     sm_config_set_fifo_join(&used_config, PIO_FIFO_JOIN_RX);
 
-    for (int i = LPT_BASE_PIN; i < LPT_BASE_PIN + 8; i++) { // Sets pins to use PIO
-        pio_gpio_init(used_pio, i);
+    for (int i = LPT_CAPTURE_BASE_PIN; i < LPT_CAPTURE_BASE_PIN + 9; i++) { // Sets pins to use PIO (STROBE, D0-D7)
+        pio_gpio_init(chip->used_pio, i);
     }
+    pio_gpio_init(chip->used_pio, LPT_SELIN_PIN);
+    pio_gpio_init(chip->used_pio, LPT_INIT_PIN);
 
-    pio_gpio_init(used_pio, LPT_STROBE_PIN);
-    pio_gpio_init(used_pio, LPT_INIT_PIN);
-#if LPT_STROBE_SWAPPED
-    pio_sm_set_consecutive_pindirs(used_pio, used_sm, LPT_STROBE_PIN, 9, false); // Sets pins in PIO to be inputs
-#else
-    pio_sm_set_consecutive_pindirs(used_pio, used_sm, LPT_BASE_PIN, 9, false); // Sets pins in PIO to be inputs
-#endif
+    pio_sm_set_consecutive_pindirs(chip->used_pio, chip->used_sm, LPT_CAPTURE_BASE_PIN, 9, false); // Sets pins in PIO to be inputs
+    pio_sm_set_consecutive_pindirs(chip->used_pio, chip->used_sm, LPT_SELIN_PIN, 1, false);
+    pio_sm_set_consecutive_pindirs(chip->used_pio, chip->used_sm, LPT_INIT_PIN, 1, false);
 
-    if (pio_sm_init(used_pio, used_sm, used_offset, &used_config) < 0) {
+    if (pio_sm_init(chip->used_pio, chip->used_sm, chip->used_offset, &used_config) < 0) {
         return false;
     }
 
-    pio_sm_set_enabled(used_pio, used_sm, true);
+    pio_sm_set_enabled(chip->used_pio, chip->used_sm, true);
+    return true;
+#endif
+}
+
+static void unload_chip(opl_chip_t *chip) {
+#if LPT_TIMESTAMP_CAPTURE
+    lpt_capture_unload(&chip->capture);
+#else
+    pio_sm_set_enabled(chip->used_pio, chip->used_sm, false);
+    pio_manager_unload(chip->used_pio, chip->used_sm, chip->used_offset, &opl2_program);
+
+    for (int i = LPT_CAPTURE_BASE_PIN; i < LPT_CAPTURE_BASE_PIN + 9; i++) {
+        gpio_deinit(i);
+    }
+    gpio_deinit(LPT_SELIN_PIN);
+    gpio_deinit(LPT_INIT_PIN);
+#endif
+}
+
+static void launch_core1(bool dual) {
     stop_core1 = false;
     multicore_reset_core1();
+    dual_mode = dual;
     multicore_launch_core1(core1_operation);
+}
+
+bool load_opl2(Device *self) {
+    ringbuffer_reset(opl_ringbuffer);
+
+    if (!load_chip(&core1_chip, -1)) {
+        return false;
+    }
+
+    launch_core1(false);
     return true;
 }
 
 bool unload_opl2(Device *self) {
     stop_core1 = true;
-    pio_sm_set_enabled(used_pio, used_sm, false);
-    pio_manager_unload(used_pio, used_sm, used_offset, &opl2_program);
+    unload_chip(&core1_chip);
+    return true;
+}
 
-    for (int i = LPT_BASE_PIN; i < LPT_BASE_PIN + 8; i++) {
-        gpio_deinit(i);
+uint32_t generate_opl2_block(Device *self, int16_t *interleaved, uint32_t frames) {
+    stereo_frame_t *output = (stereo_frame_t *) interleaved;
+    for (uint32_t popped = 0; popped < frames;) { // Core1 renders ahead of realtime, waits only on start
+        popped += ringbuffer_pop_bulk(opl_ringbuffer, output + popped, frames - popped);
     }
-    gpio_deinit(LPT_STROBE_PIN);
-    gpio_deinit(LPT_INIT_PIN);
-    return true;
+    return frames;
+}
+
+uint32_t buffered_opl2(Device *self) {
+    return ringbuffer_count(opl_ringbuffer);
 }
 
 size_t generate_opl2(Device *self, int16_t *left_sample, int16_t *right_sample) {
+    int16_t frame[2];
+    generate_opl2_block(self, frame, 1);
 
-    if (sample_used >= SAMPLE_REPEAT) {
-        while (ringbuffer_empty()) {
-            tight_loop_contents();
-        }
-        if (!ringbuffer_pop(&last_sample)) {
-            last_sample = 0;
+    *left_sample = frame[0];
+    *right_sample = frame[1];
+    return 0;
+}
+
+bool load_dual_opl2(Device *self) {
+    ringbuffer_reset(opl_ringbuffer);
+    ringbuffer_reset(mix_ringbuffer);
+
+    // Created before core1 starts, so the shared tables of emu8950 are initialized by one core only
+    core0_chip.opl = OPL_Pico_Init(0);
+    if (core0_chip.opl == NULL) {
+        return false;
+    }
+
+    if (!load_chip(&core1_chip, 0)) {
+        OPL_Pico_delete(core0_chip.opl);
+        core0_chip.opl = NULL;
+        return false;
+    }
+
+    if (!load_chip(&core0_chip, 1)) {
+        unload_chip(&core1_chip);
+        OPL_Pico_delete(core0_chip.opl);
+        core0_chip.opl = NULL;
+        return false;
+    }
+    lpt_capture_share_clock(&core0_chip.capture, &core1_chip.capture); // Restarted by core1 for both chips
+
+    launch_core1(true);
+    return true;
+}
+
+bool unload_dual_opl2(Device *self) {
+    stop_core1 = true;
+    unload_chip(&core1_chip);
+    unload_chip(&core0_chip);
+
+    OPL_Pico_delete(core0_chip.opl);
+    core0_chip.opl = NULL;
+    return true;
+}
+
+uint32_t generate_dual_opl2_block(Device *self, int16_t *interleaved, uint32_t frames) {
+    for (uint32_t generated = 0; generated < frames;) {
+        uint32_t chunk = frames - generated;
+        if (chunk > OPL_MIX_OUTPUT_CHUNK) {
+            chunk = OPL_MIX_OUTPUT_CHUNK;
         }
-        sample_used = 0;
+
+        mix_frames();
+        generated += ringbuffer_pop_bulk(mix_ringbuffer, (stereo_frame_t *) interleaved + generated, chunk);
     }
+    return frames;
+}
+
+uint32_t buffered_dual_opl2(Device *self) {
+    return ringbuffer_count(opl_ringbuffer) + ringbuffer_count(mix_ringbuffer);
+}
 
-    *left_sample = last_sample;
-    *right_sample = last_sample;
-    sample_used++;
+size_t generate_dual_opl2(Device *self, int16_t *left_sample, int16_t *right_sample) {
+    int16_t frame[2];
+    generate_dual_opl2_block(self, frame, 1);
+
+    *left_sample = frame[0];
+    *right_sample = frame[1];
     return 0;
 }
 
+// Ringbuffer is shared by both modes (only one device is loaded at a time)
+static bool create_shared(void) {
+    if (opl_ringbuffer == NULL) {
+        opl_ringbuffer = ringbuffer_create(OPL_RINGBUFFER_SIZE);
+        if (opl_ringbuffer == NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
 Device *create_opl2() {
     Device *opl2_struct = calloc(1, sizeof(Device));
     if (opl2_struct == NULL) {
         return NULL;
     }
 
+    if (!create_shared()) {
+        free(opl2_struct);
+        return NULL;
+    }
+
     opl2_struct->load_device = load_opl2;
     opl2_struct->unload_device = unload_opl2;
     opl2_struct->generate_sample = generate_opl2;
+    opl2_struct->generate_block = generate_opl2_block;
+    opl2_struct->native_rate = OPL_PICO_RATE;
+    opl2_struct->buffered_frames = buffered_opl2;
 
     return opl2_struct;
+}
+
+Device *create_dual_opl2() {
+    Device *dual_opl2_struct = calloc(1, sizeof(Device));
+    if (dual_opl2_struct == NULL) {
+        return NULL;
+    }
+
+    if (!create_shared()) {
+        free(dual_opl2_struct);
+        return NULL;
+    }
+
+    mix_ringbuffer = ringbuffer_create(OPL_MIX_RINGBUFFER_SIZE);
+    if (mix_ringbuffer == NULL) {
+        free(dual_opl2_struct);
+        return NULL;
+    }
+
+    dual_opl2_struct->load_device = load_dual_opl2;
+    dual_opl2_struct->unload_device = unload_dual_opl2;
+    dual_opl2_struct->generate_sample = generate_dual_opl2;
+    dual_opl2_struct->generate_block = generate_dual_opl2_block;
+    dual_opl2_struct->native_rate = OPL_PICO_RATE;
+    dual_opl2_struct->buffered_frames = buffered_dual_opl2;
+
+    return dual_opl2_struct;
 }
\ No newline at end of file
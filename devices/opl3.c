@@ -0,0 +1,292 @@
+#include "config.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "device.h"
+#include "pio_manager.h"
+#include "ringbuffer.h"
+#include "lpt_capture.h"
+#include "opl/opl3.h"
+#include "hardware/clocks.h"
+#include "hardware/pio.h"
+#include "pico/multicore.h"
+#include "opl3.pio.h"
+#include "pico/time.h"
+
+#include "pico/stdlib.h"
+
+// Nuked OPL3 runs at 14.318 MHz / 288, chip is reset to exactly this rate so it does no resampling of its own
+#define OPL3_NATIVE_RATE 49716
+
+// Buffer storing frames generated
+#define OPL3_RINGBUFFER_SIZE 4096
+
+// Core1 renders in blocks of this size (shorter only when split by a register write or at the end of ringbuffer)
+#define OPL3_BLOCK_MIN 32
+#define OPL3_BLOCK_MAX 128
+
+// Bank (A1) is taken from SELIN in the same snapshot as data, A0 from STROBE same as OPL2LPT
+#define OPL3_BANK_BIT (LPT_SELIN_PIN - LPT_CAPTURE_BASE_PIN)
+
+#if OPL3_BANK_BIT > 15
+    #error "OPL3LPT needs SELIN within 16 pins from LPT_CAPTURE_BASE_PIN"
+#endif
+
+// Variables for PIO - each device simulated has its own
+static PIO used_pio;
+static int8_t used_sm;
+static int used_offset;
+
+// Killswitch for core1
+static volatile bool stop_core1 = false;
+
+// Chip renders native stereo at OPL3_NATIVE_RATE, the shared resampler converts it to the output rate
+static opl3_chip *opl3;
+static ringbuffer_t *opl3_ringbuffer;
+
+// Register writes waiting for their sample position (used only by core1)
+static lpt_capture_t opl3_capture;
+
+#if OPL3_PROFILE
+// Render time of the frames since the last report (all 36 slots are computed every frame, so it does not depend
+// on how many channels play - any capture measures the full 18 channel load)
+static uint64_t profile_us;
+static uint32_t profile_frames;
+static uint32_t profile_worst;
+
+static void profile_block(uint32_t elapsed_us, size_t frames) {
+    uint32_t cycles_per_us = clock_get_hz(clk_sys) / 1000000;
+    uint32_t block_cycles = (elapsed_us * cycles_per_us) / frames;
+    if (block_cycles > profile_worst) {
+        profile_worst = block_cycles;
+    }
+
+    profile_us += elapsed_us;
+    profile_frames += frames;
+    if (profile_frames < OPL3_NATIVE_RATE) {
+        return;
+    }
+
+    uint32_t budget = clock_get_hz(clk_sys) / OPL3_NATIVE_RATE;
+    uint32_t average = (uint32_t) ((profile_us * cycles_per_us) / profile_frames);
+    printf("OPL3: %lu cycles/frame (worst block %lu), budget %lu cycles/frame, core1 load %lu%%\n",
+        (unsigned long) average, (unsigned long) profile_worst, (unsigned long) budget,
+        (unsigned long) ((average * 100) / budget));
+
+    profile_us = 0;
+    profile_frames = 0;
+    profile_worst = 0;
+}
+#endif
+
+static void apply_write(uint32_t value) {
+    OPL3_WriteRegBuffered(opl3, value >> 8, value & 255);
+}
+
+static void queue_write(uint16_t address, uint8_t data, uint32_t timestamp) {
+    uint32_t value;
+    if (lpt_capture_full(&opl3_capture) && lpt_capture_pop(&opl3_capture, &value)) { // No space left, oldest write is applied late rather than lost
+        apply_write(value);
+    }
+
+#if LPT_TIMESTAMP_CAPTURE
+    lpt_capture_queue_timed(&opl3_capture, (address << 8) | data, timestamp);
+#else
+    lpt_capture_queue(&opl3_capture, (address << 8) | data);
+#endif
+}
+
+static bool instruction_waiting(void) {
+#if LPT_TIMESTAMP_CAPTURE
+    return !pio_sm_is_rx_fifo_empty(opl3_capture.pio, opl3_capture.sm);
+#else
+    return !pio_sm_is_rx_fifo_empty(used_pio, used_sm);
+#endif
+}
+
+static void load_new_instruction(uint16_t *register_address) {
+    uint16_t pins;
+    uint32_t timestamp = 0;
+
+#if LPT_TIMESTAMP_CAPTURE
+    if (!lpt_capture_read(&opl3_capture, &pins, &timestamp)) {
+        return;
+    }
+#else
+    if (pio_sm_is_rx_fifo_empty(used_pio, used_sm)) {
+        return;
+    }
+    pins = (pio_sm_get(used_pio, used_sm) >> 16); // Same snapshot as lpt_timestamp
+#endif
+
+    uint16_t bank = ((pins >> OPL3_BANK_BIT) & 1) << 8;
+
+#if LPT_STROBE_SWAPPED
+    if ((pins & 1) == 0) {
+        *register_address = bank | ((pins >> 1) & 255);
+    } else {
+        queue_write(*register_address, (pins >> 1) & 255, timestamp);
+    }
+#else
+    if (((pins >> 8) & 1) == 0) {
+        *register_address = bank | (pins & 255);
+    } else {
+        queue_write(*register_address, pins & 255, timestamp);
+    }
+#endif
+}
+
+static void core1_operation(void) {
+    OPL3_Reset(opl3, OPL3_NATIVE_RATE);
+    uint16_t register_address = 0;
+    stereo_frame_t *span;
+
+    while (!stop_core1) {
+        while (instruction_waiting()) {
+            load_new_instruction(&register_address);
+        }
+
+        // Writes due now are applied, block ends right before the next one
+        size_t position = ringbuffer_produced(opl3_ringbuffer);
+        uint32_t value;
+        while (lpt_capture_pop_due(&opl3_capture, position, &value)) {
+            apply_write(value);
+        }
+
+        size_t wanted = lpt_capture_frames_until_next(&opl3_capture, position);
+        if (wanted > OPL3_BLOCK_MAX) {
+            wanted = OPL3_BLOCK_MAX;
+        }
+
+        // Wait for the sample clock to reach a whole block, unless the block is cut short by a register write
+        size_t due = lpt_capture_frames_due(&opl3_capture);
+        if (due < ((wanted < OPL3_BLOCK_MIN) ? wanted : OPL3_BLOCK_MIN)) {
+            continue;
+        }
+        if (wanted > due) {
+            wanted = due;
+        }
+
+        size_t reserved = ringbuffer_reserve(opl3_ringbuffer, wanted, &span);
+#if OPL3_PROFILE
+        uint32_t start = time_us_32();
+#endif
+        OPL3_GenerateStream(opl3, (int16_t *) span, reserved); // Interleaved (left, right), same as the frames
+#if OPL3_PROFILE
+        if (reserved > 0) {
+            profile_block(time_us_32() - start, reserved);
+        }
+#endif
+        ringbuffer_commit(opl3_ringbuffer, reserved);
+    }
+}
+
+bool load_opl3(Device *self) {
+    ringbuffer_reset(opl3_ringbuffer);
+    lpt_capture_init(&opl3_capture, opl3_ringbuffer, OPL3_NATIVE_RATE);
+
+#if LPT_TIMESTAMP_CAPTURE
+    if (!lpt_capture_load(&opl3_capture)) {
+        return false;
+    }
+#else
+    used_offset = pio_manager_load(&used_pio, &used_sm, &opl3_program);
+    if (used_offset < 0) {
+        return false;
+    }
+
+    pio_sm_config used_config = opl3_program_get_default_config(used_offset);
+    sm_config_set_in_pins(&used_config, LPT_CAPTURE_BASE_PIN);
+    sm_config_set_fifo_join(&used_config, PIO_FIFO_JOIN_RX);
+
+    for (int i = LPT_CAPTURE_BASE_PIN; i < LPT_CAPTURE_BASE_PIN + 9; i++) { // Sets pins to use PIO (STROBE, D0-D7)
+        pio_gpio_init(used_pio, i);
+    }
+    pio_gpio_init(used_pio, LPT_SELIN_PIN);
+    pio_gpio_init(used_pio, LPT_INIT_PIN);
+
+    pio_sm_set_consecutive_pindirs(used_pio, used_sm, LPT_CAPTURE_BASE_PIN, 9, false); // Sets pins in PIO to be inputs
+    pio_sm_set_consecutive_pindirs(used_pio, used_sm, LPT_SELIN_PIN, 1, false);
+    pio_sm_set_consecutive_pindirs(used_pio, used_sm, LPT_INIT_PIN, 1, false);
+
+    if (pio_sm_init(used_pio, used_sm, used_offset, &used_config) < 0) {
+        return false;
+    }
+
+    pio_sm_set_enabled(used_pio, used_sm, true);
+#endif
+
+    stop_core1 = false;
+    multicore_reset_core1();
+    multicore_launch_core1(core1_operation);
+    return true;
+}
+
+bool unload_opl3(Device *self) {
+    stop_core1 = true;
+#if LPT_TIMESTAMP_CAPTURE
+    lpt_capture_unload(&opl3_capture);
+#else
+    pio_sm_set_enabled(used_pio, used_sm, false);
+    pio_manager_unload(used_pio, used_sm, used_offset, &opl3_program);
+
+    for (int i = LPT_CAPTURE_BASE_PIN; i < LPT_CAPTURE_BASE_PIN + 9; i++) {
+        gpio_deinit(i);
+    }
+    gpio_deinit(LPT_SELIN_PIN);
+    gpio_deinit(LPT_INIT_PIN);
+#endif
+    return true;
+}
+
+uint32_t generate_opl3_block(Device *self, int16_t *interleaved, uint32_t frames) {
+    stereo_frame_t *output = (stereo_frame_t *) interleaved;
+    for (uint32_t popped = 0; popped < frames;) { // Core1 renders ahead of realtime, waits only on start
+        popped += ringbuffer_pop_bulk(opl3_ringbuffer, output + popped, frames - popped);
+    }
+    return frames;
+}
+
+uint32_t buffered_opl3(Device *self) {
+    return ringbuffer_count(opl3_ringbuffer);
+}
+
+size_t generate_opl3(Device *self, int16_t *left_sample, int16_t *right_sample) {
+    int16_t frame[2];
+    generate_opl3_block(self, frame, 1);
+
+    *left_sample = frame[0];
+    *right_sample = frame[1];
+    return 0;
+}
+
+Device *create_opl3() {
+    Device *opl3_struct = calloc(1, sizeof(Device));
+    if (opl3_struct == NULL) {
+        return NULL;
+    }
+
+    opl3 = calloc(1, sizeof(opl3_chip));
+    if (opl3 == NULL) {
+        free(opl3_struct);
+        return NULL;
+    }
+
+    opl3_ringbuffer = ringbuffer_create(OPL3_RINGBUFFER_SIZE);
+    if (opl3_ringbuffer == NULL) {
+        free(opl3);
+        free(opl3_struct);
+        return NULL;
+    }
+
+    opl3_struct->load_device = load_opl3;
+    opl3_struct->unload_device = unload_opl3;
+    opl3_struct->generate_sample = generate_opl3;
+    opl3_struct->generate_block = generate_opl3_block;
+    opl3_struct->native_rate = OPL3_NATIVE_RATE;
+    opl3_struct->buffered_frames = buffered_opl3;
+
+    return opl3_struct;
+}
\ No newline at end of file
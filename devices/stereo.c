@@ -6,15 +6,17 @@
 #include <stdlib.h>
 #include "device.h"
 #include "pio_manager.h"
-#include "ringbuffer.h"
 #include "hardware/clocks.h"
+#include "hardware/dma.h"
 #include "hardware/pio.h"
-#include "hardware/irq.h"
-#include "hardware/pwm.h"
-#include "pico/time.h"
 #include "stereo.pio.h"
 
-#define STEREO_RINGBUFFER_SIZE 2048
+// Ring of sampled frames in bytes as a power of 2 (DMA ring wrap on the write address), each frame is 2 bytes
+#define STEREO_RING_BITS 12
+#define STEREO_RING_FRAMES ((1u << STEREO_RING_BITS) / sizeof(uint16_t))
+
+// Frame clock and I2S clock come from different dividers; when reading falls this far behind, old frames are dropped
+#define STEREO_MAX_BEHIND (STEREO_RING_FRAMES / 2)
 
 // Variables for PIO - each device simulated has its own
 static PIO sound_left_pio;
@@ -29,24 +31,102 @@ static PIO detection_pio;
 static int8_t detection_sm;
 static int detection_offset;
 
-static int16_t last_left_sample = 0;
-static int16_t last_right_sample = 0;
-static uint pwm_slice;
+// Last byte written to each channel (left, right), kept there by one DMA channel per FIFO
+static volatile uint8_t latch[2] __attribute__((aligned(2)));
+
+// Latched pair sampled at SAMPLE_RATE by a timer-paced DMA channel, low byte is left
+static uint16_t frame_ring[STEREO_RING_FRAMES] __attribute__((aligned(1u << STEREO_RING_BITS)));
+static uint32_t frame_read;
+
+static int latch_left_channel = -1;
+static int latch_right_channel = -1;
+static int frame_channel = -1;
+static int frame_timer = -1;
+
+static uint32_t greatest_common_divisor(uint32_t a, uint32_t b) {
+    while (b != 0) {
+        uint32_t rest = a % b;
+        a = b;
+        b = rest;
+    }
+    return a;
+}
+
+// Channel keeping the top byte of every word pushed by the state machine in the latch
+static int start_latch(PIO pio, uint sm, volatile uint8_t *target) {
+    int channel = dma_claim_unused_channel(false);
+    if (channel < 0) {
+        return -1;
+    }
+
+    dma_channel_config config = dma_channel_get_default_config(channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, pio_get_dreq(pio, sm, false));
+    dma_channel_configure(channel, &config, target, (const volatile uint8_t *) &pio->rxf[sm] + 3,
+                          dma_encode_endless_transfer_count(), true);
+    return channel;
+}
+
+static bool start_sampling(void) {
+    latch[0] = 128;
+    latch[1] = 128;
+    frame_read = 0;
+
+    latch_left_channel = start_latch(sound_left_pio, sound_left_sm, &latch[0]);
+    latch_right_channel = start_latch(sound_right_pio, sound_right_sm, &latch[1]);
+    frame_channel = dma_claim_unused_channel(false);
+    frame_timer = dma_claim_unused_timer(false);
+    if (latch_left_channel < 0 || latch_right_channel < 0 || frame_channel < 0 || frame_timer < 0) {
+        return false;
+    }
+
+    // Timer runs at clk_sys * numerator / denominator (both 16-bit)
+    uint32_t divisor = greatest_common_divisor(clock_get_hz(clk_sys), SAMPLE_RATE);
+    uint32_t numerator = SAMPLE_RATE / divisor;
+    uint32_t denominator = clock_get_hz(clk_sys) / divisor;
+    while (denominator > 0xFFFF) {
+        numerator = (numerator + 1) / 2;
+        denominator /= 2;
+    }
+    dma_timer_set_fraction(frame_timer, numerator, denominator);
+
+    dma_channel_config config = dma_channel_get_default_config(frame_channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_ring(&config, true, STEREO_RING_BITS);
+    channel_config_set_dreq(&config, dma_get_timer_dreq(frame_timer));
+    dma_channel_configure(frame_channel, &config, frame_ring, latch, dma_encode_endless_transfer_count(), true);
+    return true;
+}
 
-static void get_samples(void) {
-    pwm_clear_irq(pwm_slice);
-    if (!pio_sm_is_rx_fifo_empty(sound_left_pio, sound_left_sm)) {
-        last_left_sample = (((pio_sm_get(sound_left_pio, sound_left_sm) >> 24) & 0xFF) - 128) << 8;
+static void stop_channel(int *channel) {
+    if (*channel >= 0) {
+        dma_channel_abort(*channel);
+        dma_channel_unclaim(*channel);
+        *channel = -1;
     }
-    if (!pio_sm_is_rx_fifo_empty(sound_right_pio, sound_right_sm)) {
-        last_right_sample = (((pio_sm_get(sound_right_pio, sound_right_sm) >> 24) & 0xFF) - 128) << 8;
+}
+
+static void stop_sampling(void) {
+    stop_channel(&frame_channel);
+    stop_channel(&latch_left_channel);
+    stop_channel(&latch_right_channel);
+    if (frame_timer >= 0) {
+        dma_timer_unclaim(frame_timer);
+        frame_timer = -1;
     }
-    ringbuffer_push(last_left_sample);
-    ringbuffer_push(last_right_sample);
+}
+
+static uint32_t frames_available(void) {
+    uintptr_t write_addr = (uintptr_t) dma_channel_hw_addr(frame_channel)->write_addr;
+    uint32_t write = (uint32_t) (write_addr - (uintptr_t) frame_ring) / sizeof(uint16_t);
+    return (write - frame_read) & (STEREO_RING_FRAMES - 1);
 }
 
 bool load_stereo(Device *self) {
-    ringbuffer_init(STEREO_RINGBUFFER_SIZE);
 
     sound_left_offset = pio_manager_load(&sound_left_pio, &sound_left_sm, &stereo_left_program);
     if (sound_left_offset < 0) {
@@ -115,25 +195,16 @@ bool load_stereo(Device *self) {
 
     pio_sm_set_enabled(detection_pio, detection_sm, true);
 
-    gpio_set_function(PICO_UNUSED_PIN, GPIO_FUNC_PWM);
-    pwm_slice = pwm_gpio_to_slice_num(PICO_UNUSED_PIN);
-    uint16_t top = (clock_get_hz(clk_sys) + SAMPLE_RATE / 2) / SAMPLE_RATE - 1;
-    pwm_set_clkdiv(pwm_slice, 1.0f);
-    pwm_set_wrap(pwm_slice, top);
-    pwm_set_gpio_level(PICO_UNUSED_PIN, top/2);
-    pwm_clear_irq(pwm_slice);
-    pwm_set_irq_enabled(pwm_slice, true);
-    irq_set_exclusive_handler(PWM_IRQ_WRAP, get_samples);
-    irq_set_enabled(PWM_IRQ_WRAP, true);
-    pwm_set_enabled(pwm_slice, true);
+    // Latches and the frame clock run on DMA only, CPU reads whole blocks of frames
+    if (!start_sampling()) {
+        return false;
+    }
 
     return true;
 }
 
 bool unload_stereo(Device *self) {
-    pwm_set_enabled(pwm_slice, false);
-    irq_set_enabled(PWM_IRQ_WRAP, false);
-    irq_remove_handler(PWM_IRQ_WRAP, get_samples);
+    stop_sampling();
 
     pio_sm_set_enabled(sound_left_pio, sound_left_sm, false);
     pio_sm_set_enabled(sound_right_pio, sound_right_sm, false);
@@ -152,11 +223,38 @@ bool unload_stereo(Device *self) {
     return true;
 }
 
-size_t generate_stereo(Device *self, int16_t *left_sample, int16_t *right_sample) {  
-    while (!ringbuffer_pop(left_sample)) {
-        tight_loop_contents();
+uint32_t generate_stereo_block(Device *self, int16_t *interleaved, uint32_t frames) {
+    uint32_t frame = 0;
+    while (frame < frames) {
+        uint32_t available = frames_available();
+        if (available == 0) {
+            tight_loop_contents();
+            continue;
+        }
+        if (available > STEREO_MAX_BEHIND) {
+            frame_read = (frame_read + available - STEREO_MAX_BEHIND / 2) & (STEREO_RING_FRAMES - 1);
+            available = STEREO_MAX_BEHIND / 2;
+        }
+        if (available > frames - frame) {
+            available = frames - frame;
+        }
+
+        for (uint32_t i = 0; i < available; i++) {
+            uint16_t pair = frame_ring[frame_read];
+            frame_read = (frame_read + 1) & (STEREO_RING_FRAMES - 1);
+            interleaved[2 * frame] = (int16_t) (((int32_t) (pair & 0xFF) - 128) << 8);
+            interleaved[2 * frame + 1] = (int16_t) (((int32_t) (pair >> 8) - 128) << 8);
+            frame++;
+        }
     }
-    ringbuffer_pop(right_sample);
+    return frames;
+}
+
+size_t generate_stereo(Device *self, int16_t *left_sample, int16_t *right_sample) {
+    int16_t frame[2];
+    generate_stereo_block(self, frame, 1);
+    *left_sample = frame[0];
+    *right_sample = frame[1];
     return 0;
 }
 
@@ -169,6 +267,8 @@ Device *create_stereo() {
     stereo_struct->load_device = load_stereo;
     stereo_struct->unload_device = unload_stereo;
     stereo_struct->generate_sample = generate_stereo;
+    stereo_struct->generate_block = generate_stereo_block;
+    stereo_struct->native_rate = SAMPLE_RATE;
 
     return stereo_struct;
 }
\ No newline at end of file
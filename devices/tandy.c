@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include "pio_manager.h"
 #include "ringbuffer.h"
+#include "lpt_capture.h"
 #include "device.h"
 #include "square/square_c.h"
 #include "pico/multicore.h"
@@ -16,6 +17,13 @@
 #define TND_RINGBUFFER_SIZE 2048
 #define TND_DETECTION_FREQ_HZ 4000000
 
+// Core1 renders in blocks of this size (shorter only at the end of ringbuffer), register writes are applied within
+#define TND_BLOCK_MIN 32
+#define TND_BLOCK_MAX 128
+
+// Every write due within a block is queued before rendering it, a full queue would apply a write ahead of earlier ones
+_Static_assert(SQUARE_PENDING_WRITES >= LPT_PENDING_WRITES, "render_block queue must hold all writes of the capture");
+
 // Variables for PIO - each device simulated has its own
 static PIO sound_pio;
 static int8_t sound_sm;
@@ -28,14 +36,50 @@ static int detection_offset;
 // Killswitch for core1
 static volatile bool stop_core1 = false;
 
-static bool sample_used = false;
+// Chip renders at SQUARE_RATE, the shared resampler converts it to the output rate
+static ringbuffer_t *tandy_ringbuffer;
+
+// Register writes waiting for their sample position (used only by core1)
+static lpt_capture_t tandy_capture;
+
+static bool instruction_waiting(void) {
+#if LPT_TIMESTAMP_CAPTURE
+    return !pio_sm_is_rx_fifo_empty(tandy_capture.pio, tandy_capture.sm);
+#else
+    return !pio_sm_is_rx_fifo_empty(sound_pio, sound_sm);
+#endif
+}
 
 static void load_new_instruction(tandy_t *device) {
+    uint8_t data;
+    uint32_t value;
+
+#if LPT_TIMESTAMP_CAPTURE
+    uint16_t pins;
+    uint32_t timestamp;
+    if (!lpt_capture_read(&tandy_capture, &pins, &timestamp)) {
+        return;
+    }
+    if (((pins >> (LPT_STROBE_PIN - LPT_CAPTURE_BASE_PIN)) & 1) != 0) { // Chip not selected (STROBE high), tandy_sound ignores it too
+        return;
+    }
+    data = (pins >> (LPT_BASE_PIN - LPT_CAPTURE_BASE_PIN)) & 255;
+#else
     if (pio_sm_is_rx_fifo_empty(sound_pio, sound_sm)) {
         return;
     }
+    data = pio_sm_get(sound_pio, sound_sm) >> 24;
+#endif
 
-    tandy_write(device, pio_sm_get(sound_pio, sound_sm) >> 24);
+    if (lpt_capture_full(&tandy_capture) && lpt_capture_pop(&tandy_capture, &value)) { // No space left, oldest write is applied late rather than lost
+        tandy_write(device, value);
+    }
+
+#if LPT_TIMESTAMP_CAPTURE
+    lpt_capture_queue_timed(&tandy_capture, data, timestamp);
+#else
+    lpt_capture_queue(&tandy_capture, data);
+#endif
 }
 
 static void reset_chip(tandy_t **device) {
@@ -49,32 +93,50 @@ static void reset_chip(tandy_t **device) {
 
 static void core1_operation(void) {
     tandy_t *device = tandy_create();
-    int16_t current_sample = 0;
+    stereo_frame_t *span;
 
     while (!stop_core1) {
-        while ((!pio_sm_is_rx_fifo_empty(sound_pio, sound_sm))) {
+        while (instruction_waiting()) {
             load_new_instruction(device);
         }
-        current_sample = tandy_get_sample(device);
-        while (ringbuffer_full() && !stop_core1) {
-            load_new_instruction(device);
+
+        size_t due = lpt_capture_frames_due(&tandy_capture);
+        if (due < TND_BLOCK_MIN) {
+            continue; // Wait for the sample clock, but keep reading the writes
         }
-        ringbuffer_push(current_sample);
+
+        // Writes due within the block are passed with their frame, tandy_render_block splits the block at them
+        size_t position = ringbuffer_produced(tandy_ringbuffer);
+        size_t reserved = ringbuffer_reserve(tandy_ringbuffer, (due < TND_BLOCK_MAX) ? due : TND_BLOCK_MAX, &span);
+        size_t offset;
+        uint32_t value;
+        while ((offset = lpt_capture_frames_until_next(&tandy_capture, position)) < reserved && lpt_capture_pop(&tandy_capture, &value)) {
+            tandy_write_at(device, value, offset);
+        }
+
+        tandy_render_block(device, (int16_t *) span, reserved);
+        ringbuffer_commit(tandy_ringbuffer, reserved);
     }
     tandy_destroy(device);
 }
 
 bool load_tandy(Device *self) {
 
-    ringbuffer_init(TND_RINGBUFFER_SIZE);
+    ringbuffer_reset(tandy_ringbuffer);
+    lpt_capture_init(&tandy_capture, tandy_ringbuffer, SQUARE_RATE);
 
-    sound_offset = pio_manager_load(&sound_pio, &sound_sm, &tandy_sound_program);
-    if (sound_offset < 0) {
+    detection_offset = pio_manager_load(&detection_pio, &detection_sm, &tandy_detection_program);
+    if (detection_offset < 0) {
         return false;
     }
 
-    detection_offset = pio_manager_load(&detection_pio, &detection_sm, &tandy_detection_program);
-    if (detection_offset < 0) {
+#if LPT_TIMESTAMP_CAPTURE
+    if (!lpt_capture_load(&tandy_capture)) {
+        return false;
+    }
+#else
+    sound_offset = pio_manager_load(&sound_pio, &sound_sm, &tandy_sound_program);
+    if (sound_offset < 0) {
         return false;
     }
 
@@ -98,6 +160,7 @@ bool load_tandy(Device *self) {
     }
 
     pio_sm_set_enabled(sound_pio, sound_sm, true);
+#endif
 
     pio_sm_config detection_config = tandy_detection_program_get_default_config(detection_offset);
     sm_config_set_set_pins(&detection_config, LPT_ACK_PIN, 1);
@@ -123,8 +186,12 @@ bool load_tandy(Device *self) {
 
 bool unload_tandy(Device *self) {
     stop_core1 = true;
+#if LPT_TIMESTAMP_CAPTURE
+    lpt_capture_unload(&tandy_capture);
+#else
     pio_sm_set_enabled(sound_pio, sound_sm, false);
     pio_manager_unload(sound_pio, sound_sm, sound_offset, &tandy_sound_program);
+#endif
 
     pio_sm_set_enabled(detection_pio, detection_sm, false);
     pio_manager_unload(detection_pio, detection_sm, detection_offset, &tandy_detection_program);
@@ -140,22 +207,24 @@ bool unload_tandy(Device *self) {
     return true;
 }
 
-size_t generate_tandy(Device *self, int16_t *left_sample, int16_t *right_sample) {
-    if (!sample_used) {
-        sample_used = true;
-        return 0;
-    }
-    sample_used = false;
-    int16_t curr_sample = 0;
-    while (ringbuffer_empty()) {
-        tight_loop_contents();
-    }
-    if (!ringbuffer_pop(&curr_sample)) {
-        curr_sample = 0;
+uint32_t generate_tandy_block(Device *self, int16_t *interleaved, uint32_t frames) {
+    stereo_frame_t *output = (stereo_frame_t *) interleaved;
+    for (uint32_t popped = 0; popped < frames;) { // Core1 renders ahead of realtime, waits only on start
+        popped += ringbuffer_pop_bulk(tandy_ringbuffer, output + popped, frames - popped);
     }
+    return frames;
+}
 
-    *left_sample = curr_sample;
-    *right_sample = curr_sample;
+uint32_t buffered_tandy(Device *self) {
+    return ringbuffer_count(tandy_ringbuffer);
+}
+
+size_t generate_tandy(Device *self, int16_t *left_sample, int16_t *right_sample) {
+    int16_t frame[2];
+    generate_tandy_block(self, frame, 1);
+
+    *left_sample = frame[0];
+    *right_sample = frame[1];
     return 0;
 }
 
@@ -165,9 +234,18 @@ Device *create_tandy() {
         return NULL;
     }
 
+    tandy_ringbuffer = ringbuffer_create(TND_RINGBUFFER_SIZE);
+    if (tandy_ringbuffer == NULL) {
+        free(tandy_struct);
+        return NULL;
+    }
+
     tandy_struct->load_device = load_tandy;
     tandy_struct->unload_device = unload_tandy;
     tandy_struct->generate_sample = generate_tandy;
+    tandy_struct->generate_block = generate_tandy_block;
+    tandy_struct->native_rate = SQUARE_RATE;
+    tandy_struct->buffered_frames = buffered_tandy;
 
     return tandy_struct;
 }
\ No newline at end of file
@@ -0,0 +1,70 @@
+# Generates host stand-ins of the headers pioasm would produce.
+#
+# The programs are never executed on the host, so only the parts used by the C code are emitted:
+# <name>_program (with the instruction count and program name) and <name>_program_get_default_config.
+# Configure is re-run whenever any of the .pio files changes.
+
+function(picovox_host_generate_pio_headers TARGET OUTPUT_DIR)
+    file(MAKE_DIRECTORY ${OUTPUT_DIR})
+
+    foreach(PIO_FILE ${ARGN})
+        set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS ${PIO_FILE})
+        get_filename_component(PIO_BASENAME ${PIO_FILE} NAME_WE)
+
+        file(STRINGS ${PIO_FILE} PIO_LINES)
+        set(PROGRAMS "")
+        set(CURRENT "")
+
+        foreach(LINE IN LISTS PIO_LINES)
+            string(REGEX REPLACE ";.*$" "" LINE "${LINE}")
+            string(STRIP "${LINE}" STRIPPED)
+
+            if (STRIPPED MATCHES "^\\.program[ \t]+([A-Za-z0-9_]+)")
+                set(CURRENT ${CMAKE_MATCH_1})
+                list(APPEND PROGRAMS ${CURRENT})
+                set(LENGTH_${CURRENT} 0)
+                set(WRAP_TARGET_${CURRENT} 0)
+                set(WRAP_${CURRENT} -1)
+            elseif (CURRENT STREQUAL "" OR STRIPPED STREQUAL "")
+                continue()
+            elseif (STRIPPED STREQUAL ".wrap_target")
+                set(WRAP_TARGET_${CURRENT} ${LENGTH_${CURRENT}})
+            elseif (STRIPPED STREQUAL ".wrap")
+                math(EXPR WRAP_${CURRENT} "${LENGTH_${CURRENT}} - 1")
+            elseif (STRIPPED MATCHES "^\\." OR STRIPPED MATCHES "^[A-Za-z0-9_]+:$")
+                # Other directives and labels take no instruction slot
+            else()
+                math(EXPR LENGTH_${CURRENT} "${LENGTH_${CURRENT}} + 1")
+            endif()
+        endforeach()
+
+        string(TOUPPER ${PIO_BASENAME} GUARD)
+        set(CONTENT "// Generated by picovox_host_generate_pio_headers from ${PIO_BASENAME}.pio, do not edit\n\n")
+        string(APPEND CONTENT "#ifndef ${GUARD}_PIO_H\n#define ${GUARD}_PIO_H\n\n#include \"hardware/pio.h\"\n")
+
+        foreach(PROGRAM IN LISTS PROGRAMS)
+            set(LENGTH ${LENGTH_${PROGRAM}})
+            set(WRAP ${WRAP_${PROGRAM}})
+            if (WRAP LESS 0)
+                math(EXPR WRAP "${LENGTH} - 1")
+            endif()
+
+            string(APPEND CONTENT "\nstatic const uint16_t ${PROGRAM}_program_instructions[${LENGTH}] = { 0 };\n\n")
+            string(APPEND CONTENT "static const pio_program_t ${PROGRAM}_program = {\n")
+            string(APPEND CONTENT "    .instructions = ${PROGRAM}_program_instructions,\n")
+            string(APPEND CONTENT "    .length = ${LENGTH},\n")
+            string(APPEND CONTENT "    .origin = -1,\n")
+            string(APPEND CONTENT "    .name = \"${PROGRAM}\",\n};\n\n")
+            string(APPEND CONTENT "static inline pio_sm_config ${PROGRAM}_program_get_default_config(uint offset) {\n")
+            string(APPEND CONTENT "    pio_sm_config c = pio_get_default_sm_config();\n")
+            string(APPEND CONTENT "    sm_config_set_wrap(&c, offset + ${WRAP_TARGET_${PROGRAM}}, offset + ${WRAP});\n")
+            string(APPEND CONTENT "    c.program = &${PROGRAM}_program;\n")
+            string(APPEND CONTENT "    return c;\n}\n")
+        endforeach()
+
+        string(APPEND CONTENT "\n#endif\n")
+        file(CONFIGURE OUTPUT ${OUTPUT_DIR}/${PIO_BASENAME}.pio.h CONTENT "${CONTENT}" @ONLY)
+    endforeach()
+
+    target_include_directories(${TARGET} PUBLIC ${OUTPUT_DIR})
+endfunction()
@@ -0,0 +1,148 @@
+#include "pico_host.h"
+
+#include <stdlib.h>
+
+// Consumer of audio_i2s_connect takes this many frames at a time (pico-extras default)
+#define HOST_I2S_TAKE_FRAMES 256
+
+// How often a producer waiting for a free buffer looks at the consumer again
+#define HOST_I2S_POLL_US 50
+
+// Producer buffers circulate through two queues of indices - free ones and the ones given to the consumer
+static struct {
+    bool running;
+    uint32_t rate;
+    uint buffer_count;
+    uint buffer_frames;
+    int16_t *samples;
+    uint32_t *given_frames;
+
+    uint *free_queue;
+    uint free_first;
+    uint free_count;
+    uint *full_queue;
+    uint full_first;
+    uint full_count;
+    uint32_t copied;        // Frames of the oldest given buffer the consumer already took
+
+    uint64_t started_us;
+    uint64_t takes_done;
+    bool given_any;
+    uint64_t underrun_frames;
+} i2s;
+
+bool host_i2s_start(uint32_t rate, uint buffer_count, uint buffer_frames) {
+    host_i2s_stop();
+
+    i2s.samples = calloc((size_t) buffer_count * buffer_frames * 2, sizeof(int16_t));
+    i2s.given_frames = calloc(buffer_count, sizeof(uint32_t));
+    i2s.free_queue = calloc(buffer_count, sizeof(uint));
+    i2s.full_queue = calloc(buffer_count, sizeof(uint));
+    if (i2s.samples == NULL || i2s.given_frames == NULL || i2s.free_queue == NULL || i2s.full_queue == NULL) {
+        host_i2s_stop();
+        return false;
+    }
+
+    i2s.rate = rate;
+    i2s.buffer_count = buffer_count;
+    i2s.buffer_frames = buffer_frames;
+    for (uint i = 0; i < buffer_count; i++) {
+        i2s.free_queue[i] = i;
+    }
+    i2s.free_first = 0;
+    i2s.free_count = buffer_count;
+    i2s.full_first = 0;
+    i2s.full_count = 0;
+    i2s.copied = 0;
+
+    i2s.started_us = time_us_64();
+    i2s.takes_done = 0;
+    i2s.given_any = false;
+    i2s.underrun_frames = 0;
+    i2s.running = true;
+    return true;
+}
+
+void host_i2s_stop(void) {
+    i2s.running = false;
+    free(i2s.samples);
+    free(i2s.given_frames);
+    free(i2s.free_queue);
+    free(i2s.full_queue);
+    i2s.samples = NULL;
+    i2s.given_frames = NULL;
+    i2s.free_queue = NULL;
+    i2s.full_queue = NULL;
+}
+
+// One take of the consumer - copies across given buffers, frees each once all of it was taken, plays silence for the rest
+static void consumer_take(void) {
+    uint32_t wanted = HOST_I2S_TAKE_FRAMES;
+    while (wanted > 0 && i2s.full_count > 0) {
+        uint buffer = i2s.full_queue[i2s.full_first];
+        uint32_t left = i2s.given_frames[buffer] - i2s.copied;
+        uint32_t taken = (left < wanted) ? left : wanted;
+        i2s.copied += taken;
+        wanted -= taken;
+
+        if (i2s.copied == i2s.given_frames[buffer]) {
+            i2s.full_first = (i2s.full_first + 1) % i2s.buffer_count;
+            i2s.full_count--;
+            i2s.free_queue[(i2s.free_first + i2s.free_count) % i2s.buffer_count] = buffer;
+            i2s.free_count++;
+            i2s.copied = 0;
+        }
+    }
+    if (i2s.given_any) {
+        i2s.underrun_frames += wanted;
+    }
+}
+
+// Consumer runs lazily - every take due by real time is done now
+static void consumer_update(void) {
+    uint64_t due = (time_us_64() - i2s.started_us) * i2s.rate / (HOST_I2S_TAKE_FRAMES * 1000000ull);
+    for ( ; i2s.takes_done < due; i2s.takes_done++) {
+        consumer_take();
+    }
+}
+
+int16_t *host_i2s_take(void) {
+    if (!i2s.running) {
+        return NULL;
+    }
+
+    consumer_update();
+    while (i2s.free_count == 0) {
+        sleep_us(HOST_I2S_POLL_US);
+        consumer_update();
+    }
+
+    uint buffer = i2s.free_queue[i2s.free_first];
+    i2s.free_first = (i2s.free_first + 1) % i2s.buffer_count;
+    i2s.free_count--;
+    return i2s.samples + (size_t) buffer * i2s.buffer_frames * 2;
+}
+
+void host_i2s_give(int16_t *samples, uint32_t frames) {
+    uint buffer = (samples - i2s.samples) / (i2s.buffer_frames * 2);
+    consumer_update(); // Takes due while the buffer was rendered came before it
+    i2s.given_any = true;
+
+    // Empty buffer would never be taken, it goes straight back
+    if (frames == 0) {
+        i2s.free_queue[(i2s.free_first + i2s.free_count) % i2s.buffer_count] = buffer;
+        i2s.free_count++;
+        return;
+    }
+
+    i2s.given_frames[buffer] = frames;
+    i2s.full_queue[(i2s.full_first + i2s.full_count) % i2s.buffer_count] = buffer;
+    i2s.full_count++;
+}
+
+uint64_t host_i2s_underrun_frames(void) {
+    if (i2s.running) {
+        consumer_update();
+    }
+    return i2s.underrun_frames;
+}
@@ -0,0 +1,971 @@
+#define _GNU_SOURCE
+#include "pico_host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+
+// Depth of the simulated RX FIFO (joined FIFO has 8 entries, normal one 4)
+#define HOST_FIFO_DEPTH 8
+
+// How long multicore_reset_core1 waits for core1 to exit on its own before killing it
+#define HOST_CORE1_EXIT_TIMEOUT_US 200000
+
+pio_hw_t host_pio_hw[NUM_PIOS] = { { 0 }, { 1 }, { 2 } };
+
+typedef struct host_sm_t {
+    bool claimed;
+    atomic_bool enabled;
+    const pio_program_t *program;
+    pio_sm_config config;
+    uint depth;
+
+    uint32_t fifo[HOST_FIFO_DEPTH];
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_size_t dropped;
+} host_sm_t;
+
+typedef struct host_pio_t {
+    host_sm_t sm[NUM_PIO_STATE_MACHINES];
+    uint32_t used_instructions;
+    bool irq0_source[NUM_PIO_STATE_MACHINES];
+} host_pio_t;
+
+static host_pio_t pio_state[NUM_PIOS];
+static pthread_mutex_t pio_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Interrupts are serialized as if they all ran on core0
+static pthread_mutex_t irq_lock = PTHREAD_MUTEX_INITIALIZER;
+static irq_handler_t irq_handlers[HOST_IRQ_COUNT];
+static atomic_bool irq_enabled[HOST_IRQ_COUNT];
+
+static bool gpio_state[HOST_GPIO_COUNT];
+
+/**
+ * Clocks and time
+ */
+
+static uint32_t sys_clock_hz = HOST_SYS_CLOCK_HZ;
+
+uint32_t clock_get_hz(enum clock_index clk_index) {
+    return (clk_index == clk_sys) ? sys_clock_hz : 48000000u;
+}
+
+bool set_sys_clock_khz(uint32_t freq_khz, bool required) {
+    sys_clock_hz = freq_khz * 1000;
+    return true;
+}
+
+uint64_t time_us_64(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000u + (uint64_t) now.tv_nsec / 1000u;
+}
+
+uint32_t time_us_32(void) {
+    return (uint32_t) time_us_64();
+}
+
+absolute_time_t get_absolute_time(void) {
+    return time_us_64();
+}
+
+void sleep_us(uint64_t us) {
+    struct timespec duration = { .tv_sec = us / 1000000u, .tv_nsec = (us % 1000000u) * 1000u };
+    while (nanosleep(&duration, &duration) == -1 && errno == EINTR) {
+    }
+}
+
+void sleep_ms(uint32_t ms) {
+    sleep_us((uint64_t) ms * 1000u);
+}
+
+void busy_wait_us(uint64_t us) {
+    uint64_t end = time_us_64() + us;
+    while (time_us_64() < end) {
+        tight_loop_contents();
+    }
+}
+
+/**
+ * Pacing threads (repeating timers, PWM wrap)
+ */
+
+typedef struct host_pacer_t {
+    pthread_t thread;
+    atomic_bool running;
+    uint64_t period_ns;
+    bool (*tick)(struct host_pacer_t *pacer);
+    void *context;
+} host_pacer_t;
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+}
+
+static void *pacer_thread(void *arg) {
+    host_pacer_t *pacer = arg;
+    uint64_t deadline = now_ns();
+
+    while (atomic_load(&pacer->running)) {
+        deadline += pacer->period_ns;
+        uint64_t current = now_ns();
+        if (deadline > current + 100000u) {
+            sleep_us((deadline - current - 100000u) / 1000u);
+        }
+        while (now_ns() < deadline) {
+            tight_loop_contents();
+        }
+        // Ticks missed while the host did not run the thread are caught up with a pause between them, so the other
+        // threads go on as well (on the device nothing delays an alarm or PWM IRQ by a whole number of ticks). A yield
+        // is not enough with a single core, the scheduler would keep this thread.
+        if (current > deadline) {
+            sleep_us(1);
+        }
+
+        pthread_mutex_lock(&irq_lock);
+        bool keep_running = atomic_load(&pacer->running) && pacer->tick(pacer);
+        pthread_mutex_unlock(&irq_lock);
+
+        if (!keep_running) {
+            atomic_store(&pacer->running, false);
+        }
+    }
+    return NULL;
+}
+
+static host_pacer_t *pacer_start(uint64_t period_ns, bool (*tick)(host_pacer_t *), void *context) {
+    host_pacer_t *pacer = calloc(1, sizeof(host_pacer_t));
+    if (pacer == NULL) {
+        return NULL;
+    }
+
+    pacer->period_ns = period_ns ? period_ns : 1;
+    pacer->tick = tick;
+    pacer->context = context;
+    atomic_store(&pacer->running, true);
+
+    if (pthread_create(&pacer->thread, NULL, pacer_thread, pacer) != 0) {
+        free(pacer);
+        return NULL;
+    }
+    return pacer;
+}
+
+static void pacer_stop(host_pacer_t *pacer) {
+    if (pacer == NULL) {
+        return;
+    }
+
+    atomic_store(&pacer->running, false);
+    if (!pthread_equal(pthread_self(), pacer->thread)) {
+        pthread_join(pacer->thread, NULL);
+        free(pacer);
+    } else {
+        pthread_detach(pacer->thread);
+    }
+}
+
+// Callback may change the delay of the next call, same as with the SDK alarm pool
+static bool repeating_timer_tick(host_pacer_t *pacer) {
+    repeating_timer_t *timer = pacer->context;
+    bool keep_running = timer->callback(timer);
+    pacer->period_ns = (uint64_t) (timer->delay_us < 0 ? -timer->delay_us : timer->delay_us) * 1000u;
+    return keep_running;
+}
+
+bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t callback, void *user_data, repeating_timer_t *out) {
+    out->delay_us = delay_us;
+    out->callback = callback;
+    out->user_data = user_data;
+    out->host_thread = pacer_start((uint64_t) (delay_us < 0 ? -delay_us : delay_us) * 1000u, repeating_timer_tick, out);
+    return out->host_thread != NULL;
+}
+
+bool cancel_repeating_timer(repeating_timer_t *timer) {
+    if (timer->host_thread == NULL) {
+        return false;
+    }
+
+    pacer_stop(timer->host_thread);
+    timer->host_thread = NULL;
+    return true;
+}
+
+/**
+ * IRQ
+ */
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+    pthread_mutex_lock(&irq_lock);
+    irq_handlers[num] = handler;
+    pthread_mutex_unlock(&irq_lock);
+}
+
+void irq_remove_handler(uint num, irq_handler_t handler) {
+    pthread_mutex_lock(&irq_lock);
+    if (irq_handlers[num] == handler) {
+        irq_handlers[num] = NULL;
+    }
+    pthread_mutex_unlock(&irq_lock);
+}
+
+void irq_set_enabled(uint num, bool enabled) {
+    atomic_store(&irq_enabled[num], enabled);
+}
+
+static void raise_irq(uint num) {
+    if (!atomic_load(&irq_enabled[num])) {
+        return;
+    }
+
+    pthread_mutex_lock(&irq_lock);
+    if (irq_handlers[num] != NULL) {
+        irq_handlers[num]();
+    }
+    pthread_mutex_unlock(&irq_lock);
+}
+
+/**
+ * GPIO
+ */
+
+void gpio_init(uint gpio) {
+    gpio_state[gpio] = false;
+}
+
+void gpio_deinit(uint gpio) {
+}
+
+void gpio_set_dir(uint gpio, bool out) {
+}
+
+void gpio_put(uint gpio, bool value) {
+    gpio_state[gpio] = value;
+}
+
+bool gpio_get(uint gpio) {
+    return gpio_state[gpio];
+}
+
+void gpio_pull_up(uint gpio) {
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn) {
+}
+
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t event_mask, bool enabled, gpio_irq_callback_t callback) {
+}
+
+/**
+ * PWM
+ */
+
+#define HOST_PWM_SLICES 12
+
+typedef struct host_pwm_t {
+    float clkdiv;
+    uint16_t wrap;
+    bool irq_enabled;
+    host_pacer_t *pacer;
+} host_pwm_t;
+
+static host_pwm_t pwm_state[HOST_PWM_SLICES];
+
+static bool pwm_wrap_tick(host_pacer_t *pacer) {
+    if (irq_handlers[PWM_IRQ_WRAP] != NULL && atomic_load(&irq_enabled[PWM_IRQ_WRAP])) {
+        irq_handlers[PWM_IRQ_WRAP]();
+    }
+    return true;
+}
+
+uint pwm_gpio_to_slice_num(uint gpio) {
+    return (gpio >> 1) % HOST_PWM_SLICES;
+}
+
+void pwm_set_clkdiv(uint slice_num, float divider) {
+    pwm_state[slice_num].clkdiv = divider;
+}
+
+void pwm_set_wrap(uint slice_num, uint16_t wrap) {
+    pwm_state[slice_num].wrap = wrap;
+}
+
+void pwm_set_gpio_level(uint gpio, uint16_t level) {
+}
+
+void pwm_clear_irq(uint slice_num) {
+}
+
+void pwm_set_irq_enabled(uint slice_num, bool enabled) {
+    pwm_state[slice_num].irq_enabled = enabled;
+}
+
+void pwm_set_enabled(uint slice_num, bool enabled) {
+    host_pwm_t *pwm = &pwm_state[slice_num];
+
+    if (!enabled) {
+        pacer_stop(pwm->pacer);
+        pwm->pacer = NULL;
+        return;
+    }
+
+    if (pwm->pacer == NULL && pwm->irq_enabled) {
+        double period_s = (pwm->wrap + 1.0) * (pwm->clkdiv > 0 ? pwm->clkdiv : 1.0) / clock_get_hz(clk_sys);
+        pwm->pacer = pacer_start((uint64_t) (period_s * 1e9), pwm_wrap_tick, pwm);
+    }
+}
+
+/**
+ * Multicore
+ */
+
+static pthread_t core1_thread;
+static bool core1_started = false;
+static atomic_bool core1_finished;
+static void (*core1_entry)(void);
+
+static void *core1_trampoline(void *arg) {
+    pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
+    core1_entry();
+    atomic_store(&core1_finished, true);
+    return NULL;
+}
+
+void multicore_reset_core1(void) {
+    if (!core1_started) {
+        return;
+    }
+
+    // Give core1 a chance to notice its killswitch, then reset it the hard way
+    uint64_t deadline = time_us_64() + HOST_CORE1_EXIT_TIMEOUT_US;
+    while (!atomic_load(&core1_finished) && time_us_64() < deadline) {
+        sleep_us(100);
+    }
+    if (!atomic_load(&core1_finished)) {
+        pthread_cancel(core1_thread);
+    }
+    pthread_join(core1_thread, NULL);
+    core1_started = false;
+}
+
+void multicore_launch_core1(void (*entry)(void)) {
+    multicore_reset_core1();
+
+    core1_entry = entry;
+    atomic_store(&core1_finished, false);
+    if (pthread_create(&core1_thread, NULL, core1_trampoline, NULL) != 0) {
+        fprintf(stderr, "pico_host: could not start core1 thread\n");
+        abort();
+    }
+    core1_started = true;
+}
+
+/**
+ * PIO
+ */
+
+static host_sm_t *get_sm(PIO pio, uint sm) {
+    return &pio_state[pio->index].sm[sm];
+}
+
+pio_sm_config pio_get_default_sm_config(void) {
+    pio_sm_config config = {
+        .clkdiv = 1.0f,
+        .in_count = 32,
+        .wrap = PIO_INSTRUCTION_COUNT - 1,
+        .in_shift_right = true,
+        .push_threshold = 32,
+        .fifo_join = PIO_FIFO_JOIN_NONE,
+        .program = NULL
+    };
+    return config;
+}
+
+void sm_config_set_in_pins(pio_sm_config *c, uint in_base) {
+    c->in_base = in_base;
+}
+
+void sm_config_set_in_pin_count(pio_sm_config *c, uint in_count) {
+    c->in_count = in_count;
+}
+
+void sm_config_set_out_pins(pio_sm_config *c, uint out_base, uint out_count) {
+    c->out_base = out_base;
+    c->out_count = out_count;
+}
+
+void sm_config_set_set_pins(pio_sm_config *c, uint set_base, uint set_count) {
+    c->set_base = set_base;
+    c->set_count = set_count;
+}
+
+void sm_config_set_jmp_pin(pio_sm_config *c, uint pin) {
+    c->jmp_pin = pin;
+}
+
+void sm_config_set_wrap(pio_sm_config *c, uint wrap_target, uint wrap) {
+    c->wrap_target = wrap_target;
+    c->wrap = wrap;
+}
+
+void sm_config_set_clkdiv(pio_sm_config *c, float div) {
+    c->clkdiv = div;
+}
+
+void sm_config_set_in_shift(pio_sm_config *c, bool shift_right, bool autopush, uint push_threshold) {
+    c->in_shift_right = shift_right;
+    c->autopush = autopush;
+    c->push_threshold = push_threshold;
+}
+
+void sm_config_set_fifo_join(pio_sm_config *c, enum pio_fifo_join join) {
+    c->fifo_join = join;
+}
+
+void sm_config_set_mov_status(pio_sm_config *c, enum pio_mov_status_type status_sel, uint status_n) {
+    c->status_sel = status_sel;
+    c->status_n = status_n;
+}
+
+int pio_claim_unused_sm(PIO pio, bool required) {
+    pthread_mutex_lock(&pio_lock);
+    for (uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) {
+        host_sm_t *state = get_sm(pio, sm);
+        if (!state->claimed) {
+            state->claimed = true;
+            pthread_mutex_unlock(&pio_lock);
+            return sm;
+        }
+    }
+    pthread_mutex_unlock(&pio_lock);
+
+    if (required) {
+        fprintf(stderr, "pico_host: no free state machine on PIO%u\n", pio->index);
+        abort();
+    }
+    return -1;
+}
+
+static int find_program_offset(PIO pio, const pio_program_t *program) {
+    uint32_t program_mask = (program->length >= 32) ? 0xffffffffu : ((1u << program->length) - 1);
+    for (int offset = PIO_INSTRUCTION_COUNT - program->length; offset >= 0; offset--) {
+        if ((pio_state[pio->index].used_instructions & (program_mask << offset)) == 0) {
+            return offset;
+        }
+    }
+    return -1;
+}
+
+bool pio_can_add_program(PIO pio, const pio_program_t *program) {
+    pthread_mutex_lock(&pio_lock);
+    bool result = find_program_offset(pio, program) >= 0;
+    pthread_mutex_unlock(&pio_lock);
+    return result;
+}
+
+uint pio_add_program(PIO pio, const pio_program_t *program) {
+    pthread_mutex_lock(&pio_lock);
+    int offset = find_program_offset(pio, program);
+    if (offset < 0) {
+        fprintf(stderr, "pico_host: no program space on PIO%u for %s\n", pio->index, program->name);
+        abort();
+    }
+    uint32_t program_mask = (program->length >= 32) ? 0xffffffffu : ((1u << program->length) - 1);
+    pio_state[pio->index].used_instructions |= program_mask << offset;
+    pthread_mutex_unlock(&pio_lock);
+    return offset;
+}
+
+void pio_remove_program_and_unclaim_sm(const pio_program_t *program, PIO pio, uint sm, uint offset) {
+    pthread_mutex_lock(&pio_lock);
+    uint32_t program_mask = (program->length >= 32) ? 0xffffffffu : ((1u << program->length) - 1);
+    pio_state[pio->index].used_instructions &= ~(program_mask << offset);
+
+    host_sm_t *state = get_sm(pio, sm);
+    atomic_store(&state->enabled, false);
+    state->claimed = false;
+    state->program = NULL;
+    pthread_mutex_unlock(&pio_lock);
+}
+
+int pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config) {
+    pthread_mutex_lock(&pio_lock);
+    host_sm_t *state = get_sm(pio, sm);
+    atomic_store(&state->enabled, false);
+    state->config = *config;
+    state->depth = (config->fifo_join == PIO_FIFO_JOIN_RX) ? HOST_FIFO_DEPTH : HOST_FIFO_DEPTH / 2;
+    state->program = config->program;
+    atomic_store(&state->head, 0);
+    atomic_store(&state->tail, 0);
+    atomic_store(&state->dropped, 0);
+    pthread_mutex_unlock(&pio_lock);
+    return 0;
+}
+
+// Running state machine takes the new configuration, FIFO contents stay
+int pio_sm_set_config(PIO pio, uint sm, const pio_sm_config *config) {
+    pthread_mutex_lock(&pio_lock);
+    host_sm_t *state = get_sm(pio, sm);
+    state->config = *config;
+    state->depth = (config->fifo_join == PIO_FIFO_JOIN_RX) ? HOST_FIFO_DEPTH : HOST_FIFO_DEPTH / 2;
+    pthread_mutex_unlock(&pio_lock);
+    return 0;
+}
+
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled) {
+    pthread_mutex_lock(&pio_lock);
+    host_sm_t *state = get_sm(pio, sm);
+    atomic_store(&state->enabled, enabled);
+    pthread_mutex_unlock(&pio_lock);
+}
+
+void pio_sm_clear_fifos(PIO pio, uint sm) {
+    host_sm_t *state = get_sm(pio, sm);
+    atomic_store(&state->tail, atomic_load(&state->head));
+}
+
+void pio_gpio_init(PIO pio, uint pin) {
+}
+
+int pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out) {
+    return 0;
+}
+
+void pio_set_irq0_source_enabled(PIO pio, pio_interrupt_source_t source, bool enabled) {
+    pio_state[pio->index].irq0_source[source % NUM_PIO_STATE_MACHINES] = enabled;
+}
+
+uint pio_sm_get_rx_fifo_level(PIO pio, uint sm) {
+    host_sm_t *state = get_sm(pio, sm);
+    return atomic_load_explicit(&state->head, memory_order_acquire) - atomic_load_explicit(&state->tail, memory_order_relaxed);
+}
+
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm) {
+    return pio_sm_get_rx_fifo_level(pio, sm) == 0;
+}
+
+bool pio_sm_is_rx_fifo_full(PIO pio, uint sm) {
+    return pio_sm_get_rx_fifo_level(pio, sm) >= get_sm(pio, sm)->depth;
+}
+
+uint32_t pio_sm_get(PIO pio, uint sm) {
+    host_sm_t *state = get_sm(pio, sm);
+    uint tail = atomic_load_explicit(&state->tail, memory_order_relaxed);
+
+    // Reading an empty FIFO returns 0 on the real hardware as well
+    if (atomic_load_explicit(&state->head, memory_order_acquire) == tail) {
+        return 0;
+    }
+
+    uint32_t word = state->fifo[tail % HOST_FIFO_DEPTH];
+    atomic_store_explicit(&state->tail, tail + 1, memory_order_release);
+    return word;
+}
+
+uint32_t pio_sm_get_blocking(PIO pio, uint sm) {
+    while (pio_sm_is_rx_fifo_empty(pio, sm)) {
+        tight_loop_contents();
+    }
+    return pio_sm_get(pio, sm);
+}
+
+uint pio_get_dreq(PIO pio, uint sm, bool is_tx) {
+    // Same numbering as on RP2350: TX0-3 and RX0-3 of each PIO in turn
+    return pio->index * 2 * NUM_PIO_STATE_MACHINES + (is_tx ? 0 : NUM_PIO_STATE_MACHINES) + sm;
+}
+
+/**
+ * DMA
+ */
+
+#define HOST_DMA_ENDLESS_MASK 0xf0000000u
+#define HOST_DMA_PIO_DREQS (NUM_PIOS * 2 * NUM_PIO_STATE_MACHINES)
+
+typedef struct host_dma_t {
+    bool claimed;
+    bool busy;
+    dma_channel_config config;
+    dma_channel_hw_t hw;
+    uint64_t started_ns;    // Timer-paced channels: when triggered and how many transfers were done since
+    uint64_t done;
+} host_dma_t;
+
+typedef struct host_dma_timer_t {
+    bool claimed;
+    uint16_t numerator;
+    uint16_t denominator;
+} host_dma_timer_t;
+
+static host_dma_t dma_state[NUM_DMA_CHANNELS];
+static host_dma_timer_t dma_timers[NUM_DMA_TIMERS];
+static pthread_mutex_t dma_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int dma_claim_unused_channel(bool required) {
+    pthread_mutex_lock(&dma_lock);
+    for (uint channel = 0; channel < NUM_DMA_CHANNELS; channel++) {
+        if (!dma_state[channel].claimed) {
+            dma_state[channel].claimed = true;
+            pthread_mutex_unlock(&dma_lock);
+            return channel;
+        }
+    }
+    pthread_mutex_unlock(&dma_lock);
+
+    if (required) {
+        fprintf(stderr, "pico_host: no free DMA channel\n");
+        abort();
+    }
+    return -1;
+}
+
+void dma_channel_claim(uint channel) {
+    pthread_mutex_lock(&dma_lock);
+    if (dma_state[channel].claimed) {
+        fprintf(stderr, "pico_host: DMA channel %u already claimed\n", channel);
+        abort();
+    }
+    dma_state[channel].claimed = true;
+    pthread_mutex_unlock(&dma_lock);
+}
+
+void dma_channel_unclaim(uint channel) {
+    pthread_mutex_lock(&dma_lock);
+    dma_state[channel].claimed = false;
+    pthread_mutex_unlock(&dma_lock);
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel) {
+    dma_channel_config config = {
+        .size = DMA_SIZE_32,
+        .read_increment = true,
+        .write_increment = false,
+        .ring_bits = 0,
+        .ring_write = false,
+        .dreq = 0x3f   // Unpaced
+    };
+    return config;
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) {
+    c->size = size;
+}
+
+void channel_config_set_read_increment(dma_channel_config *c, bool incr) {
+    c->read_increment = incr;
+}
+
+void channel_config_set_write_increment(dma_channel_config *c, bool incr) {
+    c->write_increment = incr;
+}
+
+void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits) {
+    c->ring_write = write;
+    c->ring_bits = size_bits;
+}
+
+void channel_config_set_dreq(dma_channel_config *c, uint dreq) {
+    c->dreq = dreq;
+}
+
+static bool paced_by_pio_rx(const host_dma_t *dma) {
+    return dma->config.dreq < HOST_DMA_PIO_DREQS && dma->config.dreq % (2 * NUM_PIO_STATE_MACHINES) >= NUM_PIO_STATE_MACHINES;
+}
+
+static bool paced_by_timer(const host_dma_t *dma) {
+    return dma->config.dreq >= DREQ_DMA_TIMER0 && dma->config.dreq < DREQ_DMA_TIMER0 + NUM_DMA_TIMERS;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint32_t encoded_transfer_count, bool trigger) {
+    host_dma_t *dma = &dma_state[channel];
+    dma->config = *config;
+    dma->hw.read_addr = (uintptr_t) read_addr;
+    dma->hw.write_addr = (uintptr_t) write_addr;
+    dma->hw.transfer_count = encoded_transfer_count;
+    dma->started_ns = now_ns();
+    dma->done = 0;
+
+    if (!paced_by_pio_rx(dma) && !paced_by_timer(dma)) {
+        fprintf(stderr, "pico_host: DMA channel %u is not paced by a PIO RX FIFO or a DMA timer\n", channel);
+        abort();
+    }
+    dma->busy = trigger;
+}
+
+void dma_channel_abort(uint channel) {
+    dma_state[channel].busy = false;
+}
+
+static uintptr_t advance_addr(uintptr_t addr, uint bytes, uint ring_bits) {
+    uintptr_t next = addr + bytes;
+    if (ring_bits == 0) {
+        return next;
+    }
+    uintptr_t mask = ((uintptr_t) 1 << ring_bits) - 1;
+    return (addr & ~mask) | (next & mask);
+}
+
+// One transfer; a FIFO-paced one only if its FIFO holds a word
+static bool transfer(host_dma_t *dma) {
+    uint bytes = 1u << dma->config.size;
+    uint8_t data[4];
+
+    if (paced_by_pio_rx(dma)) {
+        PIO pio = &host_pio_hw[dma->config.dreq / (2 * NUM_PIO_STATE_MACHINES)];
+        uint sm = dma->config.dreq % NUM_PIO_STATE_MACHINES;
+        if (pio_sm_is_rx_fifo_empty(pio, sm)) {
+            return false;
+        }
+
+        // Narrow reads take their lane of the word, as on the bus
+        uint32_t word = pio_sm_get(pio, sm);
+        memcpy(data, (uint8_t *) &word + (dma->hw.read_addr & 3), bytes);
+    } else {
+        memcpy(data, (const void *) dma->hw.read_addr, bytes);
+    }
+    memcpy((void *) dma->hw.write_addr, data, bytes);
+
+    if (dma->config.read_increment) {
+        dma->hw.read_addr = advance_addr(dma->hw.read_addr, bytes, dma->config.ring_write ? 0 : dma->config.ring_bits);
+    }
+    if (dma->config.write_increment) {
+        dma->hw.write_addr = advance_addr(dma->hw.write_addr, bytes, dma->config.ring_write ? dma->config.ring_bits : 0);
+    }
+    bool endless = (dma->hw.transfer_count & HOST_DMA_ENDLESS_MASK) == HOST_DMA_ENDLESS_MASK;
+    if (!endless && --dma->hw.transfer_count == 0) {
+        dma->busy = false;
+    }
+    return true;
+}
+
+dma_channel_hw_t *dma_channel_hw_addr(uint channel) {
+    host_dma_t *dma = &dma_state[channel];
+    if (!dma->busy) {
+        return &dma->hw;
+    }
+
+    if (paced_by_pio_rx(dma)) {
+        while (dma->busy && transfer(dma)) {
+        }
+        return &dma->hw;
+    }
+
+    host_dma_timer_t *timer = &dma_timers[dma->config.dreq - DREQ_DMA_TIMER0];
+    if (timer->denominator == 0) {
+        return &dma->hw;
+    }
+    double rate = (double) clock_get_hz(clk_sys) * timer->numerator / timer->denominator;
+    uint64_t due = (uint64_t) ((now_ns() - dma->started_ns) * rate / 1e9);
+
+    for ( ; dma->busy && dma->done < due; dma->done++) {
+        for (uint other = 0; other < NUM_DMA_CHANNELS; other++) {
+            if (dma_state[other].busy && paced_by_pio_rx(&dma_state[other])) {
+                transfer(&dma_state[other]);
+            }
+        }
+        transfer(dma);
+    }
+    return &dma->hw;
+}
+
+int dma_claim_unused_timer(bool required) {
+    pthread_mutex_lock(&dma_lock);
+    for (uint timer = 0; timer < NUM_DMA_TIMERS; timer++) {
+        if (!dma_timers[timer].claimed) {
+            dma_timers[timer].claimed = true;
+            pthread_mutex_unlock(&dma_lock);
+            return timer;
+        }
+    }
+    pthread_mutex_unlock(&dma_lock);
+
+    if (required) {
+        fprintf(stderr, "pico_host: no free DMA timer\n");
+        abort();
+    }
+    return -1;
+}
+
+void dma_timer_unclaim(uint timer) {
+    pthread_mutex_lock(&dma_lock);
+    dma_timers[timer].claimed = false;
+    pthread_mutex_unlock(&dma_lock);
+}
+
+void dma_timer_set_fraction(uint timer, uint16_t numerator, uint16_t denominator) {
+    dma_timers[timer].numerator = numerator;
+    dma_timers[timer].denominator = denominator;
+}
+
+uint dma_get_timer_dreq(uint timer_num) {
+    return DREQ_DMA_TIMER0 + timer_num;
+}
+
+/**
+ * Host-only part
+ */
+
+// All enabled state machines running the program (several programs may listen to the same pins, e.g. dual OPL2)
+static size_t find_running_programs(const char *program_name, PIO *pios, uint *sms, size_t max) {
+    size_t found = 0;
+    pthread_mutex_lock(&pio_lock);
+    for (uint p = 0; p < NUM_PIOS; p++) {
+        for (uint s = 0; s < NUM_PIO_STATE_MACHINES && found < max; s++) {
+            host_sm_t *state = &pio_state[p].sm[s];
+            if (atomic_load(&state->enabled) && state->program != NULL && strcmp(state->program->name, program_name) == 0) {
+                pios[found] = &host_pio_hw[p];
+                sms[found] = s;
+                found++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&pio_lock);
+    return found;
+}
+
+static bool find_running_program(const char *program_name, PIO *pio, uint *sm) {
+    return find_running_programs(program_name, pio, sm, 1) > 0;
+}
+
+bool host_pio_is_running(const char *program_name) {
+    PIO pio;
+    uint sm;
+    return find_running_program(program_name, &pio, &sm);
+}
+
+// Waiting push replays a capture paced by the FIFO, the other one drops the word as the state machine misses the write
+static bool push_word(PIO pio, uint sm, uint32_t word, bool wait) {
+    host_sm_t *state = get_sm(pio, sm);
+
+    uint head = atomic_load_explicit(&state->head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&state->tail, memory_order_acquire) >= state->depth) {
+        if (!atomic_load(&state->enabled)) {
+            return false;
+        }
+        if (!wait) {
+            atomic_fetch_add(&state->dropped, 1);
+            return false;
+        }
+        tight_loop_contents();
+    }
+
+    state->fifo[head % HOST_FIFO_DEPTH] = word;
+    atomic_store_explicit(&state->head, head + 1, memory_order_release);
+
+    if (pio_state[pio->index].irq0_source[sm]) {
+        raise_irq(PIO0_IRQ_0 + 2 * pio->index);
+    }
+    return true;
+}
+
+// Word is seen by every state machine running the program, same as the pins are
+static size_t feed(const char *program_name, size_t count, uint32_t (*word_at)(const void *, size_t), const void *data) {
+    PIO pios[NUM_PIOS * NUM_PIO_STATE_MACHINES];
+    uint sms[NUM_PIOS * NUM_PIO_STATE_MACHINES];
+    size_t found = find_running_programs(program_name, pios, sms, NUM_PIOS * NUM_PIO_STATE_MACHINES);
+    if (found == 0) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        for (size_t j = 0; j < found; j++) {
+            if (!push_word(pios[j], sms[j], word_at(data, i), true)) {
+                return i;
+            }
+        }
+    }
+    return count;
+}
+
+static uint32_t word_of_words(const void *data, size_t i) {
+    return ((const uint32_t *) data)[i];
+}
+
+static uint32_t word_of_bytes(const void *data, size_t i) {
+    return (uint32_t) ((const uint8_t *) data)[i] << 24;
+}
+
+bool host_pio_push(const char *program_name, uint32_t word) {
+    return feed(program_name, 1, word_of_words, &word) == 1;
+}
+
+bool host_pio_write(const char *program_name, uint32_t word) {
+    PIO pios[NUM_PIOS * NUM_PIO_STATE_MACHINES];
+    uint sms[NUM_PIOS * NUM_PIO_STATE_MACHINES];
+    size_t found = find_running_programs(program_name, pios, sms, NUM_PIOS * NUM_PIO_STATE_MACHINES);
+
+    bool pushed = found > 0;
+    for (size_t j = 0; j < found; j++) {
+        pushed &= push_word(pios[j], sms[j], word, false);
+    }
+    return pushed;
+}
+
+size_t host_pio_dropped(const char *program_name) {
+    PIO pios[NUM_PIOS * NUM_PIO_STATE_MACHINES];
+    uint sms[NUM_PIOS * NUM_PIO_STATE_MACHINES];
+    size_t found = find_running_programs(program_name, pios, sms, NUM_PIOS * NUM_PIO_STATE_MACHINES);
+
+    size_t dropped = 0;
+    for (size_t j = 0; j < found; j++) {
+        dropped += atomic_load(&get_sm(pios[j], sms[j])->dropped);
+    }
+    return dropped;
+}
+
+// Only the FIFO levels are simulated, so "mov x, status" is the only thing an output pin can follow
+bool host_pio_status(const char *program_name) {
+    PIO pio;
+    uint sm;
+    if (!find_running_program(program_name, &pio, &sm)) {
+        return false;
+    }
+
+    pthread_mutex_lock(&pio_lock);
+    pio_sm_config config = get_sm(pio, sm)->config;
+    pthread_mutex_unlock(&pio_lock);
+
+    switch (config.status_sel) {
+        case STATUS_TX_LESSTHAN:
+            return config.status_n > 0;
+        case STATUS_RX_LESSTHAN:
+            return pio_sm_get_rx_fifo_level(pio, sm) < config.status_n;
+        default:
+            return false;
+    }
+}
+
+size_t host_pio_feed_words(const char *program_name, const uint32_t *words, size_t count) {
+    return feed(program_name, count, word_of_words, words);
+}
+
+static uint32_t word_of_packed_bytes(const void *data, size_t i) {
+    const uint8_t *bytes = (const uint8_t *) data + 4 * i;
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+}
+
+// Autopush at 32 bits shifting right packs four bytes per word, the first one in the low byte
+static bool packs_bytes(const char *program_name) {
+    PIO pio;
+    uint sm;
+    if (!find_running_program(program_name, &pio, &sm)) {
+        return false;
+    }
+    pio_sm_config *config = &get_sm(pio, sm)->config;
+    return config->autopush && config->push_threshold == 32 && config->in_shift_right;
+}
+
+size_t host_pio_feed_bytes(const char *program_name, const uint8_t *bytes, size_t count) {
+    if (packs_bytes(program_name)) {
+        return 4 * feed(program_name, count / 4, word_of_packed_bytes, bytes);
+    }
+    return feed(program_name, count, word_of_bytes, bytes);
+}
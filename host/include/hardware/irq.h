@@ -0,0 +1,7 @@
+#ifndef HOST_HARDWARE_IRQ_H
+#define HOST_HARDWARE_IRQ_H
+
+// Host build: everything used from the Pico SDK lives in one shim
+#include "pico_host.h"
+
+#endif // HOST_HARDWARE_IRQ_H
@@ -0,0 +1,7 @@
+#ifndef HOST_PICO_UTIL_PHEAP_H
+#define HOST_PICO_UTIL_PHEAP_H
+
+// Host build: everything used from the Pico SDK lives in one shim
+#include "pico_host.h"
+
+#endif // HOST_PICO_UTIL_PHEAP_H
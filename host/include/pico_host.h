@@ -0,0 +1,397 @@
+#ifndef PICO_HOST_H
+#define PICO_HOST_H
+
+/**
+ * Thin stand-in for the parts of the Pico SDK used by picovox, so the emulation pipeline
+ * (devices, ringbuffer, opl, square) can be built and profiled on a Linux host.
+ *
+ * PIO state machines are not executed; instead every claimed state machine owns a simulated RX FIFO
+ * that can be fed from a byte/word stream (see host_pio_* functions at the bottom).
+ * Core1 is a thread, interrupts are called from the thread that raised them (serialized by one lock),
+ * repeating timers and the PWM wrap IRQ are paced by their own threads.
+ * DMA channels are paced by an RX FIFO or a DMA timer and run lazily, when their registers are read: a FIFO-paced
+ * channel moves whatever the FIFO holds, a timer-paced one does the transfers due by real time, each after moving
+ * one word from the FIFO of every other running FIFO-paced channel (so a capture replays one write per transfer).
+ * I2S output of pico-extras is simulated with its pool of producer buffers (see host_i2s_* functions at the bottom).
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sched.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef unsigned int uint;
+
+#define __isr
+#define __not_in_flash_func(func_name) func_name
+#define __time_critical_func(func_name) func_name
+#define __scratch_x(group)
+#define __scratch_y(group)
+
+// Spin loops give the other side a chance to run (the host may have less cores than threads)
+static inline void tight_loop_contents(void) { sched_yield(); }
+static inline void __dsb(void) { __sync_synchronize(); }
+static inline void __dmb(void) { __sync_synchronize(); }
+
+/**
+ * Clocks
+ */
+
+enum clock_index {
+    clk_gpout0 = 0,
+    clk_ref,
+    clk_sys,
+    clk_peri,
+    CLK_COUNT
+};
+
+#define HOST_SYS_CLOCK_HZ 250000000u
+
+uint32_t clock_get_hz(enum clock_index clk_index);
+bool set_sys_clock_khz(uint32_t freq_khz, bool required);
+
+/**
+ * Time
+ */
+
+typedef uint64_t absolute_time_t;
+
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+absolute_time_t get_absolute_time(void);
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+void busy_wait_us(uint64_t us);
+
+typedef struct repeating_timer repeating_timer_t;
+typedef bool (*repeating_timer_callback_t)(repeating_timer_t *rt);
+
+struct repeating_timer {
+    int64_t delay_us;
+    repeating_timer_callback_t callback;
+    void *user_data;
+    void *host_thread;      // Host only: pacing thread of the timer
+};
+
+bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t callback, void *user_data, repeating_timer_t *out);
+bool cancel_repeating_timer(repeating_timer_t *timer);
+
+/**
+ * IRQ
+ */
+
+typedef void (*irq_handler_t)(void);
+
+#define PWM_IRQ_WRAP 8
+#define PIO0_IRQ_0 15
+#define PIO1_IRQ_0 17
+#define PIO2_IRQ_0 19
+#define HOST_IRQ_COUNT 64
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_remove_handler(uint num, irq_handler_t handler);
+void irq_set_enabled(uint num, bool enabled);
+
+/**
+ * GPIO
+ */
+
+enum gpio_function {
+    GPIO_FUNC_SIO = 5,
+    GPIO_FUNC_PIO0 = 6,
+    GPIO_FUNC_PIO1 = 7,
+    GPIO_FUNC_PIO2 = 8,
+    GPIO_FUNC_PWM = 4,
+    GPIO_FUNC_NULL = 0x1f
+};
+
+#define GPIO_IN false
+#define GPIO_OUT true
+#define GPIO_IRQ_EDGE_FALL 0x4u
+#define GPIO_IRQ_EDGE_RISE 0x8u
+#define HOST_GPIO_COUNT 48
+
+typedef void (*gpio_irq_callback_t)(uint gpio, uint32_t event_mask);
+
+void gpio_init(uint gpio);
+void gpio_deinit(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_put(uint gpio, bool value);
+bool gpio_get(uint gpio);
+void gpio_pull_up(uint gpio);
+void gpio_set_function(uint gpio, enum gpio_function fn);
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t event_mask, bool enabled, gpio_irq_callback_t callback);
+
+/**
+ * PWM (only the wrap IRQ is simulated)
+ */
+
+uint pwm_gpio_to_slice_num(uint gpio);
+void pwm_set_clkdiv(uint slice_num, float divider);
+void pwm_set_wrap(uint slice_num, uint16_t wrap);
+void pwm_set_gpio_level(uint gpio, uint16_t level);
+void pwm_clear_irq(uint slice_num);
+void pwm_set_irq_enabled(uint slice_num, bool enabled);
+void pwm_set_enabled(uint slice_num, bool enabled);
+
+/**
+ * Multicore
+ */
+
+void multicore_reset_core1(void);
+void multicore_launch_core1(void (*entry)(void));
+
+/**
+ * PIO
+ */
+
+#define NUM_PIOS 3
+#define NUM_PIO_STATE_MACHINES 4
+#define PIO_INSTRUCTION_COUNT 32
+#define PICO_RP2350 1
+
+typedef struct pio_program {
+    const uint16_t *instructions;
+    uint8_t length;
+    int8_t origin;
+    const char *name;       // Host only: used to find the state machine to feed
+} pio_program_t;
+
+typedef struct pio_hw {
+    uint index;
+    uint32_t rxf[NUM_PIO_STATE_MACHINES];   // Only the addresses are used (DMA source)
+} pio_hw_t;
+
+typedef pio_hw_t *PIO;
+
+extern pio_hw_t host_pio_hw[NUM_PIOS];
+#define pio0 (&host_pio_hw[0])
+#define pio1 (&host_pio_hw[1])
+#define pio2 (&host_pio_hw[2])
+
+enum pio_fifo_join {
+    PIO_FIFO_JOIN_NONE = 0,
+    PIO_FIFO_JOIN_TX = 1,
+    PIO_FIFO_JOIN_RX = 2
+};
+
+enum pio_mov_status_type {
+    STATUS_TX_LESSTHAN = 0,
+    STATUS_RX_LESSTHAN = 1,
+    STATUS_IRQ_SET = 2
+};
+
+typedef enum pio_interrupt_source {
+    pis_sm0_rx_fifo_not_empty = 0,
+    pis_sm1_rx_fifo_not_empty,
+    pis_sm2_rx_fifo_not_empty,
+    pis_sm3_rx_fifo_not_empty
+} pio_interrupt_source_t;
+
+typedef struct {
+    float clkdiv;
+    uint in_base;
+    uint in_count;
+    uint out_base;
+    uint out_count;
+    uint set_base;
+    uint set_count;
+    uint jmp_pin;
+    uint wrap_target;
+    uint wrap;
+    bool in_shift_right;
+    bool autopush;
+    uint push_threshold;
+    enum pio_fifo_join fifo_join;
+    enum pio_mov_status_type status_sel;
+    uint status_n;
+    const pio_program_t *program;   // Host only: set by the generated *_program_get_default_config
+} pio_sm_config;
+
+pio_sm_config pio_get_default_sm_config(void);
+void sm_config_set_in_pins(pio_sm_config *c, uint in_base);
+void sm_config_set_in_pin_count(pio_sm_config *c, uint in_count);
+void sm_config_set_out_pins(pio_sm_config *c, uint out_base, uint out_count);
+void sm_config_set_set_pins(pio_sm_config *c, uint set_base, uint set_count);
+void sm_config_set_jmp_pin(pio_sm_config *c, uint pin);
+void sm_config_set_wrap(pio_sm_config *c, uint wrap_target, uint wrap);
+void sm_config_set_clkdiv(pio_sm_config *c, float div);
+void sm_config_set_in_shift(pio_sm_config *c, bool shift_right, bool autopush, uint push_threshold);
+void sm_config_set_fifo_join(pio_sm_config *c, enum pio_fifo_join join);
+void sm_config_set_mov_status(pio_sm_config *c, enum pio_mov_status_type status_sel, uint status_n);
+
+int pio_claim_unused_sm(PIO pio, bool required);
+bool pio_can_add_program(PIO pio, const pio_program_t *program);
+uint pio_add_program(PIO pio, const pio_program_t *program);
+void pio_remove_program_and_unclaim_sm(const pio_program_t *program, PIO pio, uint sm, uint offset);
+int pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config);
+int pio_sm_set_config(PIO pio, uint sm, const pio_sm_config *config);
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled);
+void pio_sm_clear_fifos(PIO pio, uint sm);
+void pio_gpio_init(PIO pio, uint pin);
+int pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out);
+void pio_set_irq0_source_enabled(PIO pio, pio_interrupt_source_t source, bool enabled);
+
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm);
+bool pio_sm_is_rx_fifo_full(PIO pio, uint sm);
+uint pio_sm_get_rx_fifo_level(PIO pio, uint sm);
+uint32_t pio_sm_get(PIO pio, uint sm);
+uint32_t pio_sm_get_blocking(PIO pio, uint sm);
+uint pio_get_dreq(PIO pio, uint sm, bool is_tx);
+
+/**
+ * DMA (paced by a PIO RX FIFO or a DMA timer, transfers are done when the channel registers are read)
+ */
+
+#define NUM_DMA_CHANNELS 16
+#define NUM_DMA_TIMERS 4
+#define DREQ_DMA_TIMER0 0x3b
+
+enum dma_channel_transfer_size {
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2
+};
+
+typedef struct {
+    enum dma_channel_transfer_size size;
+    bool read_increment;
+    bool write_increment;
+    uint ring_bits;
+    bool ring_write;
+    uint dreq;
+} dma_channel_config;
+
+// Addresses are full pointers on the host, 32-bit registers on the device
+typedef struct {
+    volatile uintptr_t read_addr;
+    volatile uintptr_t write_addr;
+    volatile uint32_t transfer_count;
+} dma_channel_hw_t;
+
+int dma_claim_unused_channel(bool required);
+void dma_channel_claim(uint channel);
+void dma_channel_unclaim(uint channel);
+dma_channel_config dma_channel_get_default_config(uint channel);
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size);
+void channel_config_set_read_increment(dma_channel_config *c, bool incr);
+void channel_config_set_write_increment(dma_channel_config *c, bool incr);
+void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits);
+void channel_config_set_dreq(dma_channel_config *c, uint dreq);
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint32_t encoded_transfer_count, bool trigger);
+void dma_channel_abort(uint channel);
+dma_channel_hw_t *dma_channel_hw_addr(uint channel);
+
+int dma_claim_unused_timer(bool required);
+void dma_timer_unclaim(uint timer);
+void dma_timer_set_fraction(uint timer, uint16_t numerator, uint16_t denominator);
+uint dma_get_timer_dreq(uint timer_num);
+
+static inline uint32_t dma_encode_endless_transfer_count(void) { return 0xf0000000u; }
+
+/**
+ * Host-only part: feeding the simulated RX FIFOs
+ */
+
+/**
+ * @brief Pushes one word into the RX FIFO of every running state machine with given program (all of them see the pins).
+ * @note Blocks while the FIFO is full (replays a capture paced by the FIFO, as a writer waiting for the device would)
+ * and raises the RX not empty IRQ if enabled.
+ *
+ * @param program_name is the name of the PIO program (as written after .program in the .pio file).
+ * @param word is the raw FIFO word (as pushed by the ISR).
+ *
+ * @return true if the word was pushed, false if no such program is running (or it was stopped meanwhile).
+ */
+bool host_pio_push(const char *program_name, uint32_t word);
+
+/**
+ * @brief Writes one word into the RX FIFO of every running state machine with given program, without waiting.
+ * @note A state machine whose FIFO is full drops the word (counted, see host_pio_dropped) - same as it misses the
+ * strobe while stalled on "push block" or loses the word on "push noblock". Use for writers timed by themselves.
+ *
+ * @return true if every state machine took the word, false if any dropped it (or no such program is running).
+ */
+bool host_pio_write(const char *program_name, uint32_t word);
+
+/**
+ * @brief Returns number of words dropped by host_pio_write since the state machines with given program were started.
+ */
+size_t host_pio_dropped(const char *program_name);
+
+/**
+ * @brief Returns the "mov x, status" condition of the first running state machine with given program (e.g. DSS ACK).
+ *
+ * @return true while the status would be all ones (e.g. RX FIFO level under the set limit), false otherwise.
+ */
+bool host_pio_status(const char *program_name);
+
+/**
+ * @brief Pushes a stream of words into the RX FIFO of given program.
+ *
+ * @return number of words pushed.
+ */
+size_t host_pio_feed_words(const char *program_name, const uint32_t *words, size_t count);
+
+/**
+ * @brief Pushes a stream of bytes into the RX FIFO of given program, each byte shifted in as by "in pins, 8".
+ * @note With autopush at 32 bits (shifting right) four bytes make one word and bytes of an incomplete word are not pushed.
+ *
+ * @return number of bytes pushed.
+ */
+size_t host_pio_feed_bytes(const char *program_name, const uint8_t *bytes, size_t count);
+
+/**
+ * @brief Checks whether given program is loaded into any enabled state machine.
+ */
+bool host_pio_is_running(const char *program_name);
+
+/**
+ * Host-only part: I2S output (audio_i2s of pico-extras with the producer pool of picovox.c)
+ */
+
+/**
+ * @brief Starts the simulated I2S output with a pool of buffer_count producer buffers of buffer_frames stereo frames.
+ * @note Consumer takes 256 frames at a time by real time at given rate, copying them across the given buffers and
+ * freeing each once all of it was taken, same as audio_i2s_connect. It runs lazily (when the output is used), so the
+ * output must be used from one thread.
+ *
+ * @return true if started, false if allocation failed.
+ */
+bool host_i2s_start(uint32_t rate, uint buffer_count, uint buffer_frames);
+
+/**
+ * @brief Stops the output and frees its buffers.
+ */
+void host_i2s_stop(void);
+
+/**
+ * @brief Takes a free producer buffer, waiting until the consumer frees one (same as blocking take_audio_buffer).
+ *
+ * @return interleaved samples of buffer_frames frames, NULL if the output is not started.
+ */
+int16_t *host_i2s_take(void);
+
+/**
+ * @brief Gives a buffer from host_i2s_take to the consumer.
+ *
+ * @param frames is number of frames written into it.
+ */
+void host_i2s_give(int16_t *samples, uint32_t frames);
+
+/**
+ * @brief Returns number of frames the consumer played as silence, as no given frames were left (counted after the
+ * first buffer was given).
+ */
+uint64_t host_i2s_underrun_frames(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PICO_HOST_H
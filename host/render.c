@@ -0,0 +1,224 @@
+#include "config.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "device.h"
+#include "resampler.h"
+#include "pico_host.h"
+
+/**
+ * Host driver of the emulation pipeline.
+ *
+ * Loads one device, feeds its PIO programs from capture files (raw little-endian FIFO words, each in its own thread,
+ * paced by the simulated FIFO same as the LPT port would be) and renders given number of frames at OUTPUT_RATE via the
+ * shared resampler, the same way picovox.c does.
+ * Rendered audio is stored as interleaved signed 16-bit stereo and the rendering speed is reported.
+ * Devices rendering by a clock of their own (core1 devices, DSS) are rendered into the simulated I2S output with the
+ * producer pool of picovox.c, so blocks are taken in the same bursts as on the device; for them the fill level and
+ * rate correction of the resampler and the silence played by I2S are reported at the end.
+ *
+ * Usage: picovox_render <device> <frames> <output.raw|-> [<program>=<capture.bin>]...
+ */
+
+// Same pool as SAMPLES_PER_BUFFER and NUM_BUFFERS in picovox.c
+#define RENDER_BLOCK_FRAMES 512
+#define RENDER_POOL_BUFFERS 10
+#define MAX_FEEDERS 4
+
+typedef struct {
+    const char *name;
+    Device *(*create)(void);
+} device_entry_t;
+
+static const device_entry_t device_list[] = {
+    { "covox", create_covox },
+    { "stereo", create_stereo },
+    { "ftl", create_ftl },
+    { "dss", create_dss },
+    { "opl2", create_opl2 },
+    { "tandy", create_tandy },
+    { "cms", create_cms },
+    { "opl3", create_opl3 },
+    { "dual_opl2", create_dual_opl2 }
+};
+
+typedef struct {
+    pthread_t thread;
+    char program[64];
+    uint32_t *words;
+    size_t count;
+} feeder_t;
+
+static atomic_bool rendering;
+
+static void *feeder_operation(void *arg) {
+    feeder_t *feeder = arg;
+
+    // The capture is replayed as long as the render runs (an empty capture just keeps the FIFO empty)
+    while (atomic_load(&rendering) && feeder->count > 0) {
+        if (host_pio_feed_words(feeder->program, feeder->words, feeder->count) < feeder->count) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static bool load_capture(feeder_t *feeder, const char *argument) {
+    const char *separator = strchr(argument, '=');
+    if (separator == NULL || (size_t) (separator - argument) >= sizeof(feeder->program)) {
+        fprintf(stderr, "Expected <program>=<capture file>, got %s\n", argument);
+        return false;
+    }
+    memcpy(feeder->program, argument, separator - argument);
+    feeder->program[separator - argument] = '\0';
+
+    FILE *capture = fopen(separator + 1, "rb");
+    if (capture == NULL) {
+        fprintf(stderr, "Could not open capture %s\n", separator + 1);
+        return false;
+    }
+
+    fseek(capture, 0, SEEK_END);
+    long size = ftell(capture);
+    fseek(capture, 0, SEEK_SET);
+
+    feeder->count = (size > 0) ? (size_t) size / sizeof(uint32_t) : 0;
+    feeder->words = malloc((feeder->count ? feeder->count : 1) * sizeof(uint32_t));
+    if (feeder->words == NULL) {
+        fclose(capture);
+        return false;
+    }
+
+    // Words are stored little-endian, convert them byte by byte to stay independent of the host
+    for (size_t i = 0; i < feeder->count; i++) {
+        uint8_t bytes[4];
+        if (fread(bytes, 1, 4, capture) != 4) {
+            feeder->count = i;
+            break;
+        }
+        feeder->words[i] = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+    }
+    fclose(capture);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        fprintf(stderr, "Usage: %s <device> <frames> <output.raw|-> [<program>=<capture.bin>]...\n", argv[0]);
+        return 1;
+    }
+
+    const device_entry_t *entry = NULL;
+    for (size_t i = 0; i < sizeof(device_list) / sizeof(device_list[0]); i++) {
+        if (strcmp(argv[1], device_list[i].name) == 0) {
+            entry = &device_list[i];
+        }
+    }
+    if (entry == NULL) {
+        fprintf(stderr, "Unknown device %s\n", argv[1]);
+        return 1;
+    }
+
+    uint64_t frames = strtoull(argv[2], NULL, 10);
+
+    FILE *output = NULL;
+    if (strcmp(argv[3], "-") != 0) {
+        output = fopen(argv[3], "wb");
+        if (output == NULL) {
+            fprintf(stderr, "Could not open output %s\n", argv[3]);
+            return 1;
+        }
+    }
+
+    feeder_t feeders[MAX_FEEDERS] = { 0 };
+    int feeder_count = argc - 4;
+    if (feeder_count > MAX_FEEDERS) {
+        fprintf(stderr, "At most %d captures supported\n", MAX_FEEDERS);
+        return 1;
+    }
+    for (int i = 0; i < feeder_count; i++) {
+        if (!load_capture(&feeders[i], argv[4 + i])) {
+            return 1;
+        }
+    }
+
+    Device *device = entry->create();
+    if (device == NULL || !device->load_device(device)) {
+        fprintf(stderr, "Could not load device %s\n", entry->name);
+        return 1;
+    }
+
+    atomic_store(&rendering, true);
+    for (int i = 0; i < feeder_count; i++) {
+        if (!host_pio_is_running(feeders[i].program)) {
+            fprintf(stderr, "Warning: program %s is not running in device %s\n", feeders[i].program, entry->name);
+        }
+        pthread_create(&feeders[i].thread, NULL, feeder_operation, &feeders[i]);
+    }
+
+    static resampler_t resampler;
+    resampler_configure(&resampler, device, OUTPUT_RATE);
+
+    // Devices on demand are rendered as fast as they can be
+    bool paced = device->buffered_frames != NULL;
+    if (paced && !host_i2s_start(OUTPUT_RATE, RENDER_POOL_BUFFERS, RENDER_BLOCK_FRAMES)) {
+        fprintf(stderr, "Could not start I2S output\n");
+        return 1;
+    }
+
+    static int16_t samples[2 * RENDER_BLOCK_FRAMES];
+    uint64_t rendered = 0;
+    uint64_t start = time_us_64();
+
+    while (rendered < frames) {
+        uint32_t wanted = (frames - rendered < RENDER_BLOCK_FRAMES) ? (uint32_t) (frames - rendered) : RENDER_BLOCK_FRAMES;
+        int16_t *block = paced ? host_i2s_take() : samples;
+        uint32_t generated = resampler_generate(&resampler, device, block, wanted);
+        if (output != NULL) {
+            fwrite(block, sizeof(int16_t) * 2, generated, output);
+        }
+        if (paced) {
+            host_i2s_give(block, generated);
+        }
+        rendered += generated;
+    }
+
+    uint64_t elapsed = time_us_64() - start;
+    uint64_t underrun = paced ? host_i2s_underrun_frames() : 0;
+    host_i2s_stop();
+
+    // Unloading stops the state machines, which releases feeders blocked on a full FIFO
+    atomic_store(&rendering, false);
+    device->unload_device(device);
+    multicore_reset_core1();
+    for (int i = 0; i < feeder_count; i++) {
+        pthread_join(feeders[i].thread, NULL);
+        free(feeders[i].words);
+    }
+
+    if (output != NULL) {
+        fclose(output);
+    }
+
+    double seconds = elapsed / 1e6;
+    double frames_per_second = (seconds > 0) ? rendered / seconds : 0;
+    printf("%s: %llu frames in %.3f s, %.0f frames/s (%.2fx realtime at %d Hz)\n", entry->name,
+           (unsigned long long) rendered, seconds, frames_per_second, frames_per_second / OUTPUT_RATE, OUTPUT_RATE);
+
+    if (resampler.controlled) {
+        printf("%s: %u frames buffered (target %u), rate correction %.1f ppm\n", entry->name,
+               (unsigned) (resampler.average_error / 256 + (int32_t) resampler.fill_target), (unsigned) resampler.fill_target,
+               resampler.correction * 1e6 / 4294967296.0);
+    }
+    if (paced) {
+        printf("%s: %llu frames of silence played by I2S\n", entry->name, (unsigned long long) underrun);
+    }
+
+    free(device);
+    return 0;
+}
@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include "square/square_c.h"
+
+/**
+ * Benchmark of the CMS block kernel (gameblaster_render_block) against the per-frame loop of both SAA1099 chips
+ * (gameblaster_get_sample, the way the CMS device rendered before).
+ *
+ * Both get the same random register writes (volumes, frequencies, octaves, tone/noise enables, noise rates and
+ * envelopes of both chips) between blocks of the size core1 renders. Output of the block kernel is halved and clamped,
+ * so the per-frame output is halved and clamped the same way and both must match exactly (the host build keeps
+ * SQUARE_BLEP off, band-limited edges would differ by design).
+ * Level is checked on its own too: a voice with both tone and noise doubles when both are high (as the float renderer
+ * does), so it peaks at twice the level of the tone alone.
+ * Voices 2 and 5 (the ones with envelopes) are kept audible: while they are silent, the per-frame loop does not latch
+ * a finished one-shot envelope and replays it once its position wraps, the block kernel latches it right away.
+ * Usage: cms_bench [<frames>]
+ */
+
+#define DEFAULT_FRAMES 2000000u
+
+// Same as CMS_BLOCK_MAX in devices/cms.c
+#define BLOCK_FRAMES 128
+
+// Random writes done before each block (0 to this many)
+#define MAX_WRITES_PER_BLOCK 3
+
+static uint32_t random_state = 1;
+
+static uint32_t next_random(void) {
+    random_state = random_state * 1664525u + 1013904223u;
+    return random_state >> 8;
+}
+
+static double now_seconds(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static void write_both(gameblaster_t *first, gameblaster_t *second, uint32_t address, uint8_t data) {
+    gameblaster_write(first, address, data);
+    gameblaster_write(second, address, data);
+}
+
+// Register write to a random register of a random chip (data port is even, address port odd, chip by bit 1)
+static void write_random(gameblaster_t *first, gameblaster_t *second) {
+    static const uint8_t registers[] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d,
+                                         0x10, 0x11, 0x12, 0x14, 0x15, 0x16, 0x18, 0x19, 0x1c };
+    uint32_t random = next_random();
+    uint32_t chip = (random & 1) << 1;
+    uint8_t reg = registers[(random >> 1) % sizeof(registers)];
+    uint8_t data = (uint8_t) (random >> 8);
+
+    if (reg == 0x02 || reg == 0x05) {
+        data |= 0x11; // Envelope voices stay audible
+    } else if (reg == 0x14) {
+        data |= 0x24;
+    } else if (reg >= 0x10 && reg <= 0x12) {
+        data &= 0x77; // Octaves have 3 bits
+    } else if (reg == 0x1c) {
+        data = (data & 0x0f) == 0 ? 0x02 : 0x01; // Mostly enabled, sometimes reset (and disabled until next time)
+    }
+    write_both(first, second, chip | 1, reg);
+    write_both(first, second, chip, data);
+}
+
+static void setup(gameblaster_t *first, gameblaster_t *second) {
+    for (uint32_t chip = 0; chip < 4; chip += 2) {
+        write_both(first, second, chip | 1, 0x1c);
+        write_both(first, second, chip, 0x01);
+        write_both(first, second, chip | 1, 0x14);
+        write_both(first, second, chip, 0x3f);
+    }
+}
+
+static int16_t halve(int32_t sample) {
+    sample >>= 1;
+    return (int16_t) ((sample > 32767) ? 32767 : (sample < -32768) ? -32768 : sample);
+}
+
+// Highest left sample of voice 0 at full volume, with noise added to the tone or not
+static int16_t peak_level(bool noise) {
+    int16_t output[2 * BLOCK_FRAMES];
+    gameblaster_t *cms = gameblaster_create();
+    static const uint8_t writes[][2] = { { 0x1c, 0x01 }, { 0x00, 0x0f }, { 0x08, 0x80 }, { 0x10, 0x04 }, { 0x14, 0x01 },
+                                         { 0x16, 0x00 } };
+    for (size_t i = 0; i < sizeof(writes) / sizeof(writes[0]); i++) {
+        gameblaster_write(cms, 1, writes[i][0]);
+        gameblaster_write(cms, 0, writes[i][1]);
+    }
+    gameblaster_write(cms, 1, 0x15);
+    gameblaster_write(cms, 0, noise ? 0x01 : 0x00);
+
+    int16_t peak = 0;
+    for (uint32_t block = 0; block < 64; block++) {
+        gameblaster_render_block(cms, output, BLOCK_FRAMES);
+        for (uint32_t i = 0; i < BLOCK_FRAMES; i++) {
+            peak = (output[2 * i] > peak) ? output[2 * i] : peak;
+        }
+    }
+    gameblaster_destroy(cms);
+    return peak;
+}
+
+int main(int argc, char **argv) {
+    uint32_t frames = (argc > 1) ? (uint32_t) strtoul(argv[1], NULL, 10) : DEFAULT_FRAMES;
+    uint32_t blocks = frames / BLOCK_FRAMES;
+    frames = blocks * BLOCK_FRAMES;
+
+    int16_t *frame_output = malloc(sizeof(int16_t) * 2 * frames);
+    int16_t *block_output = malloc(sizeof(int16_t) * 2 * frames);
+    gameblaster_t *frame_cms = gameblaster_create();
+    gameblaster_t *block_cms = gameblaster_create();
+    uint8_t *writes = malloc(blocks);
+    if (frame_output == NULL || block_output == NULL || frame_cms == NULL || block_cms == NULL || writes == NULL) {
+        fprintf(stderr, "Allocation failed\n");
+        return 1;
+    }
+    setup(frame_cms, block_cms);
+    for (uint32_t block = 0; block < blocks; block++) {
+        writes[block] = next_random() % (MAX_WRITES_PER_BLOCK + 1);
+    }
+
+    // Writes are done to both chips at once, so both see the same random sequence, only the rendering is timed
+    double frame_time = 0;
+    double block_time = 0;
+    for (uint32_t block = 0; block < blocks; block++) {
+        for (uint8_t write = 0; write < writes[block]; write++) {
+            write_random(frame_cms, block_cms);
+        }
+
+        double start = now_seconds();
+        for (uint32_t frame = block * BLOCK_FRAMES; frame < (block + 1) * BLOCK_FRAMES; frame++) {
+            int32_t left, right;
+            gameblaster_get_sample(frame_cms, &left, &right);
+            frame_output[2 * frame] = halve(left);
+            frame_output[2 * frame + 1] = halve(right);
+        }
+        double middle = now_seconds();
+        gameblaster_render_block(block_cms, block_output + 2 * block * BLOCK_FRAMES, BLOCK_FRAMES);
+        frame_time += middle - start;
+        block_time += now_seconds() - middle;
+    }
+
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < 2 * frames; i++) {
+        if (frame_output[i] != block_output[i]) {
+            mismatches++;
+        }
+    }
+
+    printf("CMS %u frames (random writes): per-frame loop %.0f frames/s, block kernel %.0f frames/s (%.2fx), %u mismatches\n",
+           frames, frames / frame_time, frames / block_time, frame_time / block_time, mismatches);
+
+    gameblaster_destroy(frame_cms);
+    gameblaster_destroy(block_cms);
+    free(frame_output);
+    free(block_output);
+    free(writes);
+
+    int16_t tone_peak = peak_level(false);
+    int16_t noise_peak = peak_level(true);
+    printf("CMS levels: tone %d, tone and noise %d\n", tone_peak, noise_peak);
+    if (tone_peak == 0 || noise_peak != 2 * tone_peak) {
+        fprintf(stderr, "Tone with noise does not reach twice the level of the tone\n");
+        return 1;
+    }
+
+    if (mismatches > 0) {
+        fprintf(stderr, "Block kernel output differs from the per-frame loop\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include "config.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "device.h"
+#include "resampler.h"
+#include "pico_host.h"
+
+/**
+ * Test of the DSS clock against the bursts of the I2S producer pool.
+ *
+ * A steady 7 kHz stream is written the way DSS drivers do (the FIFO filled first, then a byte whenever one is due
+ * and ACK does not signal full), while the output is rendered into the simulated I2S pool of picovox.c (10 buffers
+ * of 512 frames, taken 256 frames at a time). The stream must come out of the device whole - in order, without
+ * a byte dropped and without a tick of silence inserted - and I2S must not run out of frames.
+ * Usage: dss_pacing_test [<seconds>]
+ */
+
+#define DEFAULT_SECONDS 3.0
+
+// Same as DSS_SAMPLE_RATE and DSS_FIFO_DEPTH in devices/dss.c
+#define DSS_RATE 7000
+#define DSS_DEPTH 16
+
+// Same pool as SAMPLES_PER_BUFFER and NUM_BUFFERS in picovox.c
+#define POOL_BUFFER_FRAMES 512
+#define POOL_BUFFERS 10
+
+// How often the writer looks at the stream and ACK (drivers poll from a timer interrupt)
+#define WRITER_POLL_US 50
+
+// Bytes of the stream count up and wrap, never reaching 128 (silence)
+#define FIRST_BYTE 129
+#define BYTE_VALUES 120
+
+// I2S may miss a few takes when the host stalls (all threads share its CPUs), a starved pool misses far more
+#define MAX_UNDERRUN_SHARE 100
+
+static atomic_bool writing;
+static atomic_bool checking;
+
+static uint32_t (*dss_generate_block)(Device *self, int16_t *interleaved, uint32_t frames);
+static bool stream_started = false;
+static uint8_t expected_byte;
+static uint64_t checked_frames = 0;
+static uint64_t silent_frames = 0;
+static uint64_t wrong_frames = 0;
+
+static uint8_t stream_byte(uint64_t index) {
+    return FIRST_BYTE + index % BYTE_VALUES;
+}
+
+static void *writer_operation(void *arg) {
+    uint64_t start = time_us_64();
+    uint64_t written = 0;
+
+    while (atomic_load(&writing)) {
+        uint64_t due = DSS_DEPTH + (time_us_64() - start) * DSS_RATE / 1000000;
+        while (written < due && host_pio_status("dss")) {
+            host_pio_write("dss", (uint32_t) stream_byte(written) << 24);
+            written++;
+        }
+        sleep_us(WRITER_POLL_US);
+    }
+    return NULL;
+}
+
+// Frames at the DSS clock are checked as the resampler takes them
+static uint32_t checked_block(Device *self, int16_t *interleaved, uint32_t frames) {
+    uint32_t generated = dss_generate_block(self, interleaved, frames);
+
+    for (uint32_t frame = 0; frame < generated && atomic_load(&checking); frame++) {
+        int16_t sample = interleaved[2 * frame];
+        if (!stream_started) {
+            if (sample == 0) { // Ticks before the first write
+                continue;
+            }
+            stream_started = true;
+            expected_byte = (sample >> 8) + 128;
+        }
+
+        checked_frames++;
+        if (sample == 0) {
+            silent_frames++;
+            continue;
+        }
+        if (sample != (expected_byte - 128) << 8 || interleaved[2 * frame + 1] != sample) {
+            wrong_frames++;
+        }
+        uint8_t byte = (sample >> 8) + 128;
+        expected_byte = (byte == FIRST_BYTE + BYTE_VALUES - 1) ? FIRST_BYTE : byte + 1;
+    }
+    return generated;
+}
+
+int main(int argc, char **argv) {
+    double seconds = (argc > 1) ? atof(argv[1]) : DEFAULT_SECONDS;
+
+    Device *dss = create_dss();
+    if (dss == NULL || !dss->load_device(dss)) {
+        fprintf(stderr, "Could not load DSS\n");
+        return 1;
+    }
+    dss_generate_block = dss->generate_block;
+    dss->generate_block = checked_block;
+
+    static resampler_t resampler;
+    resampler_configure(&resampler, dss, OUTPUT_RATE);
+    if (!host_i2s_start(OUTPUT_RATE, POOL_BUFFERS, POOL_BUFFER_FRAMES)) {
+        fprintf(stderr, "Could not start I2S output\n");
+        return 1;
+    }
+
+    atomic_store(&writing, true);
+    atomic_store(&checking, true);
+    pthread_t writer;
+    pthread_create(&writer, NULL, writer_operation, NULL);
+
+    uint64_t frames = (uint64_t) (seconds * OUTPUT_RATE);
+    for (uint64_t rendered = 0; rendered < frames; rendered += POOL_BUFFER_FRAMES) {
+        int16_t *buffer = host_i2s_take();
+        host_i2s_give(buffer, resampler_generate(&resampler, dss, buffer, POOL_BUFFER_FRAMES));
+    }
+    uint64_t underrun_frames = host_i2s_underrun_frames();
+
+    // Checking stops before the writer, the ticks after it would be silent
+    atomic_store(&checking, false);
+    atomic_store(&writing, false);
+    pthread_join(writer, NULL);
+    size_t dropped = host_pio_dropped("dss");
+    dss->unload_device(dss);
+    host_i2s_stop();
+
+    printf("dss: %llu frames checked, %llu silent, %llu out of order, %zu bytes dropped, %llu frames of I2S silence\n",
+           (unsigned long long) checked_frames, (unsigned long long) silent_frames, (unsigned long long) wrong_frames,
+           dropped, (unsigned long long) underrun_frames);
+
+    bool passed = checked_frames >= (uint64_t) (seconds * DSS_RATE / 2) && silent_frames == 0 && wrong_frames == 0 &&
+                  dropped == 0 && underrun_frames <= frames / MAX_UNDERRUN_SHARE;
+    free(dss);
+    if (!passed) {
+        fprintf(stderr, "DSS stream did not come out whole\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include "config.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "device.h"
+#include "resampler.h"
+#include "pico_host.h"
+
+/**
+ * Test of dual OPL2 under bursts of register writes.
+ *
+ * Music drivers update both chips in a burst once per timer tick (with the delays an OPL2 needs after the address and
+ * the data), while the output is rendered into the simulated I2S pool of picovox.c. State machines of both chips see
+ * every write and miss the following ones once their FIFO is full (4 writes), so both FIFOs must be drained while
+ * the burst goes on - no word may be dropped, I2S must not run out of frames and both channels must sound.
+ * Usage: dual_opl2_burst_test [<seconds>]
+ */
+
+#define DEFAULT_SECONDS 2.0
+
+// Same pool as SAMPLES_PER_BUFFER and NUM_BUFFERS in picovox.c
+#define POOL_BUFFER_FRAMES 512
+#define POOL_BUFFERS 10
+
+// Timer tick of the driver (70 Hz) and the delays after writing the address and the data (3.3 and 23 us on OPL2)
+#define BURST_PERIOD_US 14000
+#define ADDRESS_DELAY_US 4
+#define DATA_DELAY_US 23
+
+#define CHANNELS 9
+
+// I2S may miss a few takes when the host stalls (all threads share its CPUs), a starved pool misses far more
+#define MAX_UNDERRUN_SHARE 100
+
+static atomic_bool writing;
+
+// Pins as captured by opl2.pio (STROBE low for the address, SELIN high for the right chip)
+static uint32_t port_word(bool right, bool data, uint8_t value) {
+#if LPT_STROBE_SWAPPED
+    uint32_t pins = data | (value << 1);
+#else
+    uint32_t pins = value | (data << 8);
+#endif
+    pins |= (uint32_t) right << (LPT_SELIN_PIN - LPT_CAPTURE_BASE_PIN);
+    return pins << 16;
+}
+
+static void write_register(bool right, uint8_t address, uint8_t value) {
+    host_pio_write("opl2", port_word(right, false, address));
+    sleep_us(ADDRESS_DELAY_US);
+    host_pio_write("opl2", port_word(right, true, value));
+    sleep_us(DATA_DELAY_US);
+}
+
+// Same instrument on every channel of both chips
+static void setup_chip(bool right) {
+    for (uint8_t channel = 0; channel < CHANNELS; channel++) {
+        uint8_t slot = (channel % 3) + (channel / 3) * 8;
+        write_register(right, 0x20 + slot, 0x01);
+        write_register(right, 0x23 + slot, 0x01);
+        write_register(right, 0x40 + slot, 0x10);
+        write_register(right, 0x43 + slot, 0x00);
+        write_register(right, 0x60 + slot, 0xf0);
+        write_register(right, 0x63 + slot, 0xf0);
+        write_register(right, 0x80 + slot, 0x77);
+        write_register(right, 0x83 + slot, 0x77);
+        write_register(right, 0xc0 + channel, 0x00);
+    }
+}
+
+// Every burst sets the frequencies of all channels of both chips, keying them on and off in turn
+static void *writer_operation(void *arg) {
+    setup_chip(false);
+    setup_chip(true);
+
+    uint64_t next_burst = time_us_64();
+    for (uint32_t burst = 0; atomic_load(&writing); burst++) {
+        for (int chip = 0; chip < 2; chip++) {
+            for (uint8_t channel = 0; channel < CHANNELS; channel++) {
+                uint16_t fnum = 0x150 + ((burst * 7 + channel * 31 + chip * 13) & 0xff);
+                bool key_on = ((burst + channel) & 3) != 3;
+                write_register(chip, 0xa0 + channel, fnum & 0xff);
+                write_register(chip, 0xb0 + channel, (key_on ? 0x20 : 0) | (4 << 2) | (fnum >> 8));
+            }
+        }
+
+        next_burst += BURST_PERIOD_US;
+        uint64_t now = time_us_64();
+        if (next_burst > now) {
+            sleep_us(next_burst - now);
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    double seconds = (argc > 1) ? atof(argv[1]) : DEFAULT_SECONDS;
+
+    Device *opl = create_dual_opl2();
+    if (opl == NULL || !opl->load_device(opl)) {
+        fprintf(stderr, "Could not load dual OPL2\n");
+        return 1;
+    }
+
+    static resampler_t resampler;
+    resampler_configure(&resampler, opl, OUTPUT_RATE);
+    if (!host_i2s_start(OUTPUT_RATE, POOL_BUFFERS, POOL_BUFFER_FRAMES)) {
+        fprintf(stderr, "Could not start I2S output\n");
+        return 1;
+    }
+
+    atomic_store(&writing, true);
+    pthread_t writer;
+    pthread_create(&writer, NULL, writer_operation, NULL);
+
+    double left_energy = 0;
+    double right_energy = 0;
+    uint64_t frames = (uint64_t) (seconds * OUTPUT_RATE);
+    for (uint64_t rendered = 0; rendered < frames; rendered += POOL_BUFFER_FRAMES) {
+        int16_t *buffer = host_i2s_take();
+        uint32_t generated = resampler_generate(&resampler, opl, buffer, POOL_BUFFER_FRAMES);
+        for (uint32_t frame = 0; frame < generated; frame++) {
+            left_energy += (double) buffer[2 * frame] * buffer[2 * frame];
+            right_energy += (double) buffer[2 * frame + 1] * buffer[2 * frame + 1];
+        }
+        host_i2s_give(buffer, generated);
+    }
+    uint64_t underrun_frames = host_i2s_underrun_frames();
+
+    atomic_store(&writing, false);
+    pthread_join(writer, NULL);
+    size_t dropped = host_pio_dropped("opl2");
+    opl->unload_device(opl);
+    multicore_reset_core1();
+    host_i2s_stop();
+
+    printf("dual_opl2: %zu words dropped, %llu frames of I2S silence, level left %.0f, right %.0f\n", dropped,
+           (unsigned long long) underrun_frames, sqrt(left_energy / frames), sqrt(right_energy / frames));
+
+    bool passed = dropped == 0 && underrun_frames <= frames / MAX_UNDERRUN_SHARE && left_energy > 0 &&
+                  right_energy > 0;
+    free(opl);
+    if (!passed) {
+        fprintf(stderr, "Writes of dual OPL2 were lost\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdint.h>
+#include "square/lfsr.h"
+
+/**
+ * Test of the noise shift register jumps (square/lfsr.h) against clocking one step at a time.
+ *
+ * Every count of clocks up to MAX_CLOCKS (slices, loops of slices and matrix jumps) is checked from a set of states,
+ * and then long jumps chained from the running state.
+ * Usage: lfsr_test
+ */
+
+#define MAX_CLOCKS 2000
+#define LONG_JUMPS 200
+
+static uint32_t random_state = 1;
+
+static uint32_t next_random(void) {
+    random_state = random_state * 1664525u + 1013904223u;
+    return random_state;
+}
+
+template<bool _WhiteNoise>
+static uint32_t tandy_mismatches(char const *name) {
+    uint32_t mismatches = 0;
+    for (int start = 0; start < 16; start++) {
+        uint32_t initial = (start == 0) ? 0x4000 : (next_random() >> 8) & 0x7fff; // First is PRNG_INITIAL
+        uint32_t stepped = initial;
+        for (uint32_t clocks = 0; clocks <= MAX_CLOCKS; clocks++) {
+            if (tandy_lfsr_advance<_WhiteNoise>(initial, clocks) != stepped) {
+                mismatches++;
+            }
+            stepped = tandy_lfsr_clock<_WhiteNoise>(stepped);
+        }
+    }
+
+    uint32_t jumped = 0x4000;
+    uint32_t stepped = 0x4000;
+    for (int jump = 0; jump < LONG_JUMPS; jump++) {
+        uint32_t clocks = next_random() >> 16;
+        jumped = tandy_lfsr_advance<_WhiteNoise>(jumped, clocks);
+        for ( ; clocks != 0; clocks--) {
+            stepped = tandy_lfsr_clock<_WhiteNoise>(stepped);
+        }
+        if (jumped != stepped) {
+            mismatches++;
+        }
+    }
+
+    printf("Tandy %s: %u mismatches\n", name, mismatches);
+    return mismatches;
+}
+
+static uint32_t saa1099_mismatches(void) {
+    uint32_t mismatches = 0;
+    for (int start = 0; start < 16; start++) {
+        uint32_t initial = (start == 0) ? 0xfffff : next_random(); // First is PRNG_INITIAL, others have history bits set
+        uint32_t stepped = initial;
+        for (uint32_t clocks = 0; clocks <= MAX_CLOCKS; clocks++) {
+            if (saa1099_lfsr_advance(initial, clocks) != stepped) {
+                mismatches++;
+            }
+            stepped = saa1099_lfsr_clock(stepped);
+        }
+    }
+
+    uint32_t jumped = 0xfffff;
+    uint32_t stepped = 0xfffff;
+    for (int jump = 0; jump < LONG_JUMPS; jump++) {
+        uint32_t clocks = next_random() >> 16;
+        jumped = saa1099_lfsr_advance(jumped, clocks);
+        for ( ; clocks != 0; clocks--) {
+            stepped = saa1099_lfsr_clock(stepped);
+        }
+        if (jumped != stepped) {
+            mismatches++;
+        }
+    }
+
+    printf("SAA1099: %u mismatches\n", mismatches);
+    return mismatches;
+}
+
+int main(void) {
+    uint32_t mismatches = tandy_mismatches<false>("periodic") + tandy_mismatches<true>("white") + saa1099_mismatches();
+    if (mismatches > 0) {
+        fprintf(stderr, "Jumps differ from clocking one step at a time\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include "emu8950.h"
+
+/**
+ * Test of the linear emu8950 renderer in rhythm mode against the per-sample renderer.
+ *
+ * Rhythm mode takes paths of its own in the linear renderer (bass drum through a side buffer, the _MO/_RO scaling of
+ * the rhythm slots, the noise update check), so melodic notes with drum hits between them are rendered by both. This
+ * file is built twice: as opl_rhythm_reference (emu8950 without EMU8950_LINEAR, writes its output to a file) and as
+ * opl_rhythm_test (emu8950 as on the device, compares with that file). Sections with melodic notes (which the linear
+ * renderer steps envelopes of a few samples apart) must differ by less than MAX_DIFFERENCE_DB from the reference,
+ * relative to the level of the reference, the drums (all of them and each alone) must match exactly. No section may be
+ * silent.
+ * Usage: opl_rhythm_reference <output.raw>, opl_rhythm_test <reference.raw>
+ */
+
+#define OPL_CLOCK 3579552
+#define STEPS 64
+#define CHUNK_SAMPLES 100
+
+// Linear rendering rounds differently (log-sin and exponent tables are walked in steps), so it is not bit exact
+#define MAX_DIFFERENCE_DB -60.0
+
+// Drums are isolated by the mask, melodic channels by not playing their notes (the linear renderer masks drums only)
+static const struct {
+    const char *name;
+    bool melodic;
+    uint32_t mask;
+} sections[] = {
+    { "all", true, 0 },
+    { "melodic", true, OPL_MASK_RHYTHM },
+    { "rhythm", false, 0 },
+    { "bass drum", false, OPL_MASK_RHYTHM & ~OPL_MASK_BD },
+    { "snare drum", false, OPL_MASK_RHYTHM & ~OPL_MASK_SD },
+    { "tom", false, OPL_MASK_RHYTHM & ~OPL_MASK_TOM },
+    { "cymbal", false, OPL_MASK_RHYTHM & ~OPL_MASK_CYM },
+    { "hi-hat", false, OPL_MASK_RHYTHM & ~OPL_MASK_HH },
+};
+
+#define SECTIONS (sizeof(sections) / sizeof(sections[0]))
+
+static int16_t *render(OPL *opl, int16_t *output, uint32_t samples) {
+    while (samples > 0) {
+        uint32_t chunk = (samples > CHUNK_SAMPLES) ? CHUNK_SAMPLES : samples;
+        OPL_calc_buffer(opl, output, chunk);
+        output += chunk;
+        samples -= chunk;
+    }
+    return output;
+}
+
+static uint32_t section_samples(void) {
+    uint32_t samples = 0;
+    for (uint32_t step = 0; step < STEPS; step++) {
+        samples += 1000 + 2000 + step * 13;
+    }
+    return samples;
+}
+
+// Melodic instruments on channels 0 to 5 (and 6 to 8 before rhythm mode is on), drum hits between their notes
+static void render_section(bool melodic, uint32_t mask, int16_t *output) {
+    OPL *opl = OPL_new(OPL_CLOCK, OPL_CLOCK / 72);
+    opl->mask = mask; // OPL_setMask is declared but not built
+    OPL_writeReg(opl, 0x01, 0x20);
+    for (uint32_t ch = 0; ch < 9; ch++) {
+        uint32_t slot = (ch % 3) + (ch / 3) * 8;
+        OPL_writeReg(opl, 0x20 + slot, 0x21 + (ch & 1) * 0x80);
+        OPL_writeReg(opl, 0x23 + slot, 0x21 + (ch & 2) * 0x20);
+        OPL_writeReg(opl, 0x40 + slot, 0x10 + ch);
+        OPL_writeReg(opl, 0x43 + slot, 0x00);
+        OPL_writeReg(opl, 0x60 + slot, 0xf3 - ch);
+        OPL_writeReg(opl, 0x63 + slot, 0xf4);
+        OPL_writeReg(opl, 0x80 + slot, 0x45);
+        OPL_writeReg(opl, 0x83 + slot, 0x37);
+        OPL_writeReg(opl, 0xe0 + slot, ch & 3);
+        OPL_writeReg(opl, 0xe3 + slot, (ch >> 1) & 3);
+        OPL_writeReg(opl, 0xc0 + ch, (ch * 3) & 0x0f);
+    }
+    // Hi-hat and tom at full volume, snare drum on a sine (its phase stays on the silent part of waveform 3)
+    OPL_writeReg(opl, 0x51, 0x00);
+    OPL_writeReg(opl, 0x52, 0x00);
+    OPL_writeReg(opl, 0xf4, 0x00);
+    OPL_writeReg(opl, 0xbd, 0xe0);
+
+    for (uint32_t step = 0; step < STEPS; step++) {
+        for (uint32_t ch = 0; ch < 6 && melodic; ch++) {
+            if ((step + ch) % 4 == 0) {
+                uint32_t fnum = 0x200 + ((step * 37 + ch * 91) & 0x1ff);
+                OPL_writeReg(opl, 0xa0 + ch, fnum & 0xff);
+                OPL_writeReg(opl, 0xb0 + ch, 0x20 | (((step + ch) % 5 + 2) << 2) | (fnum >> 8));
+            } else if ((step + ch) % 4 == 2) {
+                OPL_writeReg(opl, 0xb0 + ch, 0);
+            }
+        }
+        // Frequencies of the drum channels change every step (hi-hat and cymbal take theirs from channels 7 and 8)
+        OPL_writeReg(opl, 0xa6, 0x57);
+        OPL_writeReg(opl, 0xb6, 0x09);
+        OPL_writeReg(opl, 0xa7, 0x88 + step);
+        OPL_writeReg(opl, 0xb7, 0x0a);
+        OPL_writeReg(opl, 0xa8, 0x30);
+        OPL_writeReg(opl, 0xb8, 0x0b);
+        OPL_writeReg(opl, 0xbd, 0xe0 | (step & 0x1f));
+        output = render(opl, output, 1000);
+        OPL_writeReg(opl, 0xbd, 0xe0);
+        output = render(opl, output, 2000 + step * 13);
+    }
+    OPL_delete(opl);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <file.raw>\n", argv[0]);
+        return 1;
+    }
+    uint32_t samples = section_samples();
+    int16_t *output = malloc(sizeof(int16_t) * samples * SECTIONS);
+    if (output == NULL) {
+        fprintf(stderr, "Allocation failed\n");
+        return 1;
+    }
+    for (uint32_t section = 0; section < SECTIONS; section++) {
+        render_section(sections[section].melodic, sections[section].mask, output + section * samples);
+    }
+
+#ifdef OPL_RHYTHM_REFERENCE
+    FILE *file = fopen(argv[1], "wb");
+    if (file == NULL || fwrite(output, sizeof(int16_t), samples * SECTIONS, file) != samples * SECTIONS) {
+        fprintf(stderr, "Cannot write %s\n", argv[1]);
+        return 1;
+    }
+    fclose(file);
+    printf("Per-sample reference: %u sections of %u samples\n", (uint32_t) SECTIONS, samples);
+    free(output);
+    return 0;
+#else
+    int16_t *reference = malloc(sizeof(int16_t) * samples * SECTIONS);
+    FILE *file = fopen(argv[1], "rb");
+    if (reference == NULL || file == NULL ||
+        fread(reference, sizeof(int16_t), samples * SECTIONS, file) != samples * SECTIONS) {
+        fprintf(stderr, "Cannot read reference %s\n", argv[1]);
+        return 1;
+    }
+    fclose(file);
+
+    bool passed = true;
+    for (uint32_t section = 0; section < SECTIONS; section++) {
+        const int16_t *expected = reference + section * samples;
+        const int16_t *actual = output + section * samples;
+        double signal = 0;
+        double difference = 0;
+        for (uint32_t i = 0; i < samples; i++) {
+            double error = (double) actual[i] - expected[i];
+            signal += (double) expected[i] * expected[i];
+            difference += error * error;
+        }
+        double db = (difference > 0) ? 10.0 * log10(difference / signal) : -INFINITY;
+        bool ok = signal > 0 && (sections[section].melodic ? db <= MAX_DIFFERENCE_DB : difference == 0);
+        printf("%-10s: level %.0f, difference %.1f dB%s\n", sections[section].name, sqrt(signal / samples), db,
+               ok ? "" : " FAILED");
+        passed &= ok;
+    }
+    free(reference);
+    free(output);
+
+    if (!passed) {
+        fprintf(stderr, "Linear rendering differs from the per-sample renderer\n");
+        return 1;
+    }
+    return 0;
+#endif
+}
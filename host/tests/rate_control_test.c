@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "resampler.h"
+
+/**
+ * Test of the rate control of the shared resampler, in simulated time (no threads, no real clock).
+ *
+ * Producer renders blocks at its native rate by its own clock (the way core1 does by lpt_capture_frames_due), consumer
+ * takes output buffers by the I2S clock, which is off by a few hundred ppm. Fill level must settle at the target and
+ * the correction must find the offset of the clocks, without the ringbuffer ever running empty.
+ * Usage: rate_control_test
+ */
+
+#define TEST_NATIVE_RATE 49716
+#define TEST_OUTPUT_RATE 96000
+#define TEST_BUFFER_FRAMES 256
+#define TEST_BLOCK_MIN 32
+#define TEST_BLOCK_MAX 128
+
+#define SETTLE_SECONDS 30
+#define CHECK_SECONDS 30
+
+// Allowed distance of the mean fill level from the target (frames, single readings swing by a block) and of the
+// correction from the offset of the clocks (ppm) once settled
+#define MAX_FILL_ERROR 32
+#define MAX_PPM_ERROR 30.0
+
+typedef struct {
+    Device device;
+    double time;         // Seconds by the clock of the producer
+    uint64_t produced;
+    uint64_t consumed;
+    uint32_t underruns;
+} simulated_t;
+
+static uint32_t buffered(Device *self) {
+    simulated_t *simulated = (simulated_t *) self;
+    return (uint32_t) (simulated->produced - simulated->consumed);
+}
+
+static uint32_t generate_block(Device *self, int16_t *interleaved, uint32_t frames) {
+    simulated_t *simulated = (simulated_t *) self;
+    uint32_t available = buffered(self);
+    if (available < frames) {
+        simulated->underruns++;
+        simulated->produced += frames - available; // Silence, as the devices do
+    }
+    simulated->consumed += frames;
+    memset(interleaved, 0, frames * 2 * sizeof(int16_t));
+    return frames;
+}
+
+// Producer renders only the frames due by its clock, in blocks like the core1 loops
+static void produce(simulated_t *simulated, uint32_t fill_target) {
+    uint64_t due = fill_target + (uint64_t) (simulated->time * TEST_NATIVE_RATE);
+    while (due > simulated->produced + TEST_BLOCK_MIN) {
+        uint64_t block = due - simulated->produced;
+        simulated->produced += (block > TEST_BLOCK_MAX) ? TEST_BLOCK_MAX : block;
+    }
+}
+
+static bool run(int32_t offset_ppm) {
+    simulated_t simulated = { 0 };
+    simulated.device.generate_block = generate_block;
+    simulated.device.buffered_frames = buffered;
+    simulated.device.native_rate = TEST_NATIVE_RATE;
+
+    static resampler_t resampler;
+    resampler_configure(&resampler, &simulated.device, TEST_OUTPUT_RATE);
+
+    // Output clock measured by the clock of the producer
+    double buffer_seconds = (double) TEST_BUFFER_FRAMES / TEST_OUTPUT_RATE / (1.0 + offset_ppm * 1e-6);
+    uint32_t buffers = (SETTLE_SECONDS + CHECK_SECONDS) * TEST_OUTPUT_RATE / TEST_BUFFER_FRAMES;
+    uint32_t settle = SETTLE_SECONDS * TEST_OUTPUT_RATE / TEST_BUFFER_FRAMES;
+
+    int16_t output[2 * TEST_BUFFER_FRAMES];
+    uint32_t settled_underruns = 0;
+    int64_t fill_error_sum = 0;
+    double worst_ppm_error = 0;
+
+    for (uint32_t i = 0; i < buffers; i++) {
+        produce(&simulated, resampler.fill_target);
+        if (i == settle) {
+            settled_underruns = simulated.underruns;
+        } else if (i > settle) {
+            // Read where the controller reads it, frames taken into the resampler included
+            uint32_t fill = buffered(&simulated.device) + resampler.input_count - resampler.input_read;
+            fill_error_sum += (int32_t) fill - (int32_t) resampler.fill_target;
+        }
+
+        resampler_generate(&resampler, &simulated.device, output, TEST_BUFFER_FRAMES);
+        simulated.time += buffer_seconds;
+
+        if (i > settle) {
+            double ppm_error = resampler.correction / 4294.967296 + offset_ppm; // Faster consumer needs a smaller step
+            worst_ppm_error = (ppm_error > worst_ppm_error) ? ppm_error : ((-ppm_error > worst_ppm_error) ? -ppm_error : worst_ppm_error);
+        }
+    }
+
+    uint32_t late_underruns = simulated.underruns - settled_underruns;
+    int32_t fill_error = (int32_t) (fill_error_sum / (int64_t) (buffers - settle - 1));
+    printf("Offset %+d ppm: mean fill error %d frames (target %u), worst correction error %.1f ppm, underruns %u (%u settled)\n",
+           offset_ppm, fill_error, resampler.fill_target, worst_ppm_error, simulated.underruns, late_underruns);
+
+    polyphase_delete(resampler.polyphase);
+    resampler.polyphase = NULL;
+    return abs(fill_error) <= MAX_FILL_ERROR && worst_ppm_error <= MAX_PPM_ERROR && late_underruns == 0;
+}
+
+int main(void) {
+    bool passed = true;
+    passed &= run(0);
+    passed &= run(100);
+    passed &= run(-300);
+    passed &= run(500);
+    if (!passed) {
+        fprintf(stderr, "Fill level or rate correction did not settle\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "polyphase.h"
+
+/**
+ * Benchmark of the integer polyphase FIR (polyphase.h) against the double based converter emu8950 used before.
+ *
+ * Both convert the same signal (two tones and noise at the OPL rate) in the way emu8950 drives them
+ * (putData at the input rate, getData at the output rate) and the outputs are compared, so the benchmark
+ * also fails if the new one drifts from the old filter. Downsampling is only timed, the old filter did not taper
+ * its window there - instead tones above the output Nyquist frequency must come out attenuated by the stopband
+ * (rates of the devices converted down to 44.1 and 48 kHz by the shared resampler).
+ * Usage: rateconv_bench [<input samples>]
+ */
+
+#define INPUT_RATE 49716
+#define DEFAULT_SAMPLES 2000000u
+
+// Largest difference allowed between both converters relative to the signal (old table has 12-bit coefficients
+// and its lookup truncates the position to 1/256 of a sample, which alone gives about -45 dB at 15 kHz)
+#define MAX_DIFFERENCE_DB -34.0
+
+// Tones at least this far above the output Nyquist frequency (relative to it) must be attenuated at least this much,
+// tones this far below it must pass within the ripple
+#define STOPBAND_DISTANCE 0.3
+#define MIN_STOPBAND_DB 60.0
+#define MAX_PASSBAND_DB 0.5
+#define TONE_SAMPLES 65536
+
+/* Copy of the original converter from emu8950.c */
+
+#define LW 16
+#define SINC_RESO 256
+#define SINC_AMP_BITS 12
+#define LEGACY_PI 3.14159265358979323846264338327950288
+
+typedef struct {
+    double timer;
+    double f_ratio;
+    int16_t *sinc_table;
+    int16_t buf[LW];
+} legacy_conv_t;
+
+static double blackman(double x) { return 0.42 - 0.5 * cos(2 * LEGACY_PI * x) + 0.08 * cos(4 * LEGACY_PI * x); }
+
+static double sinc(double x) { return (x == 0.0 ? 1.0 : sin(LEGACY_PI * x) / (LEGACY_PI * x)); }
+
+static double windowed_sinc(double x) { return blackman(0.5 + 0.5 * x / (LW / 2)) * sinc(x); }
+
+static void legacy_init(legacy_conv_t *conv, double f_inp, double f_out) {
+    memset(conv, 0, sizeof(*conv));
+    conv->f_ratio = f_inp / f_out;
+    conv->sinc_table = malloc(sizeof(conv->sinc_table[0]) * SINC_RESO * LW / 2);
+    for (int i = 0; i < SINC_RESO * LW / 2; i++) {
+        const double x = (double) i / SINC_RESO;
+        if (f_out < f_inp) {
+            conv->sinc_table[i] = (int16_t) ((1 << SINC_AMP_BITS) * windowed_sinc(x / conv->f_ratio) / conv->f_ratio);
+        } else {
+            conv->sinc_table[i] = (int16_t) ((1 << SINC_AMP_BITS) * windowed_sinc(x));
+        }
+    }
+}
+
+static int16_t lookup_sinc_table(int16_t *table, double x) {
+    int16_t index = (int16_t) (x * SINC_RESO);
+    if (index < 0)
+        index = -index;
+    return table[(SINC_RESO * LW / 2 - 1 < index) ? SINC_RESO * LW / 2 - 1 : index];
+}
+
+static void legacy_put(legacy_conv_t *conv, int16_t data) {
+    for (int i = 0; i < LW - 1; i++) {
+        conv->buf[i] = conv->buf[i + 1];
+    }
+    conv->buf[LW - 1] = data;
+}
+
+static int16_t legacy_get(legacy_conv_t *conv) {
+    int32_t sum = 0;
+    double dn;
+    conv->timer += conv->f_ratio;
+    dn = conv->timer - floor(conv->timer);
+    conv->timer = dn;
+
+    for (int k = 0; k < LW; k++) {
+        double x = ((double) k - (LW / 2 - 1)) - dn;
+        sum += conv->buf[k] * lookup_sinc_table(conv->sinc_table, x);
+    }
+    return sum >> SINC_AMP_BITS;
+}
+
+/* Benchmark */
+
+static double now_seconds(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static int16_t *make_signal(uint32_t samples) {
+    int16_t *signal = malloc(sizeof(int16_t) * samples);
+    uint32_t random_state = 0x12345678;
+    for (uint32_t i = 0; i < samples; i++) {
+        random_state = random_state * 1664525u + 1013904223u;
+        double value = 9000.0 * sin(2 * LEGACY_PI * 440.0 * i / INPUT_RATE)
+                     + 6000.0 * sin(2 * LEGACY_PI * 15000.0 * i / INPUT_RATE)
+                     + (double) ((int32_t) (random_state >> 16) - 32768) / 16.0;
+        signal[i] = (int16_t) value;
+    }
+    return signal;
+}
+
+static legacy_conv_t legacy;
+static polyphase_t *polyphase;
+
+static void legacy_put_sample(int16_t sample) { legacy_put(&legacy, sample); }
+static int16_t legacy_get_sample(void) { return legacy_get(&legacy); }
+static void polyphase_put_sample(int16_t sample) { polyphase_put(polyphase, 0, sample); }
+static int16_t polyphase_get_sample(void) { polyphase_advance(polyphase); return polyphase_get(polyphase, 0); }
+
+// Drives the converter as emu8950 does - output time counted in input steps, inputs put while they are due
+static void convert(const int16_t *signal, uint32_t samples, uint32_t output_rate, int16_t *output, uint32_t output_count,
+                    void (*put)(int16_t), int16_t (*get)(void)) {
+    uint64_t out_time = 0;
+    uint32_t consumed = 0;
+
+    for (uint32_t produced = 0; produced < output_count; produced++) {
+        while ((uint64_t) consumed * output_rate <= out_time && consumed < samples) {
+            put(signal[consumed]);
+            consumed++;
+        }
+        output[produced] = get();
+        out_time += INPUT_RATE;
+    }
+}
+
+static int run(const int16_t *signal, uint32_t samples, uint32_t output_rate) {
+    uint32_t output_count = (uint32_t) (((uint64_t) samples * output_rate) / INPUT_RATE) - LW;
+    int16_t *legacy_output = malloc(sizeof(int16_t) * output_count);
+    int16_t *polyphase_output = malloc(sizeof(int16_t) * output_count);
+
+    legacy_init(&legacy, INPUT_RATE, output_rate);
+    polyphase = polyphase_create(INPUT_RATE, output_rate, 1);
+    if (legacy_output == NULL || polyphase_output == NULL || polyphase == NULL) {
+        fprintf(stderr, "Allocation failed\n");
+        return 1;
+    }
+
+    double start = now_seconds();
+    convert(signal, samples, output_rate, legacy_output, output_count, legacy_put_sample, legacy_get_sample);
+    double legacy_time = now_seconds() - start;
+
+    start = now_seconds();
+    convert(signal, samples, output_rate, polyphase_output, output_count, polyphase_put_sample, polyphase_get_sample);
+    double polyphase_time = now_seconds() - start;
+
+    double signal_squares = 0;
+    double difference_squares = 0;
+    for (uint32_t i = 0; i < output_count; i++) {
+        double difference = (double) legacy_output[i] - polyphase_output[i];
+        signal_squares += (double) legacy_output[i] * legacy_output[i];
+        difference_squares += difference * difference;
+    }
+    double difference_db = 10.0 * log10(difference_squares / signal_squares);
+
+    printf("%d -> %u Hz: legacy %.1f ns/sample, polyphase %.1f ns/sample (%.2fx), difference %.1f dB%s\n",
+           INPUT_RATE, output_rate, 1e9 * legacy_time / output_count, 1e9 * polyphase_time / output_count,
+           legacy_time / polyphase_time, difference_db, (output_rate > INPUT_RATE) ? "" : " (not compared)");
+
+    free(legacy.sinc_table);
+    polyphase_delete(polyphase);
+    free(legacy_output);
+    free(polyphase_output);
+
+    if (output_rate > INPUT_RATE && difference_db > MAX_DIFFERENCE_DB) {
+        fprintf(stderr, "Polyphase output differs from the legacy converter too much\n");
+        return 1;
+    }
+    return 0;
+}
+
+// Level of a tone in the output (dB relative to full amplitude of the input), single bin DFT over whole periods
+static double tone_db(const int16_t *output, uint32_t count, double frequency, uint32_t rate, double amplitude) {
+    double periods = floor(count * frequency / rate);
+    uint32_t length = (uint32_t) (periods * rate / frequency);
+    double real = 0;
+    double imaginary = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        double angle = 2 * LEGACY_PI * frequency * i / rate;
+        real += output[i] * cos(angle);
+        imaginary += output[i] * sin(angle);
+    }
+    return 20.0 * log10(2.0 * sqrt(real * real + imaginary * imaginary) / length / amplitude);
+}
+
+// Converts a tone and returns its level at the frequency it comes out at (aliased if above output Nyquist)
+static double convert_tone(uint32_t input_rate, uint32_t output_rate, double frequency) {
+    const double amplitude = 16000.0;
+    polyphase_t *converter = polyphase_create(input_rate, output_rate, 1);
+    int16_t *output = malloc(sizeof(int16_t) * TONE_SAMPLES);
+    if (converter == NULL || output == NULL) {
+        fprintf(stderr, "Allocation failed\n");
+        exit(1);
+    }
+
+    uint32_t input = 0;
+    for (uint32_t i = 0; i < TONE_SAMPLES; i++) {
+        for (uint32_t due = polyphase_advance(converter); due > 0; due--, input++) {
+            polyphase_put(converter, 0, (int16_t) lround(amplitude * sin(2 * LEGACY_PI * frequency * input / input_rate)));
+        }
+        output[i] = polyphase_get(converter, 0);
+    }
+
+    double output_frequency = fmod(frequency, output_rate);
+    if (output_frequency > output_rate / 2.0) {
+        output_frequency = output_rate - output_frequency;
+    }
+    uint32_t settled = 2 * POLYPHASE_MAX_TAPS; // History filled with the tone
+    double level = tone_db(output + settled, TONE_SAMPLES - settled, output_frequency, output_rate, amplitude);
+
+    polyphase_delete(converter);
+    free(output);
+    return level;
+}
+
+static int check_stopband(uint32_t input_rate, uint32_t output_rate) {
+    double nyquist = output_rate / 2.0;
+    double passband = convert_tone(input_rate, output_rate, nyquist * (1.0 - STOPBAND_DISTANCE));
+    double worst = -1000.0;
+    for (double frequency = nyquist * (1.0 + STOPBAND_DISTANCE); frequency < input_rate / 2.0; frequency += 1000.0) {
+        double level = convert_tone(input_rate, output_rate, frequency);
+        worst = (level > worst) ? level : worst;
+    }
+
+    printf("%u -> %u Hz: passband %.2f dB at %.0f Hz, stopband %.1f dB from %.0f Hz\n", input_rate, output_rate,
+           passband, nyquist * (1.0 - STOPBAND_DISTANCE), worst, nyquist * (1.0 + STOPBAND_DISTANCE));
+
+    if (fabs(passband) > MAX_PASSBAND_DB || worst > -MIN_STOPBAND_DB) {
+        fprintf(stderr, "Downsampling filter lets through what the output cannot hold\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    uint32_t samples = (argc > 1) ? (uint32_t) strtoul(argv[1], NULL, 10) : DEFAULT_SAMPLES;
+    int16_t *signal = make_signal(samples);
+
+    int result = run(signal, samples, 44100);    // Downsampling
+    result |= run(signal, samples, 48000);
+    result |= run(signal, samples, 96000);       // Upsampling
+
+    result |= check_stopband(96000, 44100);      // Covox, FTL, Stereo-On-1 at the lower output rates
+    result |= check_stopband(96000, 48000);
+
+    free(signal);
+    return result;
+}
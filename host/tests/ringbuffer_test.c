@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <pthread.h>
+#include "ringbuffer.h"
+
+/**
+ * Two-thread test of the SPSC ringbuffer.
+ *
+ * Producer pushes a sequence of frames (left = sequence number, right = its complement), mixing single and bulk
+ * pushes of varying length, consumer pops them the same way and checks that no frame is lost, duplicated or torn.
+ */
+
+#define TEST_RINGBUFFER_SIZE 64
+#define TEST_FRAMES 4000000u
+#define MAX_BULK 100
+
+static ringbuffer_t *ringbuffer;
+
+static stereo_frame_t make_frame(uint32_t sequence) {
+    return (stereo_frame_t) { (int16_t) sequence, (int16_t) ~sequence };
+}
+
+// Small xorshift, so both sides vary their request sizes independently
+static uint32_t next_random(uint32_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static void *producer_operation(void *arg) {
+    uint32_t random_state = 0x12345678;
+    stereo_frame_t frames[MAX_BULK];
+    uint32_t sequence = 0;
+
+    while (sequence < TEST_FRAMES) {
+        uint32_t wanted = next_random(&random_state) % MAX_BULK;
+
+        if (wanted == 0) {
+            if (ringbuffer_push(ringbuffer, make_frame(sequence))) {
+                sequence++;
+            } else {
+                sched_yield();
+            }
+            continue;
+        }
+
+        if (wanted > TEST_FRAMES - sequence) {
+            wanted = TEST_FRAMES - sequence;
+        }
+        for (uint32_t i = 0; i < wanted; i++) {
+            frames[i] = make_frame(sequence + i);
+        }
+
+        size_t pushed = ringbuffer_push_bulk(ringbuffer, frames, wanted);
+        if (pushed == 0) {
+            sched_yield();
+        }
+        sequence += pushed;
+    }
+    return NULL;
+}
+
+static bool check_frame(stereo_frame_t frame, uint32_t sequence) {
+    stereo_frame_t expected = make_frame(sequence);
+    if (frame.left != expected.left || frame.right != expected.right) {
+        fprintf(stderr, "Frame %u: expected (%d, %d), got (%d, %d)\n", sequence, expected.left, expected.right, frame.left, frame.right);
+        return false;
+    }
+    return true;
+}
+
+static void *consumer_operation(void *arg) {
+    uint32_t random_state = 0x9abcdef0;
+    stereo_frame_t frames[MAX_BULK];
+    uint32_t sequence = 0;
+    bool *result = arg;
+
+    while (sequence < TEST_FRAMES) {
+        uint32_t wanted = next_random(&random_state) % MAX_BULK;
+
+        if (wanted == 0) {
+            stereo_frame_t frame;
+            if (!ringbuffer_pop(ringbuffer, &frame)) {
+                sched_yield();
+                continue;
+            }
+            if (!check_frame(frame, sequence)) {
+                *result = false;
+                return NULL;
+            }
+            sequence++;
+            continue;
+        }
+
+        size_t popped = ringbuffer_pop_bulk(ringbuffer, frames, wanted);
+        if (popped == 0) {
+            sched_yield();
+        }
+        for (size_t i = 0; i < popped; i++) {
+            if (!check_frame(frames[i], sequence + i)) {
+                *result = false;
+                return NULL;
+            }
+        }
+        sequence += popped;
+    }
+
+    *result = ringbuffer_empty(ringbuffer);
+    return NULL;
+}
+
+int main(void) {
+    if (ringbuffer_create(TEST_RINGBUFFER_SIZE + 1) != NULL) {
+        fprintf(stderr, "Ringbuffer of size not power of 2 created\n");
+        return 1;
+    }
+
+    ringbuffer = ringbuffer_create(TEST_RINGBUFFER_SIZE);
+    if (ringbuffer == NULL) {
+        return 1;
+    }
+
+    // Single-threaded sanity check of full/empty without any flag
+    for (uint32_t i = 0; i < TEST_RINGBUFFER_SIZE; i++) {
+        if (!ringbuffer_push(ringbuffer, make_frame(i))) {
+            fprintf(stderr, "Push %u failed before ringbuffer was full\n", i);
+            return 1;
+        }
+    }
+    if (!ringbuffer_full(ringbuffer) || ringbuffer_push(ringbuffer, make_frame(0)) || ringbuffer_free(ringbuffer) != 0) {
+        fprintf(stderr, "Full ringbuffer accepted a frame\n");
+        return 1;
+    }
+    ringbuffer_reset(ringbuffer);
+    if (!ringbuffer_empty(ringbuffer) || ringbuffer_count(ringbuffer) != 0) {
+        fprintf(stderr, "Ringbuffer not empty after reset\n");
+        return 1;
+    }
+
+    bool result = false;
+    pthread_t producer;
+    pthread_t consumer;
+    pthread_create(&consumer, NULL, consumer_operation, &result);
+    pthread_create(&producer, NULL, producer_operation, NULL);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+
+    ringbuffer_delete(ringbuffer);
+
+    if (!result) {
+        fprintf(stderr, "Two-thread test failed\n");
+        return 1;
+    }
+    printf("%u frames passed through without loss, duplication or tearing\n", TEST_FRAMES);
+    return 0;
+}
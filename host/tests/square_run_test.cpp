@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include "square/square.h"
+
+/**
+ * Test of the run filling in the square-wave kernels of CMS and PC speaker against rendering frame by frame.
+ *
+ * Both kernels compute a frame and fill the frames after it up to the next edge (tone, noise or envelope step) at
+ * once. The same kernel called for one frame at a time never fills a run, so its output is the reference. Random
+ * register writes come between blocks of random length, and many blocks end right before or right at the next edge
+ * (found by rendering a copy of the reference ahead), so runs ending exactly on a block boundary are covered.
+ * Usage: square_run_test
+ */
+
+#define TEST_BLOCKS 40000
+#define MAX_BLOCK_FRAMES 300
+#define LOOKAHEAD_FRAMES 512
+
+// A write is done before one block of this many (on average)
+#define BLOCKS_PER_WRITE 3
+
+static uint32_t random_state = 1;
+
+static uint32_t next_random(void) {
+    random_state = random_state * 1664525u + 1013904223u;
+    return random_state >> 8;
+}
+
+// Length of the next block: random, or ending right before or right at the next edge of given lookahead
+template<typename _Frame>
+static uint32_t block_length(std::vector<_Frame> const &ahead, _Frame const &last, uint32_t &aligned) {
+    uint32_t mode = next_random() % 3;
+    if (mode != 0) {
+        for (uint32_t edge = 0; edge < ahead.size(); edge++) {
+            if (!(ahead[edge] == ((edge == 0) ? last : ahead[edge - 1]))) {
+                aligned++;
+                uint32_t length = (mode == 1) ? edge : edge + 1; // Edge starts the next block or ends this one
+                return (length == 0) ? 1 : length;
+            }
+        }
+    }
+    return 1 + next_random() % MAX_BLOCK_FRAMES;
+}
+
+struct cms_frame_t {
+    int16_t left, right;
+    bool operator==(cms_frame_t const &other) const { return left == other.left && right == other.right; }
+};
+
+static void write_random(cms_t &first, cms_t &second) {
+    static const uint8_t registers[] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d,
+                                         0x10, 0x11, 0x12, 0x14, 0x15, 0x16, 0x18, 0x19, 0x1c };
+    uint32_t random = next_random();
+    uint32_t chip = (random & 1) << 1;
+    uint8_t reg = registers[(random >> 1) % sizeof(registers)];
+    uint8_t data = uint8_t(random >> 8);
+
+    if (reg >= 0x10 && reg <= 0x12)
+        data &= 0x77; // Octaves have 3 bits
+    else if (reg == 0x1c)
+        data = ((data & 0x0f) == 0) ? 0x02 : 0x01; // Mostly enabled, sometimes reset (and disabled until next time)
+
+    for (cms_t *cms : { &first, &second }) {
+        cms->write_addr(chip | 1, reg);
+        cms->write_data(chip, data);
+    }
+}
+
+static bool test_cms(void) {
+    cms_t reference, filled;
+    for (cms_t *cms : { &reference, &filled }) {
+        for (uint32_t chip = 0; chip < 4; chip += 2) {
+            cms->write_addr(chip | 1, 0x1c);
+            cms->write_data(chip, 0x01);
+        }
+    }
+
+    uint32_t frames = 0, mismatches = 0, aligned = 0;
+    cms_frame_t last = { 0, 0 };
+    std::vector<cms_frame_t> ahead(LOOKAHEAD_FRAMES), expected, output;
+    for (uint32_t block = 0; block < TEST_BLOCKS; block++) {
+        if (next_random() % BLOCKS_PER_WRITE == 0)
+            write_random(reference, filled);
+
+        cms_t copy = reference;
+        for (cms_frame_t &frame : ahead)
+            copy.generate_frames(&frame.left, 1);
+        uint32_t length = block_length(ahead, last, aligned);
+
+        expected.resize(length);
+        output.resize(length);
+        for (cms_frame_t &frame : expected)
+            reference.generate_frames(&frame.left, 1);
+        filled.generate_frames(&output[0].left, length);
+
+        for (uint32_t i = 0; i < length; i++)
+            mismatches += !(expected[i] == output[i]);
+        last = expected[length - 1];
+        frames += length;
+    }
+
+    printf("CMS: %u frames, %u blocks (%u ending at an edge), %u mismatches\n", frames, TEST_BLOCKS, aligned, mismatches);
+    return mismatches == 0;
+}
+
+struct speaker_frame_t {
+    float left, right;
+    bool operator==(speaker_frame_t const &other) const { return left == other.left && right == other.right; }
+};
+
+static bool test_speaker(void) {
+    speaker_generator_t reference, filled;
+    reference.process_event(1193, true);
+    filled.process_event(1193, true);
+
+    uint32_t frames = 0, mismatches = 0, aligned = 0;
+    speaker_frame_t last = { 0, 0 };
+    std::vector<speaker_frame_t> ahead(LOOKAHEAD_FRAMES), expected, output;
+    for (uint32_t block = 0; block < TEST_BLOCKS; block++) {
+        if (next_random() % BLOCKS_PER_WRITE == 0) {
+            // Divisors from above the Nyquist frequency down to the lowest notes, sometimes 0 (held high) or off
+            uint32_t random = next_random();
+            uint16_t divisor = ((random & 0x1f) == 0) ? 0 : uint16_t(1 + ((random >> 5) % 0x3000));
+            bool enable = ((random >> 20) & 7) != 0;
+            reference.process_event(divisor, enable);
+            filled.process_event(divisor, enable);
+        }
+
+        speaker_generator_t copy = reference;
+        for (speaker_frame_t &frame : ahead) {
+            frame = { 0, 0 };
+            copy.generate_frames(&frame.left, 1);
+        }
+        uint32_t length = block_length(ahead, last, aligned);
+
+        expected.assign(length, { 0, 0 });
+        output.assign(length, { 0, 0 });
+        for (speaker_frame_t &frame : expected)
+            reference.generate_frames(&frame.left, 1);
+        filled.generate_frames(&output[0].left, length);
+
+        for (uint32_t i = 0; i < length; i++)
+            mismatches += !(expected[i] == output[i]);
+        last = expected[length - 1];
+        frames += length;
+    }
+
+    printf("Speaker: %u frames, %u blocks (%u ending at an edge), %u mismatches\n", frames, TEST_BLOCKS, aligned, mismatches);
+    return mismatches == 0;
+}
+
+int main(void) {
+    bool passed = test_cms();
+    passed &= test_speaker();
+    if (!passed) {
+        fprintf(stderr, "Run filling differs from rendering frame by frame\n");
+        return 1;
+    }
+    return 0;
+}
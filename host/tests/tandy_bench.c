@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "square/square_c.h"
+
+/**
+ * Benchmark of the Tandy block kernel (tandy_generate_mono) against the stereo per-frame loop (tandy_generate_frames).
+ *
+ * Both chips get the same register writes (three tones, both noise modes, volume changes) between blocks of the
+ * size core1 renders, and the mono output must match the left channel of the stereo one exactly.
+ * The song is played once with the noise channel audible and once with tones only (the usual case, where the block
+ * kernel fills the frames between edges in bulk).
+ * Usage: tandy_bench [<frames>]
+ */
+
+#define DEFAULT_FRAMES 4000000u
+
+// Same as TND_BLOCK_MAX in devices/tandy.c
+#define BLOCK_FRAMES 128
+
+// A write is done every this many blocks (music drivers update the chip ~60-200 times a second, this is more)
+#define BLOCKS_PER_WRITE 4
+
+static double now_seconds(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+// Register write for given step of the song (latch/data byte as sent to port 0xC0)
+static void write_step(tandy_t *tandy, uint32_t step, bool noise) {
+    uint8_t channel = step % 3;
+    uint16_t divisor = 0x40 + ((step * 37) & 0x3BF);
+
+    switch ((step / 3) % 4) {
+        case 0: // Tone of one channel (low and high part)
+            tandy_write(tandy, 0x80 | (channel << 5) | (divisor & 0x0F));
+            tandy_write(tandy, (divisor >> 4) & 0x3F);
+            break;
+        case 1: // Volume of one channel
+            tandy_write(tandy, 0x90 | (channel << 5) | ((step >> 2) & 0x0F));
+            break;
+        case 2: // Noise - white/periodic and all the rates including tracking of channel 2
+            tandy_write(tandy, 0xE0 | (step & 0x07));
+            break;
+        default: // Noise volume (off for tones only)
+            tandy_write(tandy, 0xF0 | (noise ? ((step >> 3) & 0x07) : 0x0F));
+            break;
+    }
+}
+
+static void setup(tandy_t *tandy, bool noise) {
+    for (uint8_t channel = 0; channel < 4; channel++) {
+        tandy_write(tandy, 0x90 | (channel << 5) | 0x02);
+    }
+    for (uint32_t step = 0; step < 12; step++) {
+        write_step(tandy, step, noise);
+    }
+}
+
+static int run(uint32_t frames, bool noise) {
+    uint32_t blocks = frames / BLOCK_FRAMES;
+
+    int16_t *stereo_output = malloc(sizeof(int16_t) * 2 * frames);
+    int16_t *mono_output = malloc(sizeof(int16_t) * frames);
+    tandy_t *stereo_tandy = tandy_create();
+    tandy_t *mono_tandy = tandy_create();
+    if (stereo_output == NULL || mono_output == NULL || stereo_tandy == NULL || mono_tandy == NULL) {
+        fprintf(stderr, "Allocation failed\n");
+        return 1;
+    }
+    setup(stereo_tandy, noise);
+    setup(mono_tandy, noise);
+
+    double start = now_seconds();
+    for (uint32_t block = 0; block < blocks; block++) {
+        if (block % BLOCKS_PER_WRITE == 0) {
+            write_step(stereo_tandy, block / BLOCKS_PER_WRITE, noise);
+        }
+        tandy_generate_frames(stereo_tandy, stereo_output + 2 * block * BLOCK_FRAMES, BLOCK_FRAMES);
+    }
+    double stereo_time = now_seconds() - start;
+
+    start = now_seconds();
+    for (uint32_t block = 0; block < blocks; block++) {
+        if (block % BLOCKS_PER_WRITE == 0) {
+            write_step(mono_tandy, block / BLOCKS_PER_WRITE, noise);
+        }
+        tandy_generate_mono(mono_tandy, mono_output + block * BLOCK_FRAMES, BLOCK_FRAMES);
+    }
+    double mono_time = now_seconds() - start;
+
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < frames; i++) {
+        if (mono_output[i] != stereo_output[2 * i] || stereo_output[2 * i] != stereo_output[2 * i + 1]) {
+            mismatches++;
+        }
+    }
+
+    printf("Tandy %u frames (%s): per-frame loop %.0f frames/s, block kernel %.0f frames/s (%.2fx), %u mismatches\n",
+           frames, noise ? "tones and noise" : "tones only", frames / stereo_time, frames / mono_time,
+           stereo_time / mono_time, mismatches);
+
+    tandy_destroy(stereo_tandy);
+    tandy_destroy(mono_tandy);
+    free(stereo_output);
+    free(mono_output);
+
+    if (mismatches > 0) {
+        fprintf(stderr, "Block kernel output differs from the per-frame loop\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    uint32_t frames = (argc > 1) ? (uint32_t) strtoul(argv[1], NULL, 10) : DEFAULT_FRAMES;
+    frames -= frames % BLOCK_FRAMES;
+
+    int result = run(frames, true);
+    result |= run(frames, false);
+    return result;
+}
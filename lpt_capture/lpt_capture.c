@@ -0,0 +1,220 @@
+#include "config.h"
+
+#include "lpt_capture.h"
+#include "pio_manager.h"
+#include "hardware/clocks.h"
+#include "hardware/pio.h"
+#include "pico/time.h"
+#include "lpt_timestamp.pio.h"
+
+// Each pass of the waiting loops in lpt_timestamp.pio takes 3 cycles
+#define LPT_CYCLES_PER_TICK 3
+
+// Anchor is taken again after this long (in ticks = 1 s), so the mapping never accumulates rounding
+#define LPT_ANCHOR_MAX_AGE(capture) ((capture)->tick_rate)
+
+void lpt_capture_init(lpt_capture_t *capture, ringbuffer_t *ringbuffer, uint32_t frame_rate) {
+    capture->ringbuffer = ringbuffer;
+    capture->frame_rate = frame_rate;
+    atomic_init(&capture->queued, 0);
+    atomic_init(&capture->applied, 0);
+    capture->tick_rate = clock_get_hz(clk_sys) / LPT_CYCLES_PER_TICK;
+    capture->anchored = false;
+    capture->clock = capture;
+    atomic_init(&capture->clock_sequence, 0);
+    capture->clock_start_us = time_us_64();
+    capture->clock_start_position = ringbuffer_produced(ringbuffer);
+}
+
+void lpt_capture_share_clock(lpt_capture_t *capture, lpt_capture_t *owner) {
+    capture->clock = owner;
+}
+
+static void restart_clock(lpt_capture_t *capture, size_t position) {
+    unsigned sequence = atomic_load_explicit(&capture->clock_sequence, memory_order_relaxed);
+    atomic_store_explicit(&capture->clock_sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    capture->clock_start_us = time_us_64();
+    capture->clock_start_position = position;
+    atomic_store_explicit(&capture->clock_sequence, sequence + 2, memory_order_release);
+}
+
+// Position of the frame due now by the sample clock (of the owner, if shared)
+static size_t clock_position(lpt_capture_t *capture) {
+    lpt_capture_t *clock = capture->clock;
+    unsigned sequence;
+    uint64_t start_us;
+    size_t start_position;
+    do {
+        sequence = atomic_load_explicit(&clock->clock_sequence, memory_order_acquire);
+        start_us = clock->clock_start_us;
+        start_position = clock->clock_start_position;
+        atomic_thread_fence(memory_order_acquire);
+    } while ((sequence & 1) != 0 || sequence != atomic_load_explicit(&clock->clock_sequence, memory_order_relaxed));
+
+    uint64_t elapsed_us = time_us_64() - start_us;
+    size_t target = (size_t) (((uint64_t) clock->frame_rate * FILL_TARGET_MS) / 1000);
+    return start_position + target + (size_t) ((elapsed_us * clock->frame_rate) / 1000000);
+}
+
+size_t lpt_capture_frames_due(lpt_capture_t *capture) {
+    size_t produced = ringbuffer_produced(capture->ringbuffer);
+    if (ringbuffer_empty(capture->ringbuffer)) { // Consumer caught up, clock starts again from here
+        restart_clock(capture, produced);
+    }
+
+    ptrdiff_t due = clock_position(capture) - produced;
+    if (due <= 0) {
+        return 0;
+    }
+
+    size_t space = ringbuffer_free(capture->ringbuffer);
+    return ((size_t) due < space) ? (size_t) due : space;
+}
+
+bool lpt_capture_load(lpt_capture_t *capture) {
+    capture->offset = pio_manager_load(&capture->pio, &capture->sm, &lpt_timestamp_program);
+    if (capture->offset < 0) {
+        return false;
+    }
+
+    pio_sm_config used_config = lpt_timestamp_program_get_default_config(capture->offset);
+    sm_config_set_in_pins(&used_config, LPT_CAPTURE_BASE_PIN);
+    sm_config_set_jmp_pin(&used_config, LPT_INIT_PIN);
+    sm_config_set_in_shift(&used_config, false, false, 32);
+    sm_config_set_fifo_join(&used_config, PIO_FIFO_JOIN_RX);
+
+    // Only the LPT inputs are taken, pins in between (ACK...) may be driven by other programs
+    for (int i = LPT_CAPTURE_BASE_PIN; i < LPT_CAPTURE_BASE_PIN + 9; i++) { // Sets pins to use PIO
+        pio_gpio_init(capture->pio, i);
+    }
+    pio_gpio_init(capture->pio, LPT_INIT_PIN);
+    pio_gpio_init(capture->pio, LPT_SELIN_PIN);
+    pio_gpio_init(capture->pio, LPT_AUTOFEED_PIN);
+
+    pio_sm_set_consecutive_pindirs(capture->pio, capture->sm, LPT_CAPTURE_BASE_PIN, 9, false); // Sets pins in PIO to be inputs
+    pio_sm_set_consecutive_pindirs(capture->pio, capture->sm, LPT_INIT_PIN, 1, false);
+    pio_sm_set_consecutive_pindirs(capture->pio, capture->sm, LPT_SELIN_PIN, 1, false);
+    pio_sm_set_consecutive_pindirs(capture->pio, capture->sm, LPT_AUTOFEED_PIN, 1, false);
+
+    if (pio_sm_init(capture->pio, capture->sm, capture->offset, &used_config) < 0) {
+        return false;
+    }
+
+    pio_sm_set_enabled(capture->pio, capture->sm, true);
+    return true;
+}
+
+void lpt_capture_unload(lpt_capture_t *capture) {
+    pio_sm_set_enabled(capture->pio, capture->sm, false);
+    pio_manager_unload(capture->pio, capture->sm, capture->offset, &lpt_timestamp_program);
+
+    for (int i = LPT_CAPTURE_BASE_PIN; i < LPT_CAPTURE_BASE_PIN + 9; i++) {
+        gpio_deinit(i);
+    }
+    gpio_deinit(LPT_INIT_PIN);
+    gpio_deinit(LPT_SELIN_PIN);
+    gpio_deinit(LPT_AUTOFEED_PIN);
+}
+
+bool lpt_capture_read(lpt_capture_t *capture, uint16_t *pins, uint32_t *timestamp) {
+    if (pio_sm_is_rx_fifo_empty(capture->pio, capture->sm)) {
+        return false;
+    }
+
+    *pins = pio_sm_get(capture->pio, capture->sm) & 0xFFFF;
+    *timestamp = pio_sm_get_blocking(capture->pio, capture->sm); // Pushed right after the snapshot
+    return true;
+}
+
+bool lpt_capture_full(lpt_capture_t *capture) {
+    size_t applied = atomic_load_explicit(&capture->applied, memory_order_acquire);
+    return atomic_load_explicit(&capture->queued, memory_order_relaxed) - applied == LPT_PENDING_WRITES;
+}
+
+// Position of the frame being produced now
+static size_t current_position(lpt_capture_t *capture) {
+    return clock_position(capture);
+}
+
+// Slot of the last write is rewritten only by the producer, so it is read even if the consumer applied it meanwhile
+static void queue_at(lpt_capture_t *capture, size_t position, uint32_t value) {
+    size_t queued = atomic_load_explicit(&capture->queued, memory_order_relaxed);
+    if (queued != atomic_load_explicit(&capture->applied, memory_order_acquire)) {
+        size_t last_position = capture->writes[(queued - 1) & (LPT_PENDING_WRITES - 1)].position;
+        if ((ptrdiff_t) (position - last_position) < 0) { // Keep writes in order
+            position = last_position;
+        }
+    }
+
+    lpt_write_t *write = &capture->writes[queued & (LPT_PENDING_WRITES - 1)];
+    write->position = position;
+    write->value = value;
+    atomic_store_explicit(&capture->queued, queued + 1, memory_order_release);
+}
+
+void lpt_capture_queue(lpt_capture_t *capture, uint32_t value) {
+    queue_at(capture, current_position(capture), value);
+}
+
+void lpt_capture_queue_timed(lpt_capture_t *capture, uint32_t value, uint32_t timestamp) {
+    size_t now = current_position(capture);
+    uint32_t elapsed = timestamp - capture->anchor_tick;
+
+    if (capture->anchored && elapsed < LPT_ANCHOR_MAX_AGE(capture)) {
+        size_t position = capture->anchor_position + (size_t) (((uint64_t) elapsed * capture->frame_rate) / capture->tick_rate);
+
+        // Mapping is trusted only while it stays close to the clock of the consumer (reading may be late by some blocks)
+        ptrdiff_t deviation = position - now;
+        ptrdiff_t tolerance = capture->ringbuffer->size / 4;
+        if (deviation > -tolerance && deviation < tolerance) {
+            queue_at(capture, position, value);
+            return;
+        }
+    }
+
+    // First write of a burst (or lost track) - it is placed as if it was read right now and the following ones are relative to it
+    capture->anchored = true;
+    capture->anchor_tick = timestamp;
+    capture->anchor_position = now;
+    queue_at(capture, now, value);
+}
+
+// Oldest write not applied yet (consumer side), NULL if there is none
+static const lpt_write_t *oldest_write(lpt_capture_t *capture) {
+    size_t applied = atomic_load_explicit(&capture->applied, memory_order_relaxed);
+    if (atomic_load_explicit(&capture->queued, memory_order_acquire) == applied) {
+        return NULL;
+    }
+    return &capture->writes[applied & (LPT_PENDING_WRITES - 1)];
+}
+
+bool lpt_capture_pop(lpt_capture_t *capture, uint32_t *value) {
+    const lpt_write_t *write = oldest_write(capture);
+    if (write == NULL) {
+        return false;
+    }
+
+    *value = write->value;
+    atomic_store_explicit(&capture->applied, atomic_load_explicit(&capture->applied, memory_order_relaxed) + 1,
+                          memory_order_release);
+    return true;
+}
+
+bool lpt_capture_pop_due(lpt_capture_t *capture, size_t position, uint32_t *value) {
+    const lpt_write_t *write = oldest_write(capture);
+    if (write == NULL || (ptrdiff_t) (write->position - position) > 0) {
+        return false;
+    }
+    return lpt_capture_pop(capture, value);
+}
+
+size_t lpt_capture_frames_until_next(lpt_capture_t *capture, size_t position) {
+    const lpt_write_t *write = oldest_write(capture);
+    if (write == NULL) {
+        return SIZE_MAX;
+    }
+
+    ptrdiff_t distance = write->position - position;
+    return (distance > 0) ? (size_t) distance : 0;
+}
@@ -0,0 +1,161 @@
+#ifndef LPT_CAPTURE_H
+#define LPT_CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "ringbuffer.h"
+#include "hardware/pio.h"
+
+// Register writes waiting for their sample position (must be power of 2)
+#define LPT_PENDING_WRITES 256
+
+/**
+ * @brief Register write (device specific value) with the sample position it should be applied at.
+ *
+ * Position is in frames produced into the device ringbuffer (see ringbuffer_produced).
+ */
+typedef struct {
+    size_t position;
+    uint32_t value;
+} lpt_write_t;
+
+/**
+ * @brief Queue of register writes of one register-based device (OPL2, Tandy, CMS) and its sample clock.
+ *
+ * Sample clock runs on the system timer - frame due now is FILL_TARGET_MS ahead of the frames elapsed since it
+ * started, and producer renders only the frames due (lpt_capture_frames_due), so its ringbuffer stays at that level
+ * and the consumer follows it (rate control of the shared resampler). Clock starts again whenever the consumer
+ * empties the ringbuffer (device loaded, first buffers of the output, or producer fell behind).
+ * Two chips filling one ringbuffer (dual OPL2) share the clock of the one calling lpt_capture_frames_due, so their
+ * writes are stamped on the same timeline (see lpt_capture_share_clock).
+ *
+ * Writes are stamped either when read (the frame due at that moment) or, with LPT_TIMESTAMP_CAPTURE, from the PIO
+ * timestamp mapped through an anchor (tick, position) taken at the first write of a burst. Either way the timing
+ * does not depend on when core1 gets to the write, so producer can render blocks and split them right at the writes.
+ * @note Queue is single-producer/single-consumer, so the chip may be rendered on another core than the one reading
+ * its writes (right chip of dual OPL2). Everything else except lpt_capture_load/unload is used only by the core
+ * reading the writes (core1).
+ */
+typedef struct lpt_capture {
+    ringbuffer_t *ringbuffer;
+    uint32_t frame_rate;
+
+    // Sample clock (position due at the start includes the fill target), restarts are guarded by the sequence
+    // (odd while being written) as a sharing capture may read it from the other core
+    struct lpt_capture *clock;
+    atomic_uint clock_sequence;
+    uint64_t clock_start_us;
+    size_t clock_start_position;
+
+    // Writes queued and applied since init (free-running, wrapped by mask on access), same scheme as ringbuffer_t
+    lpt_write_t writes[LPT_PENDING_WRITES];
+    atomic_size_t queued;
+    atomic_size_t applied;
+
+    // Mapping of PIO timestamps to sample positions
+    uint32_t tick_rate;
+    bool anchored;
+    uint32_t anchor_tick;
+    size_t anchor_position;
+
+    // Timestamping PIO program (only with LPT_TIMESTAMP_CAPTURE)
+    PIO pio;
+    uint8_t sm;
+    int offset;
+} lpt_capture_t;
+
+/**
+ * @brief Empties the queue and sets the sample clock.
+ *
+ * @param capture is the queue to be initialized.
+ * @param ringbuffer is the device ringbuffer, whose positions are used as sample clock.
+ * @param frame_rate is the rate of frames in the ringbuffer (Hz).
+ */
+void lpt_capture_init(lpt_capture_t *capture, ringbuffer_t *ringbuffer, uint32_t frame_rate);
+
+/**
+ * @brief Stamps the writes of the capture by the sample clock of another one (set after lpt_capture_init).
+ * @note Only the owner of the clock may call lpt_capture_frames_due, the sharing capture just reads the clock.
+ *
+ * @param capture is the queue whose writes are stamped by the shared clock.
+ * @param owner is the queue whose producer runs (and restarts) the clock, filling the same ringbuffer.
+ */
+void lpt_capture_share_clock(lpt_capture_t *capture, lpt_capture_t *owner);
+
+/**
+ * @brief Returns number of frames the producer should render now (due by the sample clock and fitting the ringbuffer).
+ */
+size_t lpt_capture_frames_due(lpt_capture_t *capture);
+
+/**
+ * @brief Loads and starts the timestamping PIO program (snapshot of 16 LPT pins + timestamp on every INIT falling edge).
+ *
+ * @return true if the program is running, false if anything failed.
+ */
+bool lpt_capture_load(lpt_capture_t *capture);
+
+/**
+ * @brief Stops and unloads the timestamping PIO program.
+ */
+void lpt_capture_unload(lpt_capture_t *capture);
+
+/**
+ * @brief Reads one captured write from the timestamping PIO program.
+ *
+ * @param pins is a pointer where the snapshot of pins is placed (bit 0 is LPT_CAPTURE_BASE_PIN).
+ * @param timestamp is a pointer where the timestamp of the write is placed.
+ *
+ * @return true if a write was read, false if there is none.
+ */
+bool lpt_capture_read(lpt_capture_t *capture, uint16_t *pins, uint32_t *timestamp);
+
+/**
+ * @brief Checks whether the queue is full (caller rendering the chip should apply the oldest write right away via
+ * lpt_capture_pop, another core should leave the write in the FIFO until the queue has room).
+ */
+bool lpt_capture_full(lpt_capture_t *capture);
+
+/**
+ * @brief Queues a write stamped at the moment it is read.
+ *
+ * @param value is the device specific write.
+ */
+void lpt_capture_queue(lpt_capture_t *capture, uint32_t value);
+
+/**
+ * @brief Queues a write stamped by the timestamping PIO program.
+ *
+ * @param value is the device specific write.
+ * @param timestamp is the timestamp read by lpt_capture_read.
+ */
+void lpt_capture_queue_timed(lpt_capture_t *capture, uint32_t value, uint32_t timestamp);
+
+/**
+ * @brief Pops the oldest write regardless of its position.
+ *
+ * @param value is a pointer where the write is placed.
+ *
+ * @return true if a write was popped, false if queue is empty.
+ */
+bool lpt_capture_pop(lpt_capture_t *capture, uint32_t *value);
+
+/**
+ * @brief Pops the oldest write if it is due at the given position.
+ *
+ * @param position is the position of the next frame to be produced.
+ * @param value is a pointer where the write is placed.
+ *
+ * @return true if a write was popped, false if no write is due.
+ */
+bool lpt_capture_pop_due(lpt_capture_t *capture, size_t position, uint32_t *value);
+
+/**
+ * @brief Returns number of frames that can be rendered from the given position before the next write is due.
+ *
+ * @return number of frames, SIZE_MAX if there is no write queued.
+ */
+size_t lpt_capture_frames_until_next(lpt_capture_t *capture, size_t position);
+
+#endif // LPT_CAPTURE_H
@@ -14,8 +14,6 @@
 #include <string.h>
 #include <assert.h>
 
-#define SAMPLE_BUF_SIZE 1024
-
 #ifndef INLINE
 #if defined(_MSC_VER)
 #define INLINE __inline
@@ -134,7 +132,8 @@ static uint8_t am_table[210] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
                                 3, 3, 3, 3, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2,  //
                                 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
 
-#if !EMU8950_SLOT_RENDER
+// rhythm slots are rendered here even with EMU8950_SLOT_RENDER
+#if !EMU8950_SLOT_RENDER || !EMU8950_NO_PERCUSSION_MODE
 #if !EMU8950_NO_WAVE_TABLE_MAP
 static uint16_t wave_table_map[4][PG_WIDTH];
 #else
@@ -214,106 +213,35 @@ static int32_t rks_table[2][32][2];
 ****************************************************/
 /* Note: to disable internal rate converter, set clock/72 to output sampling rate. */
 
+#if !EMU8950_NO_RATECONV
 /*
- * LW is truncate length of sinc(x) calculation.
- * Lower LW is faster, higher LW results better quality.
- * LW must be a non-zero positive even number, no upper limit.
- * LW=16 or greater is recommended when upsampling.
- * LW=8 is practically okay for downsampling.
+ * Converter is the integer polyphase FIR shared with the devices (see polyphase.h),
+ * windowed sinc of POLYPHASE_TAPS length when upsampling, same filter as the original double based one.
  */
-#define LW 16
-
-#if !EMU8950_NO_RATECONV
-/* resolution of sinc(x) table. sinc(x) where 0.0<=x<1.0 corresponds to sinc_table[0...SINC_RESO-1] */
-#define SINC_RESO 256
-#define SINC_AMP_BITS 12
-
-// double hamming(double x) { return 0.54 - 0.46 * cos(2 * PI * x); }
-static double blackman(double x) { return 0.42 - 0.5 * cos(2 * _PI_ * x) + 0.08 * cos(4 * _PI_ * x); }
-
-static double sinc(double x) { return (x == 0.0 ? 1.0 : sin(_PI_ * x) / (_PI_ * x)); }
-
-static double windowed_sinc(double x) { return blackman(0.5 + 0.5 * x / (LW / 2)) * sinc(x); }
 
 /* f_inp: input frequency. f_out: output frequencey, ch: number of channels */
 OPL_RateConv *OPL_RateConv_new(double f_inp, double f_out, int ch) {
-    OPL_RateConv *conv = malloc(sizeof(OPL_RateConv));
-    int i;
-
-    conv->ch = ch;
-    conv->f_ratio = f_inp / f_out;
-    conv->buf = malloc(sizeof(void *) * ch);
-    for (i = 0; i < ch; i++) {
-        conv->buf[i] = malloc(sizeof(conv->buf[0][0]) * LW);
-    }
-
-    /* create sinc_table for positive 0 <= x < LW/2 */
-    conv->sinc_table = malloc(sizeof(conv->sinc_table[0]) * SINC_RESO * LW / 2);
-    for (i = 0; i < SINC_RESO * LW / 2; i++) {
-        const double x = (double) i / SINC_RESO;
-        if (f_out < f_inp) {
-            /* for downsampling */
-            conv->sinc_table[i] = (int16_t) ((1 << SINC_AMP_BITS) * windowed_sinc(x / conv->f_ratio) / conv->f_ratio);
-        } else {
-            /* for upsampling */
-            conv->sinc_table[i] = (int16_t) ((1 << SINC_AMP_BITS) * windowed_sinc(x));
-        }
-    }
-
-    return conv;
-}
-
-static INLINE int16_t lookup_sinc_table(int16_t *table, double x) {
-    int16_t index = (int16_t) (x * SINC_RESO);
-    if (index < 0)
-        index = -index;
-    return table[min(SINC_RESO * LW / 2 - 1, index)];
+    return polyphase_create((uint32_t) f_inp, (uint32_t) f_out, ch);
 }
 
 void OPL_RateConv_reset(OPL_RateConv *conv) {
-    int i;
-    conv->timer = 0;
-    for (i = 0; i < conv->ch; i++) {
-        memset(conv->buf[i], 0, sizeof(conv->buf[i][0]) * LW);
-    }
+    polyphase_reset(conv);
 }
 
 /* put original data to this converter at f_inp. */
 void OPL_RateConv_putData(OPL_RateConv *conv, int ch, int16_t data) {
-    int16_t *buf = conv->buf[ch];
-    int i;
-    for (i = 0; i < LW - 1; i++) {
-        buf[i] = buf[i + 1];
-    }
-    buf[LW - 1] = data;
+    polyphase_put(conv, ch, data);
 }
 
 /* get resampled data from this converter at f_out. */
 /* this function must be called f_out / f_inp times per one putData call. */
 int16_t OPL_RateConv_getData(OPL_RateConv *conv, int ch) {
-    int16_t *buf = conv->buf[ch];
-    int32_t sum = 0;
-    int k;
-    double dn;
-    conv->timer += conv->f_ratio;
-    dn = conv->timer - floor(conv->timer);
-    conv->timer = dn;
-
-    for (k = 0; k < LW; k++) {
-        double x = ((double) k - (LW / 2 - 1)) - dn;
-        sum += buf[k] * lookup_sinc_table(conv->sinc_table, x);
-    }
-    return sum >> SINC_AMP_BITS;
+    polyphase_advance(conv);
+    return polyphase_get(conv, ch);
 }
 
 void OPL_RateConv_delete(OPL_RateConv *conv) {
-    int i;
-    for (i = 0; i < conv->ch; i++) {
-        free(conv->buf[i]);
-    }
-    free(conv->buf);
-    free(conv->sinc_table);
-    free(conv);
+    polyphase_delete(conv);
 }
 
 #endif
@@ -773,6 +701,7 @@ static INLINE void update_ampm(OPL *opl) {
     opl->lfo_am = am_table[opl->am_phase_index] >> (opl->am_mode ? 0 : 2);
 #endif
 }
+
 static void update_noise(OPL *opl, int cycle) {
 #if !EMU8950_SIMPLER_NOISE
     int i;
@@ -784,7 +713,9 @@ static void update_noise(OPL *opl, int cycle) {
     }
 #endif
 }
+#endif
 
+#if !EMU8950_NO_PERCUSSION_MODE
 static int noise_bit(OPL *opl) {
 #if !EMU8950_SIMPLER_NOISE
     return opl->noise & 1;
@@ -814,7 +745,7 @@ static void update_short_noise(OPL *opl) {
 }
 #endif
 
-#if !EMU8950_SLOT_RENDER
+#if !EMU8950_SLOT_RENDER || !EMU8950_NO_PERCUSSION_MODE
 static INLINE void calc_phase(OPL_SLOT *slot, int32_t pm_phase, uint8_t pm_mode, uint8_t reset) {
     int8_t pm = 0;
     if (slot->patch->PM) {
@@ -825,9 +756,16 @@ static INLINE void calc_phase(OPL_SLOT *slot, int32_t pm_phase, uint8_t pm_mode,
     if (reset) {
         slot->pg_phase = 0;
     }
+#if EMU8950_SLOT_RENDER
+    // pg_phase moves twice as fast in slot_render version (so the slot can be switched between both)
+    slot->pg_phase += (((slot->fnum & 0x3ff) + pm) * ml_table[slot->patch->ML]) << slot->blk;
+    slot->pg_phase &= (DP_WIDTH * 2 - 1);
+    slot->pg_out = slot->pg_phase >> (DP_BASE_BITS + 1);
+#else
     slot->pg_phase += (((slot->fnum & 0x3ff) + pm) * ml_table[slot->patch->ML]) << slot->blk >> 1;
     slot->pg_phase &= (DP_WIDTH - 1);
     slot->pg_out = slot->pg_phase >> DP_BASE_BITS;
+#endif
 }
 
 static INLINE uint8_t lookup_attack_step(OPL_SLOT *slot, uint32_t counter) {
@@ -952,6 +890,9 @@ static uint16_t get_wave_table(OPL_SLOT *slot, uint32_t index) {
 #else
 #if !EMU8950_SLOT_RENDER
     return slot->wav_or_table[(index >> (PG_BITS - 2))&3] | logsin_table[(index & LOGSIN_MASK2)];
+#elif !EMU8950_NO_PERCUSSION_MODE
+    // only rhythm slots get here, the rest is in slot_render.cpp
+    return wav_or_table_lookup[slot->patch->WS & 3][(index >> (PG_BITS - 2))&3] | logsin_table[(index & LOGSIN_MASK2)];
 #else
     assert(0);
     return 0;
@@ -1127,7 +1068,7 @@ static void update_output(OPL *opl) {
     // need am_phase and lfo_am
     update_ampm(opl);
 #if EMU8950_SHORT_NOISE_UPDATE_CHECK
-    if (opl->mask & (OPL_MASK_CYM | OPL_MASK_HH))
+    if ((opl->mask & (OPL_MASK_CYM | OPL_MASK_HH)) != (OPL_MASK_CYM | OPL_MASK_HH))
         update_short_noise(opl);
 #else
     update_short_noise(opl);
@@ -1647,9 +1588,11 @@ uint32_t __not_in_flash_func(slot_car_linear_alg0)(OPL *opl, OPL_SLOT *slot, uin
         nsamples = nsamples_bak;
         // todo if note ends we can stop early
         for (; s < nsamples; s++) {
+#if DUMPO
             if (hack_ch == 0 && s == 12) {
                 breako();
             }
+#endif
             eg_counter++;
             pm_phase = (pm_phase + opl->pm_dphase) & (PM_DP_WIDTH - 1);
             uint16_t mask = (1 << slot->eg_shift) - 1;
@@ -1689,9 +1632,11 @@ uint32_t __not_in_flash_func(slot_car_linear_alg0)(OPL *opl, OPL_SLOT *slot, uin
     if (slot->eg_state == SUSTAIN || slot->eg_state == RELEASE) {
         nsamples = nsamples_bak;
         for (; s < nsamples; s++) {
+#if DUMPO
             if (hack_ch == 0 && s == 12) {
                 breako();
             }
+#endif
             eg_counter++;
             pm_phase = (pm_phase + opl->pm_dphase) & (PM_DP_WIDTH - 1);
             uint16_t mask = (1 << slot->eg_shift) - 1;
@@ -1723,25 +1668,70 @@ uint32_t __not_in_flash_func(slot_car_linear_alg0)(OPL *opl, OPL_SLOT *slot, uin
 }
 #endif
 
-static_assert(EMU8950_NO_PERCUSSION_MODE, "");
+#if !EMU8950_NO_PERCUSSION_MODE
+// HH, SD, TOM and CYM share the noise generator and phase bits of each other, so unlike the other slots they
+// are stepped together sample by sample; their output is not halved nor negated (_RO), hence the -2 in buffer
+static void calc_rhythm_linear(OPL *opl, int32_t *buffer, uint32_t nsamples) {
+    uint32_t eg_counter = opl->eg_counter;
+    uint32_t pm_phase = opl->pm_phase;
+
+    for (uint32_t s = 0; s < nsamples; s++) {
+#if EMU8950_SHORT_NOISE_UPDATE_CHECK
+        if ((opl->mask & (OPL_MASK_CYM | OPL_MASK_HH)) != (OPL_MASK_CYM | OPL_MASK_HH))
+#endif
+        update_short_noise(opl);
+
+        eg_counter++;
+        pm_phase = (pm_phase + opl->pm_dphase) & (PM_DP_WIDTH - 1);
+        for (int i = SLOT_HH; i <= SLOT_CYM; i++) {
+            OPL_SLOT *slot = &opl->slot[i];
+            if (slot->update_requests) {
+                commit_slot_update(slot, opl->notesel);
+            }
+            calc_envelope(slot, eg_counter, 0);
+            calc_phase(slot, pm_phase, opl->pm_mode, 0);
+        }
+
+        int32_t out = 0;
+        if (!(opl->mask & OPL_MASK_HH)) {
+            out += calc_slot_hat(opl);
+        }
+        if (!(opl->mask & OPL_MASK_SD)) {
+            out += calc_slot_snare(opl);
+        }
+        if (!(opl->mask & OPL_MASK_TOM)) {
+            out += calc_slot_tom(opl);
+        }
+        if (!(opl->mask & OPL_MASK_CYM)) {
+            out += calc_slot_cym(opl);
+        }
+        buffer[s] -= out * 2;
+    }
+}
+#endif
+
 // this produces stereo
 void OPL_calc_buffer_linear(OPL *opl, int32_t *buffer, uint32_t nsamples) {
     int i;
+    // in rhythm mode ch 7 and 8 are rendered by calc_rhythm_linear
+    int melodic_slots = opl_perc_mode(opl) ? SLOT_HH : 18;
 #if EMU8950_SLOT_RENDER
     // kind of a nit pick, but so cheap - saves a bug every 24 hours due to an optimization
     // (we require that incrementing eg_counter is never zero during the rendering loop)
     opl->eg_counter = (opl->eg_counter & 0x3fffffffu) | 0x80000000u;
-    static uint8_t lfo_am_buffer_lsl3[SAMPLE_BUF_SIZE];
-    assert(nsamples <= sizeof(lfo_am_buffer_lsl3));
+    uint8_t *lfo_am_buffer_lsl3 = opl->lfo_am_work;
+    assert(nsamples <= sizeof(opl->lfo_am_work));
     opl->lfo_am_buffer_lsl3 = lfo_am_buffer_lsl3;
 #else
-    static uint8_t lfo_am_buffer[SAMPLE_BUF_SIZE];
-    assert(nsamples <= sizeof(lfo_am_buffer));
+    uint8_t *lfo_am_buffer = opl->lfo_am_work;
+    assert(nsamples <= sizeof(opl->lfo_am_work));
     opl->lfo_am_buffer = lfo_am_buffer;
 #endif
-    static int16_t mod_buffer[SAMPLE_BUF_SIZE];
+#if !EMU8950_NO_PERCUSSION_MODE
+    int32_t *bd_buffer = opl->bd_work;
+#endif
 
-    opl->mod_buffer = mod_buffer;
+    opl->mod_buffer = opl->mod_work;
     opl->buffer = buffer;
 
     // todo achievable by memcpy
@@ -1761,7 +1751,7 @@ void OPL_calc_buffer_linear(OPL *opl, int32_t *buffer, uint32_t nsamples) {
         buffer[s]=0;
     }
 
-    for (i = 0; i < 18; i++) {
+    for (i = 0; i < melodic_slots; i++) {
         OPL_SLOT *slot = &opl->slot[i];
         int ch = i >> 1;
 #if DUMPO
@@ -1780,7 +1770,10 @@ void OPL_calc_buffer_linear(OPL *opl, int32_t *buffer, uint32_t nsamples) {
 #endif
         if (!(i & 1)) {
             // ---- MOD SLOT ----
-            if ((slot+1)->eg_out >= EG_MUTE && (slot+1)->eg_state != ATTACK && !opl->ch_alg[ch]) {
+            // skipped only once the modulator is silent too, its envelope would stop mid-release otherwise
+            // and the next key on would attack from there (the per sample renderer keeps releasing it)
+            if ((slot+1)->eg_out >= EG_MUTE && (slot+1)->eg_state != ATTACK && !opl->ch_alg[ch] &&
+                slot->eg_out >= EG_MUTE && slot->eg_state != ATTACK) {
 #if DUMPO
                 memset(slot_output[i], 0, nsamples*2);
                 memset(slot_output[i+1], 0, nsamples*2);
@@ -1809,7 +1802,13 @@ void OPL_calc_buffer_linear(OPL *opl, int32_t *buffer, uint32_t nsamples) {
             memcpy(slot_output[i], opl->mod_buffer, nsamples * 2);
 #endif
         } else {
-#if EMU8950_LINEAR_SKIP
+#if !EMU8950_NO_PERCUSSION_MODE
+            if (ch == 6 && opl_perc_mode(opl)) {
+                // BD is rendered aside, as it is not halved nor negated like the rest
+                memset(bd_buffer, 0, nsamples * 4);
+                opl->buffer = bd_buffer;
+            }
+#endif
 #if EMU8950_SLOT_RENDER
             slot->buffer = opl->buffer;
 #endif
@@ -1843,13 +1842,41 @@ void OPL_calc_buffer_linear(OPL *opl, int32_t *buffer, uint32_t nsamples) {
                 opl->buffer[s] += opl_buffer_bak[s];
             }
 #endif
+#if !EMU8950_NO_PERCUSSION_MODE
+            if (opl->buffer != buffer) {
+                opl->buffer = buffer;
+                if (!(opl->mask & OPL_MASK_BD)) {
+                    for (uint32_t s = 0; s < nsamples; s++) {
+                        buffer[s] -= bd_buffer[s] * 2;
+                    }
+                }
+            }
 #endif
         }
     }
+#if !EMU8950_NO_PERCUSSION_MODE
+    if (opl_perc_mode(opl)) {
+        calc_rhythm_linear(opl, buffer, nsamples);
+    }
+#endif
     opl->pm_phase = (opl->pm_phase + opl->pm_dphase * nsamples) & (PM_DP_WIDTH - 1);
     opl->eg_counter += nsamples;
 
 }
+
+// mono counterpart of OPL_calc_buffer_stereo (same output as the per sample OPL_calc_buffer)
+void OPL_calc_buffer(OPL *opl, int16_t *buffer, uint32_t nsamples) {
+    int32_t *linear_buffer = opl->linear_work;
+    while (nsamples) {
+        uint32_t n = min(nsamples, SAMPLE_BUF_SIZE);
+        OPL_calc_buffer_linear(opl, linear_buffer, n);
+        for (uint32_t s = 0; s < n; s++) {
+            buffer[s] = _MO(linear_buffer[s]);
+        }
+        buffer += n;
+        nsamples -= n;
+    }
+}
 #endif
 
 void OPL_calc_buffer_stereo(OPL *opl, int32_t *buffer, uint32_t nsamples) {
@@ -3,6 +3,9 @@
 
 #include <stdint.h>
 #include "slot_render.h"
+#if !EMU8950_NO_RATECONV
+#include "polyphase.h"
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -20,15 +23,12 @@ extern "C" {
 #define OPL_MASK_ADPCM (1 << 14)
 #define OPL_MASK_RHYTHM (OPL_MASK_HH | OPL_MASK_CYM | OPL_MASK_TOM | OPL_MASK_SD | OPL_MASK_BD)
 
+/* samples rendered per pass of the linear renderer (size of the per chip work buffers) */
+#define SAMPLE_BUF_SIZE 1024
+
 #if !EMU8950_NO_RATECONV
-/* rate conveter */
-typedef struct __OPL_RateConv {
-  int ch;
-  double timer;
-  double f_ratio;
-  int16_t *sinc_table;
-  int16_t **buf;
-} OPL_RateConv;
+/* rate conveter (integer polyphase FIR, see polyphase.h) */
+typedef polyphase_t OPL_RateConv;
 
 OPL_RateConv *OPL_RateConv_new(double f_inp, double f_out, int ch);
 void OPL_RateConv_reset(OPL_RateConv *conv);
@@ -145,6 +145,15 @@ typedef struct __OPL {
 #endif
   uint8_t status;
 
+#if EMU8950_LINEAR
+  /* work buffers of the linear renderer, kept per chip so that several chips can render at once (e.g. on both cores) */
+  uint8_t lfo_am_work[SAMPLE_BUF_SIZE];
+  int16_t mod_work[SAMPLE_BUF_SIZE];
+#if !EMU8950_NO_PERCUSSION_MODE
+  int32_t bd_work[SAMPLE_BUF_SIZE];
+#endif
+  int32_t linear_work[SAMPLE_BUF_SIZE];
+#endif
 } OPL;
 
 #if !EMU8950_NO_TEST_FLAG
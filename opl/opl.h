@@ -37,16 +37,24 @@ typedef enum
 
 #define OPL_SECOND ((uint64_t) 1000 * 1000)
 
+// Chip clock and its native sample rate (one output every 72 clocks, ~49716 Hz)
+
+#define OPL_PICO_CLOCK 3579552
+#define OPL_PICO_RATE (OPL_PICO_CLOCK / 72)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// One emulated chip with its timers, so that several can run at once (e.g. one per core)
+
+typedef struct opl_pico opl_pico_t;
 
-int OPL_Pico_Init(unsigned int);
-unsigned int OPL_Pico_PortRead(opl_port_t);
-void OPL_Pico_WriteRegister(unsigned int, unsigned int);
-void OPL_Pico_simple(int16_t*, uint32_t);
-void OPL_Pico_delete(void);
+opl_pico_t *OPL_Pico_Init(unsigned int);
+unsigned int OPL_Pico_PortRead(opl_pico_t*, opl_port_t);
+void OPL_Pico_WriteRegister(opl_pico_t*, unsigned int, unsigned int);
+void OPL_Pico_simple(opl_pico_t*, int16_t*, uint32_t);
+void OPL_Pico_delete(opl_pico_t*);
 
 #ifdef __cplusplus
 } // extern "C"
@@ -20,6 +20,7 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
@@ -50,26 +51,49 @@ typedef struct
 } opl_timer_t;
 
 #define opl_op3mode 0
-static OPL *emu8950_opl;
 
-static opl_timer_t timer1 = { 12500, 0, 0, 0 };
-static opl_timer_t timer2 = { 3125, 0, 0, 0 };
+struct opl_pico
+{
+    OPL *emu8950_opl;
+
+    opl_timer_t timer1;
+    opl_timer_t timer2;
+};
 
-void OPL_Pico_simple(int16_t *buffer, uint32_t nsamples) {
-    OPL_calc_buffer(emu8950_opl, buffer, nsamples);
+void OPL_Pico_simple(opl_pico_t *opl, int16_t *buffer, uint32_t nsamples) {
+    OPL_calc_buffer(opl->emu8950_opl, buffer, nsamples);
 }
 
-int OPL_Pico_Init(unsigned int port_base)
+opl_pico_t *OPL_Pico_Init(unsigned int port_base)
 {
-    emu8950_opl = OPL_new(3579552, 48000); // todo check rate
-    return 1;
+    opl_pico_t *opl = calloc(1, sizeof(opl_pico_t));
+    if (opl == NULL)
+    {
+        return NULL;
+    }
+
+    opl->emu8950_opl = OPL_new(OPL_PICO_CLOCK, OPL_PICO_RATE); // Native rate (no internal converter), resampled by device
+    if (opl->emu8950_opl == NULL)
+    {
+        free(opl);
+        return NULL;
+    }
+
+    opl->timer1.rate = 12500;
+    opl->timer2.rate = 3125;
+    return opl;
 }
 
-void OPL_Pico_delete(void) {
-    OPL_delete(emu8950_opl);
+void OPL_Pico_delete(opl_pico_t *opl) {
+    if (opl == NULL) {
+        return;
+    }
+
+    OPL_delete(opl->emu8950_opl);
+    free(opl);
 }
 
-unsigned int OPL_Pico_PortRead(opl_port_t port)
+unsigned int OPL_Pico_PortRead(opl_pico_t *opl, opl_port_t port)
 {
     // OPL2 has 0x06 in its status register. If this is 0, it'll get detected as an OPL3...
     unsigned int result = 0x06;
@@ -83,13 +107,13 @@ unsigned int OPL_Pico_PortRead(opl_port_t port)
     __dsb();
     // Use time_us_64 as current_time gets updated coarsely as the mix callback is called
     uint64_t pico_time = time_us_64();
-    if (timer1.enabled && pico_time > timer1.expire_time)
+    if (opl->timer1.enabled && pico_time > opl->timer1.expire_time)
     {
         result |= 0x80;   // Either have expired
         result |= 0x40;   // Timer 1 has expired
     }
 
-    if (timer2.enabled && pico_time > timer2.expire_time)
+    if (opl->timer2.enabled && pico_time > opl->timer2.expire_time)
     {
         result |= 0x80;   // Either have expired
         result |= 0x20;   // Timer 2 has expired
@@ -115,45 +139,45 @@ static void OPLTimer_CalculateEndTime(opl_timer_t *timer)
     }
 }
 
-void OPL_Pico_WriteRegister(unsigned int reg_num, unsigned int value)
+void OPL_Pico_WriteRegister(opl_pico_t *opl, unsigned int reg_num, unsigned int value)
 {
     switch (reg_num)
     {
         case OPL_REG_TIMER1:
-            timer1.value = value;
-            OPLTimer_CalculateEndTime(&timer1);
+            opl->timer1.value = value;
+            OPLTimer_CalculateEndTime(&opl->timer1);
             //printf("timer1 set");
             break;
 
         case OPL_REG_TIMER2:
-            timer2.value = value;
-            OPLTimer_CalculateEndTime(&timer2);
+            opl->timer2.value = value;
+            OPLTimer_CalculateEndTime(&opl->timer2);
             break;
 
         case OPL_REG_TIMER_CTRL:
             if (value & 0x80)
             {
-                timer1.enabled = 0;
-                timer2.enabled = 0;
+                opl->timer1.enabled = 0;
+                opl->timer2.enabled = 0;
             }
             else
             {
                 if ((value & 0x40) == 0)
                 {
-                    timer1.enabled = (value & 0x01) != 0;
-                    OPLTimer_CalculateEndTime(&timer1);
+                    opl->timer1.enabled = (value & 0x01) != 0;
+                    OPLTimer_CalculateEndTime(&opl->timer1);
                 }
 
                 if ((value & 0x20) == 0)
                 {
-                    timer1.enabled = (value & 0x02) != 0;
-                    OPLTimer_CalculateEndTime(&timer2);
+                    opl->timer1.enabled = (value & 0x02) != 0;
+                    OPLTimer_CalculateEndTime(&opl->timer2);
                 }
             }
 
             break;
         default:
-            OPL_writeReg(emu8950_opl, reg_num, value);
+            OPL_writeReg(opl->emu8950_opl, reg_num, value);
             break;
     }
 }
@@ -12,16 +12,28 @@
 #include "pico/stdlib.h"
 #include "pico/audio_i2s.h"
 #include "device.h"
+#include "resampler.h"
 #include "hardware/clocks.h"
 
 // Time stored for software debounce
 volatile absolute_time_t last_change_press;
 
-#define NUM_DEVICES 7
+#define NUM_DEVICES (8 + OPL3_DEVICE)
 Device *devices[NUM_DEVICES];
 int8_t current_device = 5;
 int8_t wanted_device = 5;
 
+// Output rates selectable over the serial console by keys '1', '2' and '3'
+static const uint32_t output_rates[] = { 44100, 48000, 96000 };
+uint32_t wanted_output_rate = OUTPUT_RATE;
+
+// The only rate conversion - from native rate of the current device to the output rate
+static resampler_t output_resampler;
+
+// Buffers taken out of the pool by change_output_rate, filled before any other is taken
+static audio_buffer_t *drained_buffers[NUM_BUFFERS];
+static uint32_t drained_count = 0;
+
 bool load_device_list() {
     devices[0] = create_covox();
     devices[1] = create_stereo();
@@ -30,6 +42,10 @@ bool load_device_list() {
     devices[4] = create_opl2();
     devices[5] = create_tandy();
     devices[6] = create_cms();
+    devices[7] = create_dual_opl2();
+#if OPL3_DEVICE
+    devices[8] = create_opl3();
+#endif
 
     for (int i = 0; i < NUM_DEVICES; i++) {
         if (devices[i] == NULL) {
@@ -51,7 +67,7 @@ void request_change_device(uint gpio, uint32_t events) {
 }
 
 audio_format_t requested_format = {
-    .sample_freq = SAMPLE_RATE,
+    .sample_freq = OUTPUT_RATE,
     .channel_count = CHANNEL_COUNT,
     .format = AUDIO_BUFFER_FORMAT_PCM_S16
 };
@@ -90,6 +106,31 @@ audio_buffer_pool_t *load_audio(void) {
     return buffer_pool;
 }
 
+void poll_output_rate(void) {
+    int key = getchar_timeout_us(0);
+    if (key >= '1' && key < '1' + (int) (sizeof(output_rates) / sizeof(output_rates[0]))) {
+        wanted_output_rate = output_rates[key - '1'];
+    }
+}
+
+// audio_i2s retunes to requested_format when it takes the next buffer, whatever rate that buffer was rendered at.
+// So all buffers queued at the old rate are played first (every one is back in the pool once the last is playing),
+// only then the rate changes and the resampler renders the buffers after the switch for it.
+void change_output_rate(audio_buffer_pool_t *buffer_pool) {
+    while (drained_count < NUM_BUFFERS) {
+        audio_buffer_t *buffer = take_audio_buffer(buffer_pool, false);
+        if (buffer != NULL) {
+            drained_buffers[drained_count++] = buffer;
+        } else {
+            tight_loop_contents();
+        }
+    }
+
+    requested_format.sample_freq = wanted_output_rate;
+    resampler_configure(&output_resampler, devices[current_device], wanted_output_rate);
+    printf("Output rate %u Hz\n", (unsigned) wanted_output_rate);
+}
+
 void load_change_device_irq(void) {
     gpio_init(CHANGE_BUTTON_PIN);
     gpio_set_dir(CHANGE_BUTTON_PIN, GPIO_IN);
@@ -116,6 +157,7 @@ bool change_device(void) {
         return false;
     }
     printf("Switched to %d", current_device);
+    resampler_configure(&output_resampler, devices[current_device], requested_format.sample_freq);
     return true;
 }
 
@@ -129,38 +171,40 @@ int main()
         return 1;
     }
 
-    if (!devices[current_device]->load_device(devices[current_device])) {
+    // Audio goes first, so its fixed DMA channel is claimed before devices take any free one
+    audio_buffer_pool_t *buffer_pool = load_audio();
+    if (buffer_pool == NULL) {
         return 1;
     }
 
-    audio_buffer_pool_t *buffer_pool = load_audio();
-    if (buffer_pool == NULL) {
+    if (!devices[current_device]->load_device(devices[current_device])) {
         return 1;
     }
+    resampler_configure(&output_resampler, devices[current_device], requested_format.sample_freq);
 
     load_change_device_irq();
     
-    int16_t left_sample = 0;
-    int16_t right_sample = 0;
     audio_buffer_t *buffer = NULL;
 
     while(true) {
         if (current_device != wanted_device) {
             change_device();
         }
-        while ((buffer = take_audio_buffer(buffer_pool, false)) == NULL) {
-            tight_loop_contents();
+        poll_output_rate();
+        if (requested_format.sample_freq != wanted_output_rate) {
+            change_output_rate(buffer_pool);
+        }
+        if (drained_count > 0) {
+            buffer = drained_buffers[--drained_count];
+        } else {
+            while ((buffer = take_audio_buffer(buffer_pool, false)) == NULL) {
+                tight_loop_contents();
+            }
         }
 
         int16_t *samples = (int16_t *)buffer->buffer->bytes;
 
-        for (uint i = 0; i < buffer->max_sample_count; i++) {
-            devices[current_device]->generate_sample(devices[current_device], &left_sample, &right_sample);
-            samples[2 * i]     = left_sample;
-            samples[2 * i + 1] = right_sample;
-        }
-
-        buffer->sample_count = buffer->max_sample_count;
+        buffer->sample_count = resampler_generate(&output_resampler, devices[current_device], samples, buffer->max_sample_count);
         give_audio_buffer(buffer_pool, buffer);
     }
     
@@ -0,0 +1,124 @@
+#include "polyphase.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define POLYPHASE_PI 3.14159265358979323846
+
+// Phase is selected by the top bits of the 32-bit position
+#define POLYPHASE_PHASE_SHIFT (32 - __builtin_ctz(POLYPHASE_PHASES))
+
+static double blackman(double x) {
+    return 0.42 - 0.5 * cos(2 * POLYPHASE_PI * x) + 0.08 * cos(4 * POLYPHASE_PI * x);
+}
+
+static double sinc(double x) {
+    return (x == 0.0) ? 1.0 : sin(POLYPHASE_PI * x) / (POLYPHASE_PI * x);
+}
+
+// Window over the whole span of taps, sinc stretched by scale (upsampling is the filter emu8950 used)
+static double windowed_sinc(double x, int taps, double scale) {
+    return blackman(0.5 + 0.5 * x / (taps / 2)) * sinc(x / scale) / scale;
+}
+
+// Cutoff at the lower of both Nyquist frequencies
+static void compute_coefficients(int16_t *coefficients, int taps, double scale) {
+    for (int phase = 0; phase < POLYPHASE_PHASES; phase++) {
+        double fraction = (double) phase / POLYPHASE_PHASES;
+        for (int tap = 0; tap < taps; tap++) {
+            double x = (tap - (taps / 2 - 1)) - fraction;
+            coefficients[phase * taps + tap] = (int16_t) lround((1 << POLYPHASE_AMP_BITS) * windowed_sinc(x, taps, scale));
+        }
+    }
+}
+
+polyphase_t *polyphase_create(uint32_t input_rate, uint32_t output_rate, uint8_t channels) {
+    if (channels == 0 || input_rate == 0 || output_rate == 0) {
+        return NULL;
+    }
+
+    polyphase_t *polyphase = calloc(1, sizeof(polyphase_t));
+    if (polyphase == NULL) {
+        return NULL;
+    }
+
+    double ratio = (double) input_rate / output_rate;
+    double scale = (ratio > 1.0) ? ratio : 1.0;
+    int taps = (ratio > 1.0) ? POLYPHASE_TAPS * ((int) scale + 1) : POLYPHASE_TAPS;
+    polyphase->taps = (taps < POLYPHASE_MAX_TAPS) ? taps : POLYPHASE_MAX_TAPS;
+
+    polyphase->coefficients = malloc(sizeof(int16_t) * POLYPHASE_PHASES * polyphase->taps);
+    polyphase->history = malloc(sizeof(int16_t) * channels * 2 * polyphase->taps);
+    polyphase->positions = malloc(channels);
+    if (polyphase->coefficients == NULL || polyphase->history == NULL || polyphase->positions == NULL) {
+        polyphase_delete(polyphase);
+        return NULL;
+    }
+
+    polyphase->channels = channels;
+    polyphase_set_step(polyphase, (((uint64_t) input_rate) << 32) / output_rate);
+
+    compute_coefficients(polyphase->coefficients, polyphase->taps, scale);
+    polyphase_reset(polyphase);
+    return polyphase;
+}
+
+void polyphase_delete(polyphase_t *polyphase) {
+    if (polyphase == NULL) {
+        return;
+    }
+
+    free(polyphase->coefficients);
+    free(polyphase->history);
+    free(polyphase->positions);
+    free(polyphase);
+}
+
+void polyphase_reset(polyphase_t *polyphase) {
+    polyphase->phase = 0;
+    memset(polyphase->history, 0, sizeof(int16_t) * polyphase->channels * 2 * polyphase->taps);
+    memset(polyphase->positions, 0, polyphase->channels);
+}
+
+void polyphase_set_step(polyphase_t *polyphase, uint64_t step) {
+    polyphase->step_whole = step >> 32;
+    polyphase->step_fraction = (uint32_t) step;
+}
+
+void polyphase_put(polyphase_t *polyphase, uint8_t channel, int16_t sample) {
+    uint8_t taps = polyphase->taps;
+    int16_t *history = polyphase->history + channel * 2 * taps;
+    uint8_t position = polyphase->positions[channel];
+
+    // Written twice, so the window starting at any position never wraps
+    history[position] = sample;
+    history[position + taps] = sample;
+    polyphase->positions[channel] = (position + 1 == taps) ? 0 : position + 1;
+}
+
+uint32_t polyphase_advance(polyphase_t *polyphase) {
+    uint32_t previous = polyphase->phase;
+    polyphase->phase += polyphase->step_fraction;
+    return polyphase->step_whole + (polyphase->phase < previous); // Carry of the fraction
+}
+
+int16_t polyphase_get(polyphase_t *polyphase, uint8_t channel) {
+    uint8_t taps = polyphase->taps;
+    const int16_t *window = polyphase->history + channel * 2 * taps + polyphase->positions[channel];
+    const int16_t *coefficients = polyphase->coefficients + (polyphase->phase >> POLYPHASE_PHASE_SHIFT) * taps;
+
+    int32_t sum = 0;
+    for (int tap = 0; tap < taps; tap++) {
+        sum += window[tap] * coefficients[tap];
+    }
+
+    sum >>= POLYPHASE_AMP_BITS;
+    if (sum > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (sum < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t) sum;
+}
@@ -0,0 +1,93 @@
+#ifndef POLYPHASE_H
+#define POLYPHASE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Length of the windowed sinc when upsampling, downsampling takes this many more for each whole input sample per
+// output sample (the stretched sinc keeps enough lobes for the stopband), up to the maximum
+#define POLYPHASE_TAPS 16
+#define POLYPHASE_MAX_TAPS 64
+
+// Number of precomputed fractional positions between two input samples (must be power of 2)
+#define POLYPHASE_PHASES 256
+
+// Coefficients are stored in Q1.14
+#define POLYPHASE_AMP_BITS 14
+
+/**
+ * @brief Integer polyphase FIR resampler (windowed sinc) with any number of channels.
+ *
+ * Coefficients of every phase are computed once when created, output position is a 32-bit fraction
+ * (top bits select the phase) and history of each channel is kept twice in a row, so the newest
+ * taps samples are always contiguous without any shifting. The window always spans all taps, when downsampling
+ * only the sinc is stretched (cutoff at the output Nyquist frequency). No floating point is used after create.
+ * It is used by emu8950 (OPL_RateConv) as well as a generic resampler of devices (see resampler.h).
+ */
+typedef struct {
+    uint8_t channels;
+    uint8_t taps;
+
+    // Input samples per output sample (whole part and 32-bit fraction)
+    uint32_t step_whole;
+    uint32_t step_fraction;
+    uint32_t phase;
+
+    int16_t *coefficients;  // POLYPHASE_PHASES rows of taps
+    int16_t *history;       // channels * 2 * taps
+    uint8_t *positions;     // Oldest sample of each channel
+} polyphase_t;
+
+/**
+ * @brief Creates a new resampler.
+ *
+ * @param input_rate is the rate of samples put into the resampler (Hz).
+ * @param output_rate is the rate of samples taken from the resampler (Hz).
+ * @param channels is number of independent channels.
+ *
+ * @return pointer to the new resampler, NULL if allocation failed.
+ */
+polyphase_t *polyphase_create(uint32_t input_rate, uint32_t output_rate, uint8_t channels);
+
+/**
+ * @brief Frees the resampler.
+ *
+ * @param polyphase is the resampler to be freed (may be NULL).
+ */
+void polyphase_delete(polyphase_t *polyphase);
+
+/**
+ * @brief Clears the history (silence) and output position.
+ */
+void polyphase_reset(polyphase_t *polyphase);
+
+/**
+ * @brief Sets input samples per output sample (32.32 fixed point), coefficients are kept (fine rate control).
+ */
+void polyphase_set_step(polyphase_t *polyphase, uint64_t step);
+
+/**
+ * @brief Puts the newest input sample of a channel.
+ *
+ * @param channel is the channel of the sample.
+ * @param sample is the input sample.
+ */
+void polyphase_put(polyphase_t *polyphase, uint8_t channel, int16_t sample);
+
+/**
+ * @brief Moves the output position by one output sample.
+ *
+ * @return number of input samples (per channel) to be put before the next polyphase_get.
+ */
+uint32_t polyphase_advance(polyphase_t *polyphase);
+
+/**
+ * @brief Computes output sample of a channel at the current output position.
+ *
+ * @param channel is the channel of the sample.
+ *
+ * @return the output sample (saturated).
+ */
+int16_t polyphase_get(polyphase_t *polyphase, uint8_t channel);
+
+#endif // POLYPHASE_H
@@ -0,0 +1,134 @@
+#include "resampler.h"
+
+static void set_step(resampler_t *resampler, uint64_t step) {
+    resampler->step = (uint32_t) (step >> (32 - RESAMPLER_FRACTION_BITS));
+    if (resampler->polyphase != NULL) {
+        polyphase_set_step(resampler->polyphase, step);
+    }
+}
+
+bool resampler_configure(resampler_t *resampler, Device *device, uint32_t output_rate) {
+    uint32_t input_rate = device->native_rate;
+    bool controlled = device->buffered_frames != NULL;
+    bool passed = input_rate == output_rate && !controlled;
+
+    resampler->controlled = controlled;
+    resampler->fill_target = (uint32_t) (((uint64_t) input_rate * FILL_TARGET_MS) / 1000);
+
+    if (resampler->input_rate != input_rate || resampler->output_rate != output_rate || (resampler->polyphase == NULL && !passed)) {
+        polyphase_delete(resampler->polyphase);
+        resampler->polyphase = NULL;
+        resampler->input_rate = input_rate;
+        resampler->output_rate = output_rate;
+        resampler->nominal_step = (((uint64_t) input_rate) << 32) / output_rate;
+
+        if (!passed) {
+            resampler->polyphase = polyphase_create(input_rate, output_rate, 2);
+        }
+    }
+
+    resampler_reset(resampler);
+    return resampler->polyphase != NULL || passed;
+}
+
+void resampler_reset(resampler_t *resampler) {
+    resampler->phase = 0;
+    resampler->previous = (stereo_frame_t) { 0, 0 };
+    resampler->current = (stereo_frame_t) { 0, 0 };
+    resampler->pending = 0;
+    resampler->input_count = 0;
+    resampler->input_read = 0;
+    resampler->average_error = 0;
+    resampler->integral = 0;
+    resampler->correction = 0;
+    set_step(resampler, resampler->nominal_step);
+    if (resampler->polyphase != NULL) {
+        polyphase_reset(resampler->polyphase);
+        resampler->pending = polyphase_advance(resampler->polyphase); // Output position of the first frame
+    }
+}
+
+static inline int32_t clamp(int32_t value, int32_t limit) {
+    return (value > limit) ? limit : ((value < -limit) ? -limit : value);
+}
+
+// PI controller - more frames buffered than the target means consuming faster (larger step) and the other way round
+static void control_rate(resampler_t *resampler, Device *device) {
+    uint32_t buffered = device->buffered_frames(device) + (resampler->input_count - resampler->input_read);
+    int32_t error = ((int32_t) buffered - (int32_t) resampler->fill_target) * 256;
+
+    // Producer renders in blocks and consumer takes whole buffers, so single readings jump by a block or so
+    resampler->average_error += (error - resampler->average_error) >> RESAMPLER_AVERAGE_SHIFT;
+
+    resampler->integral = clamp(resampler->integral + resampler->average_error, RESAMPLER_CORRECTION_LIMIT << RESAMPLER_KI_SHIFT);
+    resampler->correction = clamp(resampler->average_error * (1 << RESAMPLER_KP_SHIFT) + (resampler->integral >> RESAMPLER_KI_SHIFT),
+                                  RESAMPLER_CORRECTION_LIMIT);
+
+    int64_t adjustment = ((int64_t) resampler->nominal_step * resampler->correction) >> 32;
+    set_step(resampler, resampler->nominal_step + adjustment);
+}
+
+// Next frame of the device, asked for a new block when all were used (devices always give all frames asked)
+static stereo_frame_t next_input(resampler_t *resampler, Device *device, uint32_t frames_left) {
+    if (resampler->input_read == resampler->input_count) {
+        // Only about as many as the output needs, so frames are not taken from the device (and its fill level) early
+        uint32_t wanted = (uint32_t) (((uint64_t) frames_left * resampler->input_rate) / resampler->output_rate) + 1;
+        if (wanted > RESAMPLER_INPUT_FRAMES) {
+            wanted = RESAMPLER_INPUT_FRAMES;
+        }
+
+        resampler->input_count = device->generate_block(device, (int16_t *) resampler->input, wanted);
+        resampler->input_read = 0;
+    }
+    return resampler->input[resampler->input_read++];
+}
+
+static inline int16_t interpolate(int16_t previous, int16_t current, uint32_t phase) {
+    // Difference has 17 bits, so phase is taken with 15 bits to stay in 32 bits
+    int32_t difference = (int32_t) current - previous;
+    return previous + ((difference * (int32_t) (phase >> 1)) >> (RESAMPLER_FRACTION_BITS - 1));
+}
+
+static uint32_t generate_polyphase(resampler_t *resampler, Device *device, int16_t *interleaved, uint32_t frames) {
+    polyphase_t *polyphase = resampler->polyphase;
+
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        for ( ; resampler->pending > 0; resampler->pending--) {
+            stereo_frame_t input = next_input(resampler, device, frames - frame);
+            polyphase_put(polyphase, 0, input.left);
+            polyphase_put(polyphase, 1, input.right);
+        }
+
+        interleaved[2 * frame] = polyphase_get(polyphase, 0);
+        interleaved[2 * frame + 1] = polyphase_get(polyphase, 1);
+        resampler->pending = polyphase_advance(polyphase);
+    }
+    return frames;
+}
+
+static uint32_t generate_linear(resampler_t *resampler, Device *device, int16_t *interleaved, uint32_t frames) {
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        while (resampler->phase >= RESAMPLER_ONE) {
+            resampler->previous = resampler->current;
+            resampler->current = next_input(resampler, device, frames - frame);
+            resampler->phase -= RESAMPLER_ONE;
+        }
+
+        interleaved[2 * frame] = interpolate(resampler->previous.left, resampler->current.left, resampler->phase);
+        interleaved[2 * frame + 1] = interpolate(resampler->previous.right, resampler->current.right, resampler->phase);
+        resampler->phase += resampler->step;
+    }
+    return frames;
+}
+
+uint32_t resampler_generate(resampler_t *resampler, Device *device, int16_t *interleaved, uint32_t frames) {
+    if (resampler->controlled) {
+        control_rate(resampler, device);
+    } else if (resampler->input_rate == resampler->output_rate) {
+        return device->generate_block(device, interleaved, frames);
+    }
+    if (resampler->polyphase != NULL) {
+        return generate_polyphase(resampler, device, interleaved, frames);
+    }
+    return generate_linear(resampler, device, interleaved, frames);
+}
@@ -0,0 +1,92 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ringbuffer.h"
+#include "polyphase.h"
+#include "device.h"
+#include "config.h"
+
+// Fractional part of the position between two input frames (Q16.16)
+#define RESAMPLER_FRACTION_BITS 16
+#define RESAMPLER_ONE (1u << RESAMPLER_FRACTION_BITS)
+
+// Rate control - error of the fill level is averaged over about 64 calls (kept in Q8 frames), the PI controller
+// output is a correction of the ratio in 2^-32 (1 ppm is about 4295)
+#define RESAMPLER_AVERAGE_SHIFT 6
+#define RESAMPLER_KP_SHIFT 7                // 7.6 ppm per frame of error
+#define RESAMPLER_KI_SHIFT 4                // 0.004 ppm per frame of error and call
+#define RESAMPLER_CORRECTION_LIMIT (1 << 22) // 977 ppm, far below anything audible as pitch
+
+// Frames of the device taken at once (more than one output buffer needs at any native rate up to the output rate)
+#define RESAMPLER_INPUT_FRAMES 512
+
+/**
+ * @brief Fixed-point resampler from the native rate of the loaded device to the output rate.
+ *
+ * The only rate conversion of the audio path - it sits between the device and the I2S buffer pool and pulls frames
+ * from generate_block of the device only when needed, so consumer drives the rate of producer. Same rates are passed
+ * through untouched. Otherwise the windowed sinc FIR is used (see polyphase.h), with linear interpolation as a fallback
+ * when it could not be allocated - output frame lies between input frames previous and current, phase being its
+ * distance from previous.
+ *
+ * Devices rendering ahead by their own frame clock (buffered_frames) are never passed through - the fill level is
+ * read once per call and a PI controller trims the ratio, so the consumer follows the clock of the producer and the
+ * ringbuffer stays at FILL_TARGET_MS instead of sitting full.
+ */
+typedef struct {
+    uint32_t input_rate;
+    uint32_t output_rate;
+
+    uint64_t nominal_step; // 32.32
+    uint32_t step;
+    uint32_t phase;
+    stereo_frame_t previous;
+    stereo_frame_t current;
+
+    polyphase_t *polyphase;
+    uint32_t pending; // Input frames to be put into the FIR before the next output frame
+
+    // Rate control (fill level of the device)
+    bool controlled;
+    uint32_t fill_target;
+    int32_t average_error;
+    int32_t integral;
+    int32_t correction;
+
+    // Frames generated by the device and not used yet
+    stereo_frame_t input[RESAMPLER_INPUT_FRAMES];
+    uint32_t input_count;
+    uint32_t input_read;
+} resampler_t;
+
+/**
+ * @brief Sets the ratio of the resampler for the device and resets it, the FIR is kept if the rates did not change.
+ *
+ * @param resampler is the resampler to be configured (zeroed before the first use).
+ * @param device is the device generating the input frames at its native rate.
+ * @param output_rate is the rate of frames generated (Hz).
+ *
+ * @return true if the FIR (or pass through) is used, false if it could not be allocated (linear interpolation is used).
+ */
+bool resampler_configure(resampler_t *resampler, Device *device, uint32_t output_rate);
+
+/**
+ * @brief Forgets the history, frames taken from the device (silence) and the rate correction, nominal ratio is kept.
+ */
+void resampler_reset(resampler_t *resampler);
+
+/**
+ * @brief Generates frames at the output rate from frames of the device at its native rate.
+ * @note Devices give all frames asked (waiting for them if needed), so all frames wanted are generated.
+ *
+ * @param device is the device generating the input frames.
+ * @param interleaved is a pointer where generated frames are placed (left, right).
+ * @param frames is number of frames wanted.
+ *
+ * @return number of frames generated.
+ */
+uint32_t resampler_generate(resampler_t *resampler, Device *device, int16_t *interleaved, uint32_t frames);
+
+#endif // RESAMPLER_H
@@ -1,59 +1,165 @@
 #include "ringbuffer.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #define MAX_SIZE 4096
 
-static size_t head = 0;
-static size_t tail = 0;
-static size_t size = 0;
-static bool empty = true;
+ringbuffer_t *ringbuffer_create(size_t size) {
+    if (size == 0 || size > MAX_SIZE || (size & (size - 1)) != 0) { // Check for power of 2.
+        return NULL;
+    }
 
-static int16_t buffer[MAX_SIZE];
+    ringbuffer_t *ringbuffer = calloc(1, sizeof(ringbuffer_t));
+    if (ringbuffer == NULL) {
+        return NULL;
+    }
 
-bool ringbuffer_init(size_t wanted_size) {
-    if (wanted_size > MAX_SIZE || (wanted_size & (wanted_size - 1)) != 0) { // Check for power of 2.
-        return false;
+    ringbuffer->frames = calloc(size, sizeof(stereo_frame_t));
+    if (ringbuffer->frames == NULL) {
+        free(ringbuffer);
+        return NULL;
     }
 
-    head = 0;
-    tail = 0;
-    size = wanted_size;
-    return true;
+    ringbuffer->size = size;
+    atomic_init(&ringbuffer->head, 0);
+    atomic_init(&ringbuffer->tail, 0);
+    return ringbuffer;
+}
+
+void ringbuffer_delete(ringbuffer_t *ringbuffer) {
+    if (ringbuffer == NULL) {
+        return;
+    }
+
+    free(ringbuffer->frames);
+    free(ringbuffer);
+}
+
+void ringbuffer_reset(ringbuffer_t *ringbuffer) {
+    atomic_store(&ringbuffer->head, 0);
+    atomic_store(&ringbuffer->tail, 0);
 }
 
-bool ringbuffer_empty() {
-    return empty;
+size_t ringbuffer_count(ringbuffer_t *ringbuffer) {
+    size_t tail = atomic_load_explicit(&ringbuffer->tail, memory_order_acquire);
+    size_t head = atomic_load_explicit(&ringbuffer->head, memory_order_acquire);
+    return head - tail;
 }
 
-bool ringbuffer_full() {
-    return head == tail && !empty;
+size_t ringbuffer_free(ringbuffer_t *ringbuffer) {
+    return ringbuffer->size - ringbuffer_count(ringbuffer);
 }
 
-bool ringbuffer_push(int16_t pushed_data) {
-    if (ringbuffer_full()) {
+size_t ringbuffer_produced(ringbuffer_t *ringbuffer) {
+    return atomic_load_explicit(&ringbuffer->head, memory_order_acquire);
+}
+
+size_t ringbuffer_consumed(ringbuffer_t *ringbuffer) {
+    return atomic_load_explicit(&ringbuffer->tail, memory_order_acquire);
+}
+
+bool ringbuffer_empty(ringbuffer_t *ringbuffer) {
+    return ringbuffer_count(ringbuffer) == 0;
+}
+
+bool ringbuffer_full(ringbuffer_t *ringbuffer) {
+    return ringbuffer_count(ringbuffer) >= ringbuffer->size;
+}
+
+bool ringbuffer_push(ringbuffer_t *ringbuffer, stereo_frame_t pushed_frame) {
+    size_t head = atomic_load_explicit(&ringbuffer->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ringbuffer->tail, memory_order_acquire);
+
+    if (head - tail >= ringbuffer->size) {
         return false;
     }
 
-    if (empty) {
-        empty = false;
+    ringbuffer->frames[head & (ringbuffer->size - 1)] = pushed_frame;
+    atomic_store_explicit(&ringbuffer->head, head + 1, memory_order_release);
+    return true;
+}
+
+bool ringbuffer_pop(ringbuffer_t *ringbuffer, stereo_frame_t *popped_frame) {
+    size_t tail = atomic_load_explicit(&ringbuffer->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ringbuffer->head, memory_order_acquire);
+
+    if (head == tail) {
+        return false;
     }
 
-    buffer[head] = pushed_data;
-    head = (head + 1) & (size - 1);
+    *popped_frame = ringbuffer->frames[tail & (ringbuffer->size - 1)];
+    atomic_store_explicit(&ringbuffer->tail, tail + 1, memory_order_release);
     return true;
 }
 
-bool ringbuffer_pop(int16_t *popped_data) {
-    if (ringbuffer_empty()) {
-        return false;
+size_t ringbuffer_reserve(ringbuffer_t *ringbuffer, size_t wanted, stereo_frame_t **span) {
+    size_t head = atomic_load_explicit(&ringbuffer->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ringbuffer->tail, memory_order_acquire);
+
+    size_t start = head & (ringbuffer->size - 1);
+    size_t available = ringbuffer->size - (head - tail);
+    if (available > ringbuffer->size - start) { // Span must not wrap around
+        available = ringbuffer->size - start;
     }
 
-    size_t next_index = (tail + 1) & (size - 1);
+    *span = &ringbuffer->frames[start];
+    return (wanted < available) ? wanted : available;
+}
 
-    if (next_index == head) {
-        empty = true;
+void ringbuffer_commit(ringbuffer_t *ringbuffer, size_t count) {
+    size_t head = atomic_load_explicit(&ringbuffer->head, memory_order_relaxed);
+    atomic_store_explicit(&ringbuffer->head, head + count, memory_order_release);
+}
+
+size_t ringbuffer_peek(ringbuffer_t *ringbuffer, size_t wanted, const stereo_frame_t **span) {
+    size_t tail = atomic_load_explicit(&ringbuffer->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ringbuffer->head, memory_order_acquire);
+
+    size_t start = tail & (ringbuffer->size - 1);
+    size_t available = head - tail;
+    if (available > ringbuffer->size - start) { // Span must not wrap around
+        available = ringbuffer->size - start;
     }
 
-    *popped_data = buffer[tail];
-    tail = next_index;
-    return true;
-}
\ No newline at end of file
+    *span = &ringbuffer->frames[start];
+    return (wanted < available) ? wanted : available;
+}
+
+void ringbuffer_consume(ringbuffer_t *ringbuffer, size_t count) {
+    size_t tail = atomic_load_explicit(&ringbuffer->tail, memory_order_relaxed);
+    atomic_store_explicit(&ringbuffer->tail, tail + count, memory_order_release);
+}
+
+size_t ringbuffer_push_bulk(ringbuffer_t *ringbuffer, const stereo_frame_t *pushed_frames, size_t count) {
+    size_t pushed = 0;
+    stereo_frame_t *span;
+
+    // At most two spans - till the end of the buffer and from its start
+    while (pushed < count) {
+        size_t reserved = ringbuffer_reserve(ringbuffer, count - pushed, &span);
+        if (reserved == 0) {
+            break;
+        }
+        memcpy(span, pushed_frames + pushed, reserved * sizeof(stereo_frame_t));
+        pushed += reserved;
+        ringbuffer_commit(ringbuffer, reserved);
+    }
+    return pushed;
+}
+
+size_t ringbuffer_pop_bulk(ringbuffer_t *ringbuffer, stereo_frame_t *popped_frames, size_t count) {
+    size_t popped = 0;
+    const stereo_frame_t *span;
+
+    while (popped < count) {
+        size_t peeked = ringbuffer_peek(ringbuffer, count - popped, &span);
+        if (peeked == 0) {
+            break;
+        }
+        memcpy(popped_frames + popped, span, peeked * sizeof(stereo_frame_t));
+        popped += peeked;
+        ringbuffer_consume(ringbuffer, peeked);
+    }
+    return popped;
+}
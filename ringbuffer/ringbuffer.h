@@ -4,46 +4,162 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdatomic.h>
 
 /**
- * @brief Initializes ringbuffer with given size (elements not deleted, but head and tail reseted).
+ * @brief One stereo frame, stored in the same layout as interleaved samples (left, right).
+ */
+typedef struct {
+    int16_t left;
+    int16_t right;
+} stereo_frame_t;
+
+/**
+ * @brief Single-producer/single-consumer ringbuffer of stereo frames.
+ *
+ * Producer only writes head, consumer only writes tail. Both indices are free-running (wrapped by mask on access),
+ * so full and empty are told apart without any shared flag. Head is published with release after the frame is written
+ * and read with acquire by consumer (tail vice versa), so it is safe between cores as well as between IRQ and main code.
+ */
+typedef struct {
+    stereo_frame_t *frames;
+    size_t size;
+    atomic_size_t head;
+    atomic_size_t tail;
+} ringbuffer_t;
+
+/**
+ * @brief Creates a new ringbuffer.
+ *
+ * @param size Number of frames in the ringbuffer. Must be power of 2.
  *
- * @param size Size of the ringbuffer. Must be power of 2.
- * 
- * @return true if ringbuffer is loaded, false if not (wanted size too big or not power of 2).
+ * @return pointer to the new ringbuffer, NULL if allocation failed or size is not power of 2.
  */
-bool ringbuffer_init(size_t size);
+ringbuffer_t *ringbuffer_create(size_t size);
+
+/**
+ * @brief Frees the ringbuffer and its frames.
+ *
+ * @param ringbuffer is the ringbuffer to be freed (may be NULL).
+ */
+void ringbuffer_delete(ringbuffer_t *ringbuffer);
+
+/**
+ * @brief Empties the ringbuffer (frames not deleted, but head and tail reseted).
+ * @note Must not be called while producer or consumer is running.
+ *
+ * @param ringbuffer is the ringbuffer to be reseted.
+ */
+void ringbuffer_reset(ringbuffer_t *ringbuffer);
+
+/**
+ * @brief Returns number of frames ready to be popped.
+ */
+size_t ringbuffer_count(ringbuffer_t *ringbuffer);
+
+/**
+ * @brief Returns number of frames that can be pushed.
+ */
+size_t ringbuffer_free(ringbuffer_t *ringbuffer);
+
+/**
+ * @brief Returns number of frames committed since the last reset (free-running, wraps around).
+ * @note Used by producer as the position of the next frame it writes.
+ */
+size_t ringbuffer_produced(ringbuffer_t *ringbuffer);
+
+/**
+ * @brief Returns number of frames consumed since the last reset (free-running, wraps around).
+ * @note Since consumer runs in real time, it can be used as a sample clock by producer.
+ */
+size_t ringbuffer_consumed(ringbuffer_t *ringbuffer);
 
 /**
  * @brief Checks whether the ringbuffer is empty.
  *
  * @return true if ringbuffer is empty, else false.
  */
-bool ringbuffer_empty();
+bool ringbuffer_empty(ringbuffer_t *ringbuffer);
 
 /**
  * @brief Checks whether the ringbuffer is full.
  *
  * @return true if ringbuffer is full, else false.
  */
-bool ringbuffer_full();
+bool ringbuffer_full(ringbuffer_t *ringbuffer);
+
+/**
+ * @brief Pushes given frame into ringbuffer (producer side).
+ *
+ * @param pushed_frame is the stereo frame that should be pushed into ringbuffer.
+ *
+ * @return true if push was successful, false if not (ringbuffer full).
+ */
+bool ringbuffer_push(ringbuffer_t *ringbuffer, stereo_frame_t pushed_frame);
 
 /**
- * @brief Pushes given data into ringbuffer.
+ * @brief Pops oldest frame from ringbuffer (consumer side).
  *
- * @param pushed_data is int16_t data that should be pushed into ringbuffer.
- * 
- * @return true if push was successful, false if not (rinbuffer full etc.).
+ * @param popped_frame is a pointer where the popped frame is placed.
+ *
+ * @return true if pop was successful, false if not (ringbuffer empty).
  */
-bool ringbuffer_push(int16_t pushed_data);
+bool ringbuffer_pop(ringbuffer_t *ringbuffer, stereo_frame_t *popped_frame);
 
 /**
- * @brief Pops oldest data from ringbuffer.
+ * @brief Reserves contiguous free space for frames (producer side), so they can be rendered right into the ringbuffer.
+ * @note Reserved frames are not visible to consumer until ringbuffer_commit is called.
+ *
+ * @param wanted is number of frames producer wants to write.
+ * @param span is a pointer where the start of the reserved space is placed.
+ *
+ * @return number of frames that can be written to span (may be less than wanted at the end of buffer, 0 if full).
+ */
+size_t ringbuffer_reserve(ringbuffer_t *ringbuffer, size_t wanted, stereo_frame_t **span);
+
+/**
+ * @brief Publishes frames written into the space from ringbuffer_reserve (producer side).
+ *
+ * @param count is number of frames written (must not be more than reserved).
+ */
+void ringbuffer_commit(ringbuffer_t *ringbuffer, size_t count);
+
+/**
+ * @brief Gives contiguous span of the oldest frames (consumer side), so they can be read right from the ringbuffer.
+ * @note Frames stay in the ringbuffer until ringbuffer_consume is called.
+ *
+ * @param wanted is number of frames consumer wants to read.
+ * @param span is a pointer where the start of the readable frames is placed.
+ *
+ * @return number of frames readable from span (may be less than wanted at the end of buffer, 0 if empty).
+ */
+size_t ringbuffer_peek(ringbuffer_t *ringbuffer, size_t wanted, const stereo_frame_t **span);
+
+/**
+ * @brief Releases frames read from the span of ringbuffer_peek (consumer side).
+ *
+ * @param count is number of frames read (must not be more than peeked).
+ */
+void ringbuffer_consume(ringbuffer_t *ringbuffer, size_t count);
+
+/**
+ * @brief Pushes up to count frames at once (producer side).
+ *
+ * @param pushed_frames is a pointer to the frames that should be pushed.
+ * @param count is number of frames wanted to be pushed.
+ *
+ * @return number of frames really pushed (less than count if ringbuffer got full).
+ */
+size_t ringbuffer_push_bulk(ringbuffer_t *ringbuffer, const stereo_frame_t *pushed_frames, size_t count);
+
+/**
+ * @brief Pops up to count oldest frames at once (consumer side).
+ *
+ * @param popped_frames is a pointer where popped frames are placed (interleaved sample buffer can be used).
+ * @param count is number of frames wanted to be popped.
  *
- * @param popped_data is int16_t data that should be popped from ringbuffer.
- * 
- * @return true if pop was successful, false if not (rinbuffer empty etc.).
+ * @return number of frames really popped (less than count if ringbuffer got empty).
  */
-bool ringbuffer_pop(int16_t *popped_data);
+size_t ringbuffer_pop_bulk(ringbuffer_t *ringbuffer, stereo_frame_t *popped_frames, size_t count);
 
-#endif // RINGBUFFER_H
\ No newline at end of file
+#endif // RINGBUFFER_H
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifndef ASG_AUDIO_LFSR_H
+#define ASG_AUDIO_LFSR_H
+
+
+//===========================================================================
+//
+// Noise shift registers of the Tandy and SAA1099 chips
+//
+// Clocking them one step at a time costs a loop iteration per clock; these
+// helpers advance them by any number of clocks with the same result. Up to
+// LFSR_SLICE_CLOCKS clocks are done at once (the feedback taps are far
+// enough apart that all the new bits come from the current state), long
+// jumps use precomputed powers of the step matrix over GF(2).
+//
+//===========================================================================
+
+// most clocks one slice can do (limited by the distance of the taps)
+static constexpr uint32_t LFSR_SLICE_CLOCKS = 11;
+
+// from this many clocks on, the matrix jump is cheaper than the slices
+static constexpr uint32_t LFSR_JUMP_CLOCKS = 8 * LFSR_SLICE_CLOCKS;
+
+//
+// matrix over GF(2) given by the images of each bit; the powers of the
+// step matrix for all the bits of a 32-bit clock count are computed at
+// compile time
+//
+template<typename _Type, int _Bits>
+struct lfsr_matrix_t
+{
+    _Type column[_Bits] = { };
+
+    constexpr _Type apply(_Type value) const
+    {
+        _Type result = 0;
+        for (int bit = 0; bit < _Bits; bit++)
+            result ^= column[bit] & (_Type(0) - _Type((value >> bit) & 1));
+        return result;
+    }
+};
+
+template<typename _Type, int _Bits>
+struct lfsr_jump_t
+{
+    lfsr_matrix_t<_Type, _Bits> power[32];
+
+    template<typename _Step>
+    constexpr lfsr_jump_t(_Step step)
+    {
+        for (int bit = 0; bit < _Bits; bit++)
+            power[0].column[bit] = step(_Type(_Type(1) << bit));
+        for (int index = 1; index < 32; index++)
+            for (int bit = 0; bit < _Bits; bit++)
+                power[index].column[bit] = power[index - 1].apply(power[index - 1].column[bit]);
+    }
+
+    constexpr _Type advance(_Type value, uint32_t clocks) const
+    {
+        for (int index = 0; clocks != 0; index++, clocks >>= 1)
+            if ((clocks & 1) != 0)
+                value = power[index].apply(value);
+        return value;
+    }
+};
+
+
+//
+// Tandy: 15 bits shifting right; mode 1 is a proper PRNG (feedback from
+// output + bit 4 into bit 14), mode 0 just feeds back low bit into high bit
+//
+template<bool _WhiteNoise>
+static inline uint32_t tandy_lfsr_clock(uint32_t prng)
+{
+    if (_WhiteNoise)
+        return (prng >> 1) | (((prng ^ (~prng >> 4)) & 1) << 14);
+    else
+        return (prng >> 1) | ((prng & 1) << 14);
+}
+
+// the inverted feedback makes the white noise step affine; bit 15 is kept
+// at 1 to carry the constant, so it is linear on 16 bits
+static constexpr lfsr_jump_t<uint16_t, 16> s_tandy_white_jump([](uint16_t value)
+{
+    return uint16_t((value & 0x8000) | ((value & 0x7fff) >> 1) | (((value ^ (value >> 4) ^ (value >> 15)) & 1) << 14));
+});
+
+template<bool _WhiteNoise>
+static inline uint32_t tandy_lfsr_advance(uint32_t prng, uint32_t clocks)
+{
+    // mode 0 is a rotation of the 15 bits
+    if (!_WhiteNoise)
+    {
+        clocks %= 15;
+        return (prng >> clocks) | ((prng & ((1u << clocks) - 1)) << (15 - clocks));
+    }
+
+    if (clocks >= LFSR_JUMP_CLOCKS)
+        return s_tandy_white_jump.advance(uint16_t(prng | 0x8000), clocks) & 0x7fff;
+
+    // the bit entering on clock n comes from bits n - 1 and n + 3 of the current state
+    for ( ; clocks > LFSR_SLICE_CLOCKS; clocks -= LFSR_SLICE_CLOCKS)
+        prng = (prng >> LFSR_SLICE_CLOCKS) | (((prng ^ ~(prng >> 4)) & ((1u << LFSR_SLICE_CLOCKS) - 1)) << (15 - LFSR_SLICE_CLOCKS));
+    return (prng >> clocks) | (((prng ^ ~(prng >> 4)) & ((1u << clocks) - 1)) << (15 - clocks));
+}
+
+
+//
+// SAA1099: shifting left with feedback from bits 17 and 10 into bit 0; the
+// bits above 17 only keep the history, they are advanced the same way
+//
+static inline uint32_t saa1099_lfsr_clock(uint32_t prng)
+{
+    return (prng << 1) | (((prng >> 17) ^ (prng >> 10)) & 1);
+}
+
+static constexpr lfsr_jump_t<uint32_t, 32> s_saa1099_jump([](uint32_t value)
+{
+    return (value << 1) | (((value >> 17) ^ (value >> 10)) & 1);
+});
+
+static inline uint32_t saa1099_lfsr_advance(uint32_t prng, uint32_t clocks)
+{
+    if (clocks >= LFSR_JUMP_CLOCKS)
+        return s_saa1099_jump.advance(prng, clocks);
+
+    // the bit entering on clock n comes from bits 18 - n and 11 - n of the current state
+    for ( ; clocks > LFSR_SLICE_CLOCKS; clocks -= LFSR_SLICE_CLOCKS)
+        prng = (prng << LFSR_SLICE_CLOCKS) | (((prng >> (18 - LFSR_SLICE_CLOCKS)) ^ (prng >> (11 - LFSR_SLICE_CLOCKS))) & ((1u << LFSR_SLICE_CLOCKS) - 1));
+    return (prng << clocks) | (((prng >> (18 - clocks)) ^ (prng >> (11 - clocks))) & ((1u << clocks) - 1));
+}
+
+#endif
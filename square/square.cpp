@@ -40,6 +40,49 @@
 //=========================================================
 
 #include "square.h"
+#include "lfsr.h"
+
+
+//
+// helpers of the event-driven kernels: number of frames after the current
+// one before the bits above mask change (i.e. the next edge), given the
+// position after the current frame; a zero step never reaches an edge
+//
+static inline uint32_t frames_to_edge(uint32_t pos, uint32_t step, uint32_t mask)
+{
+    return (step == 0) ? UINT32_MAX : ((pos | mask) - pos) / step;
+}
+
+static inline uint32_t min_run(uint32_t run, uint32_t frames)
+{
+    return (frames < run) ? frames : run;
+}
+
+//
+// polyBLEP helpers: a hard step of given height that happened a fraction d
+// of a frame before the frame it first shows in is smoothed by two residuals,
+// one on that frame and one on the frame before it (so the band-limited
+// kernels put out each frame one frame late); fractions are Q15
+//
+static constexpr uint8_t BLEP_BITS = 15;
+static constexpr uint32_t BLEP_ONE = 1 << BLEP_BITS;
+
+static inline uint32_t blep_fraction(uint32_t since, uint32_t step)
+{
+    return uint32_t((uint64_t(since) << BLEP_BITS) / step);
+}
+
+static inline void blep_step(int32_t height, uint32_t d, int32_t &before, int32_t &after)
+{
+    uint32_t rest = BLEP_ONE - d;
+    before += (height * int32_t((d * d) >> BLEP_BITS)) >> (BLEP_BITS + 1);
+    after -= (height * int32_t((rest * rest) >> BLEP_BITS)) >> (BLEP_BITS + 1);
+}
+
+static inline int16_t clamp_sample(int32_t sample)
+{
+    return int16_t((sample > 32767) ? 32767 : (sample < -32768) ? -32768 : sample);
+}
 
 
 //===========================================================================
@@ -84,16 +127,22 @@ void speaker_generator_t::generate_frames(float *dest, uint32_t frames, float ga
     if (!m_enable)
         return;
 
-    // generate a square wave
+    // generate a square wave; the level only changes at edges, so each
+    // computed frame is followed by the frames up to the next edge
     float value = MAX_VOLUME * gain;
-    for (uint32_t frame = 0; frame < frames; frame++, dest += 2)
+    for (uint32_t frame = 0; frame < frames; )
     {
         m_pos += m_step;
+        uint32_t run = 1 + min_run(frames - frame - 1, frames_to_edge(m_pos, m_step, FRAC_HALF - 1));
         if ((m_pos & FRAC_HALF) != 0)
-        {
-            dest[0] += value;
-            dest[1] += value;
-        }
+            for (uint32_t index = 0; index < run; index++)
+            {
+                dest[2 * index + 0] += value;
+                dest[2 * index + 1] += value;
+            }
+        m_pos += (run - 1) * m_step;
+        frame += run;
+        dest += 2 * run;
     }
 }
 
@@ -157,7 +206,8 @@ void speaker_t::set_control(uint8_t data)
 tandy_generator_t::tandy_generator_t() :
     m_last_freq_chan(0),
     m_noise_control(0),
-    m_prng(PRNG_INITIAL)
+    m_prng(PRNG_INITIAL),
+    m_blep_delayed(0)
 {
 }
 
@@ -237,13 +287,32 @@ void tandy_generator_t::process_event(uint8_t data)
     }
 }
 
+#ifndef SQUARE_FLOAT_OUTPUT
+//
+// output helpers: int32_t output is mixed into the buffer, int16_t output
+// (written right into the shared ringbuffer) is stored as is
+//
+static inline void output_inverted_frame(int32_t *&dest, int32_t result)
+{
+    *dest++ -= result;
+    *dest++ -= result;
+}
+
+static inline void output_inverted_frame(int16_t *&dest, int32_t result)
+{
+    *dest++ = int16_t(-result);
+    *dest++ = int16_t(-result);
+}
+#endif
+
 //
 // generate the requested number of audio frames
 //
 #ifdef SQUARE_FLOAT_OUTPUT
 void tandy_generator_t::generate_frames(float *dest, uint32_t frames, float gain)
 #else
-void tandy_generator_t::generate_frames(int32_t *dest, uint32_t frames)
+template<typename _Type>
+void tandy_generator_t::generate_frames_internal(_Type *dest, uint32_t frames)
 #endif
 {
     // generate square wavs
@@ -289,17 +358,20 @@ void tandy_generator_t::generate_frames(int32_t *dest, uint32_t frames)
             result += m_voice[2].volume;
 #endif
 
-        // noise channel: on rising edge, clock the PRNG
+        // noise channel: on rising edge, clock the PRNG (all the clocks of the frame at once)
         m_voice[3].pos += m_voice[3].step;
-        for ( ; m_voice[3].pos >= FRAC_ONE; m_voice[3].pos -= FRAC_ONE)
+        if (m_voice[3].pos >= FRAC_ONE)
         {
+            uint32_t clocks = m_voice[3].pos >> FRAC_BITS;
+            m_voice[3].pos &= FRAC_ONE - 1;
+
             // mode 0 just feeds back low bit into high bit
             if ((m_noise_control & 4) == 0)
-                m_prng = (m_prng >> 1) | ((m_prng & 1) << 14);
+                m_prng = uint16_t(tandy_lfsr_advance<false>(m_prng, clocks));
 
             // mode 1 is a proper PRNG; feedback from output + bit 4 into bit 14
             else
-                m_prng = (m_prng >> 1) | (((m_prng ^ (~m_prng >> 4)) & 1) << 14);
+                m_prng = uint16_t(tandy_lfsr_advance<true>(m_prng, clocks));
         }
 
         // PRNG output bit controls the noise contribution
@@ -311,10 +383,181 @@ void tandy_generator_t::generate_frames(int32_t *dest, uint32_t frames)
 #endif
 
         // output stereo; note that output is inverted
+#ifdef SQUARE_FLOAT_OUTPUT
         *dest++ -= result;
         *dest++ -= result;
+#else
+        output_inverted_frame(dest, result);
+#endif
+    }
+}
+
+#ifndef SQUARE_FLOAT_OUTPUT
+void tandy_generator_t::generate_frames(int32_t *dest, uint32_t frames)
+{
+    this->generate_frames_internal(dest, frames);
+}
+
+void tandy_generator_t::generate_frames(int16_t *dest, uint32_t frames)
+{
+    this->generate_frames_internal(dest, frames);
+}
+
+//
+// block kernel: same output as generate_frames (one channel of it), with the
+// state kept in locals, voices added through masks instead of branches and
+// the noise mode resolved once per block instead of on every PRNG clock;
+// output only changes at edges of the voices and PRNG clocks, so after each
+// computed frame the following frames up to the next edge are filled in bulk
+//
+template<bool _WhiteNoise>
+void tandy_generator_t::generate_mono_internal(int16_t *dest, uint32_t frames)
+{
+    uint32_t pos0 = m_voice[0].pos, step0 = m_voice[0].step;
+    uint32_t pos1 = m_voice[1].pos, step1 = m_voice[1].step;
+    uint32_t pos2 = m_voice[2].pos, step2 = m_voice[2].step;
+    uint32_t pos3 = m_voice[3].pos, step3 = m_voice[3].step;
+    int32_t volume0 = m_voice[0].volume;
+    int32_t volume1 = m_voice[1].volume;
+    int32_t volume2 = m_voice[2].volume;
+    int32_t volume3 = m_voice[3].volume;
+    uint32_t prng = m_prng;
+
+    // silent voices never end a run (their positions still advance exactly)
+    uint32_t edge_step0 = (volume0 != 0) ? step0 : 0;
+    uint32_t edge_step1 = (volume1 != 0) ? step1 : 0;
+    uint32_t edge_step2 = (volume2 != 0) ? step2 : 0;
+    uint32_t edge_step3 = (volume3 != 0) ? step3 : 0;
+
+    for (uint32_t frame = 0; frame < frames; )
+    {
+        // square voices: the half bit of the position turns into an all-ones or zero mask
+        pos0 += step0;
+        pos1 += step1;
+        pos2 += step2;
+        int32_t result = (volume0 & -int32_t((pos0 >> (FRAC_BITS - 1)) & 1))
+                       + (volume1 & -int32_t((pos1 >> (FRAC_BITS - 1)) & 1))
+                       + (volume2 & -int32_t((pos2 >> (FRAC_BITS - 1)) & 1));
+
+        // noise channel: the PRNG is clocked once per whole step crossed
+        pos3 += step3;
+        prng = tandy_lfsr_advance<_WhiteNoise>(prng, pos3 >> FRAC_BITS);
+        pos3 &= FRAC_ONE - 1;
+        result += volume3 & -int32_t(prng & 1);
+
+        // output is inverted
+        int16_t value = int16_t(-result);
+        dest[frame++] = value;
+
+        // following frames are the same until the first edge of an audible voice or the next audible PRNG clock
+        uint32_t run = frames - frame;
+        run = min_run(run, frames_to_edge(pos0, edge_step0, FRAC_HALF - 1));
+        run = min_run(run, frames_to_edge(pos1, edge_step1, FRAC_HALF - 1));
+        run = min_run(run, frames_to_edge(pos2, edge_step2, FRAC_HALF - 1));
+        run = min_run(run, frames_to_edge(pos3, edge_step3, FRAC_ONE - 1));
+        if (run == 0)
+            continue;
+
+        for (uint32_t end = frame + run; frame < end; frame++)
+            dest[frame] = value;
+
+        pos0 += run * step0;
+        pos1 += run * step1;
+        pos2 += run * step2;
+        if (volume3 != 0)
+            pos3 += run * step3;
+        else
+        {
+            // silent noise is still clocked, all at once
+            uint64_t total = pos3 + uint64_t(run) * step3;
+            prng = tandy_lfsr_advance<_WhiteNoise>(prng, uint32_t(total >> FRAC_BITS));
+            pos3 = uint32_t(total) & (FRAC_ONE - 1);
+        }
     }
+
+    m_voice[0].pos = pos0;
+    m_voice[1].pos = pos1;
+    m_voice[2].pos = pos2;
+    m_voice[3].pos = pos3;
+    m_prng = uint16_t(prng);
+}
+
+void tandy_generator_t::generate_mono(int16_t *dest, uint32_t frames)
+{
+    if ((m_noise_control & 4) != 0)
+        this->generate_mono_internal<true>(dest, frames);
+    else
+        this->generate_mono_internal<false>(dest, frames);
+}
+
+//
+// band-limited kernel: same voices as generate_mono, but every edge of a tone
+// and every change of the noise output is smoothed by polyBLEP residuals;
+// tones above the Nyquist frequency (more than one edge per frame) only add
+// their average, as nothing of them is left after band-limiting
+//
+template<bool _WhiteNoise>
+void tandy_generator_t::generate_mono_blep_internal(int16_t *dest, uint32_t frames)
+{
+    int32_t delayed = m_blep_delayed;
+    uint32_t prng = m_prng;
+    auto &noise = m_voice[3];
+
+    for (uint32_t frame = 0; frame < frames; frame++)
+    {
+        int32_t result = 0;
+        int32_t before = 0;
+        int32_t after = 0;
+
+        // square voices
+        for (int voicenum = 0; voicenum < 3; voicenum++)
+        {
+            auto &voice = m_voice[voicenum];
+            uint32_t previous = voice.pos;
+            voice.pos += voice.step;
+            if (voice.step >= FRAC_HALF)
+            {
+                result += voice.volume >> 1;
+                continue;
+            }
+
+            int32_t level = voice.volume & -int32_t((voice.pos >> (FRAC_BITS - 1)) & 1);
+            result += level;
+            if (((voice.pos ^ previous) & FRAC_HALF) != 0 && voice.volume != 0)
+                blep_step((level != 0) ? voice.volume : -voice.volume, blep_fraction(voice.pos & (FRAC_HALF - 1), voice.step), before, after);
+        }
+
+        // noise channel: output changes only when the PRNG is clocked (the last clock of the frame is taken)
+        noise.pos += noise.step;
+        if (noise.pos >= FRAC_ONE)
+        {
+            uint32_t previous = prng & 1;
+            prng = tandy_lfsr_advance<_WhiteNoise>(prng, noise.pos >> FRAC_BITS);
+            noise.pos &= FRAC_ONE - 1;
+
+            int32_t height = int32_t(prng & 1) - int32_t(previous);
+            if (height != 0 && noise.volume != 0)
+                blep_step(height * noise.volume, blep_fraction(noise.pos, noise.step), before, after);
+        }
+        result += noise.volume & -int32_t(prng & 1);
+
+        // output is inverted, and one frame late
+        dest[frame] = clamp_sample(-(delayed + before));
+        delayed = result + after;
+    }
+
+    m_blep_delayed = delayed;
+    m_prng = uint16_t(prng);
+}
+
+void tandy_generator_t::generate_mono_blep(int16_t *dest, uint32_t frames)
+{
+    if ((m_noise_control & 4) != 0)
+        this->generate_mono_blep_internal<true>(dest, frames);
+    else
+        this->generate_mono_blep_internal<false>(dest, frames);
 }
+#endif
 
 //
 // helper to compute the output sample step from a frequency divisor
@@ -470,6 +713,58 @@ void saa1099_generator_t::process_event(uint8_t reg, uint8_t data)
     }
 }
 
+//
+// helper to compute the current envelope level (0-15) from its position
+//
+int8_t saa1099_generator_t::envelope_level(envelope_t &env)
+{
+    int8_t factor = env.hold;
+
+    // if envelope is still going, get the value
+    if (factor < 0)
+    {
+        // bit 4 is number of bits for envelope control (3 vs 4); before the
+        // first step it is still step 0, not past the end (block_begin reads
+        // it there, the per-frame loop only after a step)
+        uint32_t pos = env.pos >> FRAC_BITS;
+        if (pos != 0)
+            pos -= (env.type >> 4) & 1;
+
+        // bits 1-3 are the type:
+        //   0: hold 0
+        //   1: hold 15
+        //   2: decay 15->0 then hold 0
+        //   3: decay 15->0 repeatedly
+        //   4: triangle 0->15->0 then hold 0
+        //   5: triangle 0->15->0 repeatedly
+        //   6: attack 0->15 then hold 0
+        //   7: attack 0->15 repeatedly
+        uint8_t type = (env.type >> 1) & 7;
+
+        // if past the hold time, clamp to 0 for the even-numbered cases
+        if (pos >= 32 && (type & 1) == 0)
+            env.hold = factor = 0;
+
+        // otherwise, process
+        else
+        {
+            static uint8_t const s_env_shapes[8][32] =
+            {
+                {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+                { 15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15, 15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15 },
+                { 15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+                { 15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 },
+                {  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15, 15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 },
+                {  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15, 15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 },
+                {  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15,  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+                {  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15,  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15 },
+            };
+            factor = s_env_shapes[type][pos & 31];
+        }
+    }
+    return factor;
+}
+
 //
 // helper to add the output of a single voice to the results; templated so
 // that codegen can be optimized for different voices' behaviors
@@ -508,8 +803,8 @@ void saa1099_generator_t::add_voice(int32_t &lresult, int32_t &rresult, int16_t
     lvolume *= outscale;
     rvolume *= outscale;
 #else
-    lvolume << outlevel;
-    rvolume << outlevel;
+    lvolume <<= outlevel;
+    rvolume <<= outlevel;
 #endif
 
     // non-envelope case
@@ -523,46 +818,7 @@ void saa1099_generator_t::add_voice(int32_t &lresult, int32_t &rresult, int16_t
     else
     {
         auto &env = m_envelope[_Voicenum / 3];
-        int8_t factor = env.hold;
-
-        // if envelope is still going, get the value
-        if (factor < 0)
-        {
-            // bit 4 is number of bits for envelope control (3 vs 4)
-            uint32_t pos = (env.pos >> FRAC_BITS) - ((env.type >> 4) & 1);
-
-            // bits 1-3 are the type:
-            //   0: hold 0
-            //   1: hold 15
-            //   2: decay 15->0 then hold 0
-            //   3: decay 15->0 repeatedly
-            //   4: triangle 0->15->0 then hold 0
-            //   5: triangle 0->15->0 repeatedly
-            //   6: attack 0->15 then hold 0
-            //   7: attack 0->15 repeatedly
-            uint8_t type = (env.type >> 1) & 7;
-
-            // if past the hold time, clamp to 0 for the even-numbered cases
-            if (pos >= 32 && (type & 1) == 0)
-                env.hold = factor = 0;
-
-            // otherwise, process
-            else
-            {
-                static uint8_t const s_env_shapes[8][32] =
-                {
-                    {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
-                    { 15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15, 15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15 },
-                    { 15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
-                    { 15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 },
-                    {  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15, 15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 },
-                    {  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15, 15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 },
-                    {  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15,  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
-                    {  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15,  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15 },
-                };
-                factor = s_env_shapes[type][pos & 31];
-            }
-        }
+        int8_t factor = this->envelope_level(env);
 
         // apply to left
 #ifdef SQUARE_FLOAT_OUTPUT
@@ -597,7 +853,6 @@ void saa1099_generator_t::generate_frames(int32_t *dest, uint32_t frames)
         return;
 
     // precompute volumes
-    float vvolume[6][2];
 #ifdef SQUARE_FLOAT_OUTPUT
     float vvolume[6][2];
     vvolume[0][0] = float(m_voice[0].lvolume) * gain * (1.0f / 32768.0f);
@@ -689,15 +944,221 @@ void saa1099_generator_t::generate_frames(int32_t *dest, uint32_t frames)
 
         // noise generator 0
         m_noise[0].pos += m_noise[0].step;
-        for ( ; m_noise[0].pos >= FRAC_ONE; m_noise[0].pos -= FRAC_ONE)
-            m_noise[0].prng = (m_noise[0].prng << 1) | (((m_noise[0].prng >> 17) ^ (m_noise[0].prng >> 10)) & 1);
+        m_noise[0].prng = saa1099_lfsr_advance(m_noise[0].prng, m_noise[0].pos >> FRAC_BITS);
+        m_noise[0].pos &= FRAC_ONE - 1;
 
         // noise generator 1
         m_noise[1].pos += m_noise[1].step;
-        for ( ; m_noise[1].pos >= FRAC_ONE; m_noise[1].pos -= FRAC_ONE)
-            m_noise[1].prng = (m_noise[1].prng << 1) | (((m_noise[1].prng >> 17) ^ (m_noise[1].prng >> 10)) & 1);
+        m_noise[1].prng = saa1099_lfsr_advance(m_noise[1].prng, m_noise[1].pos >> FRAC_BITS);
+        m_noise[1].pos &= FRAC_ONE - 1;
+    }
+}
+
+#ifndef SQUARE_FLOAT_OUTPUT
+//
+// recompute the volumes of a voice for the block kernel; the noise level and
+// the envelope only change at their clock edges, so this is all add_voice
+// does per frame except for the tone bit
+//
+void saa1099_generator_t::block_volume(block_t &block, int voicenum)
+{
+    auto &voice = m_voice[voicenum];
+    uint32_t noise = block.prng[voicenum / 3] & 1;
+
+    // level while the tone bit is high (or always, for the noise-only case)
+    int32_t level;
+    if (!voice.noise)
+        level = voice.enable;
+    else if (!voice.enable)
+        level = noise;
+    else
+        level = 1 << noise;
+
+    int32_t lvolume = int32_t(voice.lvolume) * level;
+    int32_t rvolume = int32_t(voice.rvolume) * level;
+
+    // envelope case
+    auto &env = m_envelope[voicenum / 3];
+    if (voicenum % 3 == 2 && (env.type & 0x80) != 0)
+    {
+        int8_t factor = this->envelope_level(env);
+        lvolume = lvolume * factor / 16;
+
+        // bit 0 means right is inverted
+        if ((env.type & 0x01) != 0)
+            factor ^= 15;
+        rvolume = rvolume * factor / 16;
+    }
+
+    block.lvolume[voicenum] = lvolume;
+    block.rvolume[voicenum] = rvolume;
+}
+
+//
+// copy the state out for a block
+//
+void saa1099_generator_t::block_begin(block_t &block)
+{
+    block.enable = m_enable;
+    for (int gen = 0; gen < 2; gen++)
+    {
+        block.noise_pos[gen] = m_noise[gen].pos;
+        block.noise_step[gen] = m_noise[gen].step;
+        block.prng[gen] = m_noise[gen].prng;
+        block.env_step[gen] = ((m_envelope[gen].type & 0xa0) == 0x80) ? m_voice[gen * 3 + 1].step : 0;
+    }
+    block.noise_clocked = 0;
+    for (int voicenum = 0; voicenum < 6; voicenum++)
+    {
+        block.pos[voicenum] = m_voice[voicenum].pos;
+        block.step[voicenum] = m_voice[voicenum].step;
+        block.tone_or[voicenum] = (!m_voice[voicenum].enable && m_voice[voicenum].noise) ? 1 : 0;
+        this->block_volume(block, voicenum);
+    }
+}
+
+//
+// add one frame to the results (same output as generate_frames), with
+// _Blep the tone edges get the polyBLEP residuals
+//
+template<bool _Blep>
+void saa1099_generator_t::block_frame_internal(block_t &block, int32_t &lresult, int32_t &rresult, int32_t &lbefore, int32_t &rbefore)
+{
+    // if not enabled, nothing to do
+    if (!block.enable)
+        return;
+
+    // envelopes are clocked by voices 1 and 4; only a new step changes the level
+    for (int gen = 0; gen < 2; gen++)
+    {
+        if (block.env_step[gen] != 0)
+        {
+            uint32_t step = m_envelope[gen].pos >> FRAC_BITS;
+            m_envelope[gen].pos += block.env_step[gen];
+            if ((m_envelope[gen].pos >> FRAC_BITS) != step)
+                this->block_volume(block, gen * 3 + 2);
+        }
+    }
+
+    // voices: the tone bit turns into an all-ones or zero mask
+    for (int voicenum = 0; voicenum < 6; voicenum++)
+    {
+        uint32_t previous = block.pos[voicenum];
+        block.pos[voicenum] += block.step[voicenum];
+        int32_t mask = -int32_t(((block.pos[voicenum] >> (FRAC_BITS - 1)) & 1) | block.tone_or[voicenum]);
+        lresult += block.lvolume[voicenum] & mask;
+        rresult += block.rvolume[voicenum] & mask;
+
+        // tone edge (at most one per frame below the Nyquist frequency, which is above all the SAA1099 notes from 14 kHz up)
+        if (_Blep && ((block.pos[voicenum] ^ previous) & FRAC_HALF) != 0 && block.tone_or[voicenum] == 0 &&
+            block.step[voicenum] < FRAC_HALF && (block.lvolume[voicenum] | block.rvolume[voicenum]) != 0)
+        {
+            uint32_t d = blep_fraction(block.pos[voicenum] & (FRAC_HALF - 1), block.step[voicenum]);
+            int32_t sign = (mask != 0) ? 1 : -1;
+            blep_step(sign * block.lvolume[voicenum], d, lbefore, lresult);
+            blep_step(sign * block.rvolume[voicenum], d, rbefore, rresult);
+        }
+    }
+
+    // noise generators: volumes of their voices change only when the PRNG is clocked
+    // (which is at the end of the frame, so it shows in the next one)
+    block.noise_clocked = 0;
+    for (int gen = 0; gen < 2; gen++)
+    {
+        block.noise_pos[gen] += block.noise_step[gen];
+        uint32_t clocks = block.noise_pos[gen] >> FRAC_BITS;
+        if (clocks != 0)
+        {
+            block.noise_pos[gen] &= FRAC_ONE - 1;
+            block.prng[gen] = saa1099_lfsr_advance(block.prng[gen], clocks);
+            this->block_volume(block, gen * 3 + 0);
+            this->block_volume(block, gen * 3 + 1);
+            this->block_volume(block, gen * 3 + 2);
+            block.noise_clocked |= 1 << gen;
+        }
+    }
+}
+
+void saa1099_generator_t::block_frame(block_t &block, int32_t &lresult, int32_t &rresult)
+{
+    int32_t unused = 0;
+    this->block_frame_internal<false>(block, lresult, rresult, unused, unused);
+}
+
+void saa1099_generator_t::block_frame_blep(block_t &block, int32_t &lresult, int32_t &rresult, int32_t &lbefore, int32_t &rbefore)
+{
+    this->block_frame_internal<true>(block, lresult, rresult, lbefore, rbefore);
+}
+
+//
+// limit run (frames after the one just computed) to those with the same
+// output: up to the next tone edge of an audible voice, the next clock of a
+// noise generator used by any voice (none if it was just clocked), or the
+// next step of a running envelope
+//
+uint32_t saa1099_generator_t::block_run(block_t const &block, uint32_t run) const
+{
+    if (!block.enable)
+        return run;
+
+    // cheap checks first, a dense song mostly stops here
+    for (int gen = 0; gen < 2 && run != 0; gen++)
+    {
+        if (m_voice[gen * 3 + 0].noise || m_voice[gen * 3 + 1].noise || m_voice[gen * 3 + 2].noise)
+        {
+            if ((block.noise_clocked & (1 << gen)) != 0)
+                return 0;
+            run = min_run(run, frames_to_edge(block.noise_pos[gen], block.noise_step[gen], FRAC_ONE - 1));
+        }
+        if (m_envelope[gen].hold < 0)
+            run = min_run(run, frames_to_edge(m_envelope[gen].pos, block.env_step[gen], FRAC_ONE - 1));
+    }
+
+    for (int voicenum = 0; voicenum < 6 && run != 0; voicenum++)
+        if (block.tone_or[voicenum] == 0 && (block.lvolume[voicenum] | block.rvolume[voicenum]) != 0)
+            run = min_run(run, frames_to_edge(block.pos[voicenum], block.step[voicenum], FRAC_HALF - 1));
+    return run;
+}
+
+//
+// advance over frames reported by block_run; noise generators no voice uses
+// are still clocked (all at once), their output does not matter until then
+//
+void saa1099_generator_t::block_skip(block_t &block, uint32_t frames)
+{
+    if (!block.enable)
+        return;
+
+    for (int voicenum = 0; voicenum < 6; voicenum++)
+        block.pos[voicenum] += frames * block.step[voicenum];
+
+    for (int gen = 0; gen < 2; gen++)
+    {
+        m_envelope[gen].pos += frames * block.env_step[gen];
+
+        uint64_t total = block.noise_pos[gen] + uint64_t(frames) * block.noise_step[gen];
+        block.prng[gen] = saa1099_lfsr_advance(block.prng[gen], uint32_t(total >> FRAC_BITS));
+        block.noise_pos[gen] = uint32_t(total) & (FRAC_ONE - 1);
+    }
+}
+
+//
+// copy the state back after a block
+//
+void saa1099_generator_t::block_end(block_t const &block)
+{
+    if (!block.enable)
+        return;
+
+    for (int gen = 0; gen < 2; gen++)
+    {
+        m_noise[gen].pos = block.noise_pos[gen];
+        m_noise[gen].prng = block.prng[gen];
     }
+    for (int voicenum = 0; voicenum < 6; voicenum++)
+        m_voice[voicenum].pos = block.pos[voicenum];
 }
+#endif
 
 //
 // helper to compute the output sample step from a voice's frequency and octave
@@ -733,7 +1194,8 @@ uint32_t saa1099_generator_t::noise_step(noise_t &noise, int gen)
 // constructor
 //
 cms_t::cms_t() :
-    m_register{ 0 }
+    m_register{ 0 },
+    m_blep_delayed{ 0, 0 }
 {
 }
 
@@ -770,6 +1232,99 @@ void cms_t::write_addr(uint32_t address, uint8_t data)
     m_register[address & 15] = data;
 }
 
+#ifndef SQUARE_FLOAT_OUTPUT
+// longest stretch of frames computed one by one before looking for a run again
+static constexpr uint32_t CMS_RUN_BACKOFF = 32;
+
+//
+// generate the requested number of frames of both chips in a single pass;
+// output is halved (same as the CMS device always did) and clamped; each
+// computed frame is repeated up to the next event of either chip
+//
+void cms_t::generate_frames(int16_t *dest, uint32_t frames)
+{
+    saa1099_generator_t::block_t block0, block1;
+    m_generator[0].block_begin(block0);
+    m_generator[1].block_begin(block1);
+
+    uint32_t backoff = 0;
+    uint32_t unchecked = 0;
+    for (uint32_t frame = 0; frame < frames; )
+    {
+        int32_t lresult = 0;
+        int32_t rresult = 0;
+        m_generator[0].block_frame(block0, lresult, rresult);
+        m_generator[1].block_frame(block1, lresult, rresult);
+
+        lresult >>= 1;
+        rresult >>= 1;
+        int16_t left = int16_t((lresult > 32767) ? 32767 : lresult);
+        int16_t right = int16_t((rresult > 32767) ? 32767 : rresult);
+        frame++;
+
+        // looking for a run costs more than a frame when events come on
+        // nearly every frame, so after each empty run the next frames are
+        // computed one by one (for twice as many, up to CMS_RUN_BACKOFF)
+        uint32_t run = 0;
+        if (unchecked > 0)
+            unchecked--;
+        else
+        {
+            run = m_generator[0].block_run(block0, frames - frame);
+            run = m_generator[1].block_run(block1, run);
+            if (run == 0)
+                unchecked = backoff = (backoff == 0) ? 1 : min_run(2 * backoff, CMS_RUN_BACKOFF);
+            else
+                backoff = 0;
+        }
+        dest[0] = left;
+        dest[1] = right;
+        dest += 2;
+        if (run == 0)
+            continue;
+
+        for (uint32_t index = 0; index < run; index++, dest += 2)
+        {
+            dest[0] = left;
+            dest[1] = right;
+        }
+        m_generator[0].block_skip(block0, run);
+        m_generator[1].block_skip(block1, run);
+        frame += run;
+    }
+
+    m_generator[0].block_end(block0);
+    m_generator[1].block_end(block1);
+}
+//
+// same with band-limited tone edges; output is halved and one frame late
+//
+void cms_t::generate_frames_blep(int16_t *dest, uint32_t frames)
+{
+    saa1099_generator_t::block_t block0, block1;
+    m_generator[0].block_begin(block0);
+    m_generator[1].block_begin(block1);
+
+    for (uint32_t frame = 0; frame < frames; frame++, dest += 2)
+    {
+        int32_t lresult = 0;
+        int32_t rresult = 0;
+        int32_t lbefore = 0;
+        int32_t rbefore = 0;
+        m_generator[0].block_frame_blep(block0, lresult, rresult, lbefore, rbefore);
+        m_generator[1].block_frame_blep(block1, lresult, rresult, lbefore, rbefore);
+
+        dest[0] = clamp_sample((m_blep_delayed[0] + lbefore) >> 1);
+        dest[1] = clamp_sample((m_blep_delayed[1] + rbefore) >> 1);
+        m_blep_delayed[0] = lresult;
+        m_blep_delayed[1] = rresult;
+    }
+
+    m_generator[0].block_end(block0);
+    m_generator[1].block_end(block1);
+}
+#endif
+
 //
 // handle reading the detection register (not sure what it really maps to)
 //
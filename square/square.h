@@ -45,7 +45,7 @@
 #ifndef ASG_AUDIO_SQUARE_H
 #define ASG_AUDIO_SQUARE_H
 
-static constexpr uint32_t OUTPUT_FREQUENCY = SAMPLE_RATE / 2;
+static constexpr uint32_t OUTPUT_FREQUENCY = SQUARE_RATE;
 
 
 //===========================================================================
@@ -189,6 +189,13 @@ public:
     void generate_frames(float *dest, uint32_t frames, float gain = 1.0f);
 #else
     void generate_frames(int32_t *dest, uint32_t frames);
+    void generate_frames(int16_t *dest, uint32_t frames);
+
+    // integer block kernel; one sample per frame, as the chip is mono
+    void generate_mono(int16_t *dest, uint32_t frames);
+
+    // same with band-limited edges (polyBLEP), output is one frame late
+    void generate_mono_blep(int16_t *dest, uint32_t frames);
 #endif
 
 private:
@@ -196,6 +203,11 @@ private:
     // internal helpers
     //
     uint32_t step_from_divisor(uint16_t divisor) const;
+#ifndef SQUARE_FLOAT_OUTPUT
+    template<typename _Type> void generate_frames_internal(_Type *dest, uint32_t frames);
+    template<bool _WhiteNoise> void generate_mono_internal(int16_t *dest, uint32_t frames);
+    template<bool _WhiteNoise> void generate_mono_blep_internal(int16_t *dest, uint32_t frames);
+#endif
 
     //
     // internal state
@@ -203,6 +215,7 @@ private:
     uint8_t m_last_freq_chan;
     uint8_t m_noise_control;
     uint16_t m_prng;
+    int32_t m_blep_delayed;
     voice_t m_voice[4];
 };
 
@@ -321,6 +334,37 @@ public:
     void generate_frames(float *dest, uint32_t frames, float gain = 1.0f);
 #else
     void generate_frames(int32_t *dest, uint32_t frames);
+
+    //
+    // integer block kernel: state is copied out for the duration of a block,
+    // and the per-voice volumes (with noise and envelope levels applied) are
+    // recomputed only at the clock edges of the noise generators and envelopes;
+    // after a frame, block_run tells how many following frames are the same
+    // and block_skip advances over them without computing them;
+    // block_frame_blep smooths the tone edges, adding the residuals after an
+    // edge to the results and those before it to lbefore/rbefore (to go to
+    // the previous frame)
+    //
+    struct block_t
+    {
+        bool enable;
+        uint32_t pos[6];
+        uint32_t step[6];
+        uint32_t tone_or[6];
+        int32_t lvolume[6];
+        int32_t rvolume[6];
+        uint32_t noise_pos[2];
+        uint32_t noise_step[2];
+        uint32_t prng[2];
+        uint32_t env_step[2];
+        uint32_t noise_clocked;
+    };
+    void block_begin(block_t &block);
+    void block_frame(block_t &block, int32_t &lresult, int32_t &rresult);
+    void block_frame_blep(block_t &block, int32_t &lresult, int32_t &rresult, int32_t &lbefore, int32_t &rbefore);
+    uint32_t block_run(block_t const &block, uint32_t run) const;
+    void block_skip(block_t &block, uint32_t frames);
+    void block_end(block_t const &block);
 #endif
 
 private:
@@ -329,6 +373,11 @@ private:
     //
     uint32_t step_from_divisor(voice_t &voice);
     uint32_t noise_step(noise_t &noise, int gen);
+    int8_t envelope_level(envelope_t &env);
+#ifndef SQUARE_FLOAT_OUTPUT
+    void block_volume(block_t &block, int voicenum);
+    template<bool _Blep> void block_frame_internal(block_t &block, int32_t &lresult, int32_t &rresult, int32_t &lbefore, int32_t &rbefore);
+#endif
 #ifdef SQUARE_FLOAT_OUTPUT
     template<int _Voicenum> void add_voice(float &lresult, float &rresult, float lvolume, float rvolume);
 #else
@@ -367,6 +416,15 @@ public:
     //
     saa1099_generator_t &generator(int index) { return m_generator[index]; }
 
+#ifndef SQUARE_FLOAT_OUTPUT
+    //
+    // output of both chips as interleaved stereo, rendered in a single pass
+    // (with band-limited edges, the output is one frame late)
+    //
+    void generate_frames(int16_t *dest, uint32_t frames);
+    void generate_frames_blep(int16_t *dest, uint32_t frames);
+#endif
+
     //
     // CMS I/O handlers
     //
@@ -381,6 +439,7 @@ private:
     // internal state
     //
     uint8_t m_register[16];
+    int32_t m_blep_delayed[2];
     saa1099_generator_t m_generator[2];
 };
 
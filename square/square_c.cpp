@@ -1,9 +1,64 @@
 #include "square_c.h"
 #include "square.h"
 
+struct pending_write_t {
+    uint32_t frame;
+    uint32_t address;
+    uint8_t data;
+};
+
+struct write_queue_t {
+    pending_write_t writes[SQUARE_PENDING_WRITES];
+    uint32_t count = 0;
+};
+
+// Returns false if there is no space left (caller applies the write right away rather than losing it, which moves it
+// before the queued ones - the queue is deep enough for the device loops never to get here)
+static bool queue_write(write_queue_t &queue, uint32_t address, uint8_t data, uint32_t frame)
+{
+    if (queue.count == SQUARE_PENDING_WRITES)
+        return false;
+
+    // Keep writes in order
+    if (queue.count > 0 && frame < queue.writes[queue.count - 1].frame)
+        frame = queue.writes[queue.count - 1].frame;
+
+    queue.writes[queue.count++] = { frame, address, data };
+    return true;
+}
+
+// Renders frames in spans between the queued writes, writes after the block stay queued relative to the next one
+template<typename _Apply, typename _Render>
+static void render_with_writes(write_queue_t &queue, uint32_t frames, _Apply apply, _Render render)
+{
+    uint32_t done = 0;
+    uint32_t index = 0;
+    for ( ; index < queue.count && queue.writes[index].frame < frames; index++)
+    {
+        auto &write = queue.writes[index];
+        if (write.frame > done)
+        {
+            render(done, write.frame - done);
+            done = write.frame;
+        }
+        apply(write);
+    }
+    if (done < frames)
+        render(done, frames - done);
+
+    uint32_t kept = 0;
+    for ( ; index < queue.count; index++, kept++)
+    {
+        queue.writes[kept] = queue.writes[index];
+        queue.writes[kept].frame -= frames;
+    }
+    queue.count = kept;
+}
+
 // Tandy part
 struct tandy_t {
     tandysound_t device;
+    write_queue_t queue;
 };
 
 tandy_t *tandy_create(void)
@@ -19,16 +74,67 @@ void tandy_write(tandy_t *tandy, uint8_t data)
     tandy->device.write_register(0xC0, data);
 }
 
+void tandy_write_at(tandy_t *tandy, uint8_t data, uint32_t frame)
+{
+    if (!tandy)
+        return;
+
+    if (!queue_write(tandy->queue, 0xC0, data, frame))
+        tandy->device.write_register(0xC0, data);
+}
+
 int32_t tandy_get_sample(tandy_t *tandy)
 {
     if (!tandy)
         return 0;
 
-    int32_t sample = 0;
-    tandy->device.generator().generate_frames(&sample, 1);
+    int16_t sample;
+    tandy->device.generator().generate_mono(&sample, 1);
     return sample;
 }
 
+void tandy_generate_frames(tandy_t *tandy, int16_t *interleaved, uint32_t frames)
+{
+    if (!tandy)
+        return;
+
+    tandy->device.generator().generate_frames(interleaved, frames);
+}
+
+void tandy_generate_mono(tandy_t *tandy, int16_t *samples, uint32_t frames)
+{
+    if (!tandy)
+        return;
+
+    tandy->device.generator().generate_mono(samples, frames);
+}
+
+void tandy_render_block(tandy_t *tandy, int16_t *interleaved, uint32_t frames)
+{
+    if (!tandy)
+        return;
+
+    render_with_writes(tandy->queue, frames,
+        [tandy](pending_write_t const &write) { tandy->device.write_register(write.address, write.data); },
+        [tandy, interleaved](uint32_t start, uint32_t count)
+        {
+            // Mono samples are rendered right into the span, then spread to both channels in place
+            // (going backwards, frame i never overwrites a mono sample not yet spread)
+            int16_t *dest = interleaved + 2 * start;
+#if SQUARE_BLEP
+            tandy->device.generator().generate_mono_blep(dest, count);
+#else
+            tandy->device.generator().generate_mono(dest, count);
+#endif
+            for (uint32_t i = count; i-- > 0; )
+            {
+                int16_t sample = dest[i];
+                dest[2 * i] = sample;
+                dest[2 * i + 1] = sample;
+            }
+        });
+}
+
 void tandy_destroy(tandy_t *tandy)
 {
     if (!tandy)
@@ -40,6 +146,7 @@ void tandy_destroy(tandy_t *tandy)
 //gameblaster part
 struct gameblaster_t {
     ::cms_t device;
+    write_queue_t queue;
 };
 
 gameblaster_t *gameblaster_create(void) {
@@ -57,6 +164,11 @@ void gameblaster_write(gameblaster_t *gameblaster, uint32_t address, uint8_t dat
         gameblaster->device.write_addr(address, data);
 }
 
+void gameblaster_write_at(gameblaster_t *gameblaster, uint32_t address, uint8_t data, uint32_t frame) {
+    if (!queue_write(gameblaster->queue, address, data, frame))
+        gameblaster_write(gameblaster, address, data);
+}
+
 void gameblaster_get_sample(gameblaster_t *gameblaster, int32_t *left, int32_t *right) {
     int32_t buffer[2] = {0, 0};
 
@@ -65,4 +177,17 @@ void gameblaster_get_sample(gameblaster_t *gameblaster, int32_t *left, int32_t *
 
     *left  = buffer[0];
     *right = buffer[1];
+}
+
+void gameblaster_render_block(gameblaster_t *gameblaster, int16_t *interleaved, uint32_t frames) {
+    render_with_writes(gameblaster->queue, frames,
+        [gameblaster](pending_write_t const &write) { gameblaster_write(gameblaster, write.address, write.data); },
+        [gameblaster, interleaved](uint32_t start, uint32_t count)
+        {
+#if SQUARE_BLEP
+            gameblaster->device.generate_frames_blep(interleaved + 2 * start, count);
+#else
+            gameblaster->device.generate_frames(interleaved + 2 * start, count);
+#endif
+        });
 }
\ No newline at end of file
@@ -13,6 +13,9 @@ extern "C" {
  * Since it is just API for the square.c library, both square_c.cpp and square_c.h are also licensed under the BSD 3-clause license.
  */
 
+// Writes waiting for their frame in the next render_block calls (device loops pass up to LPT_PENDING_WRITES per block)
+#define SQUARE_PENDING_WRITES 256
+
 /**
  * Tandy part (chip SN76486)
  */
@@ -44,6 +47,48 @@ void tandy_write(tandy_t *tandy, uint8_t data);
  */
 int32_t tandy_get_sample(tandy_t *tandy);
 
+/**
+ * @brief Sends new data into Tandy, applied right before given frame of the next tandy_render_block.
+ * @note Writes must come in order of their frames. Frames past the block are kept for the following blocks.
+ * 
+ * @param tandy is a pointer to the loaded Tandy device.
+ * @param data is raw data, input to the Tandy device.
+ * @param frame is the frame (counted from the start of the next block) the write belongs to.
+ */
+void tandy_write_at(tandy_t *tandy, uint8_t data, uint32_t frame);
+
+/**
+ * @brief Generates multiple frames from the Tandy device straight into given buffer.
+ * @note Frames are stored (not mixed) as interleaved stereo pairs, so a reserved ringbuffer span can be passed.
+ * 
+ * @param tandy is a pointer to the loaded Tandy device.
+ * @param interleaved is a pointer to the output buffer (must hold 2 * frames samples).
+ * @param frames is number of frames to be generated.
+ */
+void tandy_generate_frames(tandy_t *tandy, int16_t *interleaved, uint32_t frames);
+
+/**
+ * @brief Generates multiple mono samples from the Tandy device (integer block kernel, faster than tandy_generate_frames).
+ * @note Output equals the left (or right) channel of tandy_generate_frames.
+ * 
+ * @param tandy is a pointer to the loaded Tandy device.
+ * @param samples is a pointer to the output buffer (must hold frames samples).
+ * @param frames is number of samples to be generated.
+ */
+void tandy_generate_mono(tandy_t *tandy, int16_t *samples, uint32_t frames);
+
+/**
+ * @brief Renders a block of frames with the writes passed by tandy_write_at applied at their frames.
+ * @note Frames are stored (not mixed) as interleaved stereo pairs, so a reserved ringbuffer span can be passed.
+ *       Output needs no saturation, four voices at full volume stay within 16 bits.
+ *       With SQUARE_BLEP the edges are band-limited (output is one frame late and saturated to 16 bits).
+ * 
+ * @param tandy is a pointer to the loaded Tandy device.
+ * @param interleaved is a pointer to the output buffer (must hold 2 * frames samples).
+ * @param frames is number of frames to be generated.
+ */
+void tandy_render_block(tandy_t *tandy, int16_t *interleaved, uint32_t frames);
+
 /**
  * @brief Destroys (unloads) given Tandy device.
  * 
@@ -73,6 +118,17 @@ gameblaster_t *gameblaster_create(void);
  */
 void gameblaster_write(gameblaster_t *gameblaster, uint32_t address, uint8_t data);
 
+/**
+ * @brief Sends new data into gameblaster, applied right before given frame of the next gameblaster_render_block.
+ * @note Writes must come in order of their frames. Frames past the block are kept for the following blocks.
+ * 
+ * @param gameblaster is a pointer to the loaded gameblaster device.
+ * @param address is an address where data should be placed.
+ * @param data is raw data, input to the gameblaster device.
+ * @param frame is the frame (counted from the start of the next block) the write belongs to.
+ */
+void gameblaster_write_at(gameblaster_t *gameblaster, uint32_t address, uint8_t data, uint32_t frame);
+
 /**
  * @brief Gets a sample from the gameblaster device.
  * 
@@ -82,6 +138,17 @@ void gameblaster_write(gameblaster_t *gameblaster, uint32_t address, uint8_t dat
  */
 void gameblaster_get_sample(gameblaster_t *gameblaster, int32_t *left, int32_t *right);
 
+/**
+ * @brief Renders a block of frames of both chips with the writes passed by gameblaster_write_at applied at their frames.
+ * @note Frames are stored (not mixed) as interleaved stereo pairs at half the level of gameblaster_get_sample,
+ *       saturated to 16 bits. With SQUARE_BLEP the tone edges are band-limited (output is one frame late).
+ * 
+ * @param gameblaster is a pointer to the loaded gameblaster device.
+ * @param interleaved is a pointer to the output buffer (must hold 2 * frames samples).
+ * @param frames is number of frames to be generated.
+ */
+void gameblaster_render_block(gameblaster_t *gameblaster, int16_t *interleaved, uint32_t frames);
+
 /**
  * @brief Destroys (unloads) given gameblaster device.
  * 